@@ -20,6 +20,7 @@
 #include "fmt/format.h"
 
 #include "sbutils/FolderDiff.hpp"
+#include "sbutils/IoUring.hpp"
 #include "sbutils/Timer.hpp"
 #include "sbutils/UtilsTBB.hpp"
 
@@ -35,12 +36,18 @@ int main(int argc, char *argv[]) {
     std::string database;
     std::vector<std::string> dstPaths;
     unsigned int numberOfThreads;
+    unsigned int queueDepth;
 
     // clang-format off
     desc.add_options()
         ("help,h", "Print this help")
         ("verbose,v", "Display more information.")
+        ("quick", "Do not list folders whose time stamps have not changed. Files that are modified in place are not copied.")
         ("max-threads", po::value<unsigned int>(&numberOfThreads)->default_value(2), "Specify the maximum number of used threads.")
+        ("io-uring", "Copy files using io_uring, which keeps many files in flight and suits high-latency destinations such as network file systems.")
+        ("queue-depth", po::value<unsigned int>(&queueDepth)->default_value(32), "The number of files that are copied at once using io_uring.")
+        ("fsync", "Flush copied files to the storage when io_uring is used.")
+        ("delta", "Update modified files by writing only their changed blocks like rsync.")
         ("src_dir,s", po::value<std::vector<std::string>>(&srcPaths), "Source folder.")
         ("dst_dir,d", po::value<std::vector<std::string>>(&dstPaths), "Destination sandbox.")
         ("database,b", po::value<std::string>(&database)->default_value(sbutils::Resources::Database), "File database.");
@@ -55,6 +62,9 @@ int main(int argc, char *argv[]) {
     if (vm.count("help")) {
         std::cout << desc;
         fmt::print("Examples:\n\tmcopydiff -s src_folder -d dest_folder\n");
+        fmt::print("\tmcopydiff -s src_folder -d /nfs/dest --io-uring --queue-depth 64\n");
+        fmt::print("\tmcopydiff -s src_folder -d dest_folder --delta\n");
+        fmt::print("\tmcopydiff -s src_folder -d dest_folder1 -d dest_folder2\n");
         return 0;
     }
 
@@ -81,43 +91,75 @@ int main(int argc, char *argv[]) {
         tbb::task_scheduler_init task_scheduler(numberOfThreads);
         std::vector<sbutils::FileInfo> allEditedFiles, allNewFiles, allDeletedFiles;
         std::tie(allEditedFiles, allDeletedFiles, allNewFiles) =
-            sbutils::diffFolders_tbb(database, srcDir, verbose);
+            sbutils::diffFolders_tbb(database, srcDir, verbose, vm.count("quick"));
 
         // We will copy new files and edited files to the destiation
         // folder. We also remove all deleted files in the destination
         // folder.
         sbutils::ElapsedTime<sbutils::SECOND> e("Copy files: ", verbose);
 
-        auto runObj = [&allEditedFiles, &allNewFiles, &allDeletedFiles,
-                       verbose](const std::string &aDstDir) {
-            createParentFolders(aDstDir, allEditedFiles, verbose);
-            createParentFolders(aDstDir, allNewFiles, verbose);
+        const bool useIoUring = vm.count("io-uring");
+        const bool useDelta = vm.count("delta");
+        const bool sync = vm.count("fsync");
+        using Results = std::vector<std::tuple<size_t, size_t>>;
 
-            std::tuple<size_t, size_t> results1, results2;
-            size_t results3;
-
-            auto copyEditedFileObj = [&allEditedFiles, &aDstDir, verbose, &results1]() {
-                results1 = sbutils::copyFiles_tbb(allEditedFiles, aDstDir, verbose);
-            };
-
-            auto copyNewFileObj = [&allNewFiles, &aDstDir, verbose, &results2]() {
-                results2 = sbutils::copyFiles_tbb(allNewFiles, aDstDir, verbose);
-            };
-
-            auto deleteFileObj = [&allDeletedFiles, &aDstDir, verbose, &results3]() {
-                results3 = sbutils::deleteFiles(allDeletedFiles, aDstDir, verbose);
-            };
+        auto forEachDestination = [&dstDir](auto &&func) {
+            tbb::parallel_for(size_t(0), dstDir.size(),
+                              [&func](const size_t idx) { func(idx); });
+        };
 
-            tbb::parallel_invoke(copyEditedFileObj, copyNewFileObj, deleteFileObj);
+        // Source files are read once for all destinations unless io_uring or
+        // delta updates are requested.
+        auto copyObj = [&](const std::vector<sbutils::FileInfo> &files, bool isModified) {
+            const bool isDelta = isModified && useDelta;
+            if ((dstDir.size() > 1) && !useIoUring && !isDelta) {
+                return sbutils::copyFiles_fanout(files, dstDir, verbose);
+            }
+            Results results(dstDir.size());
+            forEachDestination([&](const size_t idx) {
+                if (isDelta) {
+                    results[idx] = sbutils::copyFiles_delta(files, dstDir[idx], verbose);
+                } else if (useIoUring) {
+                    results[idx] =
+                        sbutils::copyFiles_uring(files, dstDir[idx], verbose, queueDepth, sync);
+                } else {
+                    results[idx] = sbutils::copyFiles_tbb(files, dstDir[idx], verbose);
+                }
+            });
+            return results;
+        };
 
-            fmt::print("==== Summary for {} ====\n", aDstDir);
-            fmt::print("\tCopied {0} modified files ({1} bytes)\n", std::get<0>(results1),
-                       std::get<1>(results1));
-            fmt::print("\tCopied {0} new files ({1} bytes)\n", std::get<0>(results2),
-                       std::get<1>(results2));
-            fmt::print("\tDelete {0} files\n", results3);
+        forEachDestination([&](const size_t idx) {
+            createParentFolders(dstDir[idx], allEditedFiles, verbose);
+            createParentFolders(dstDir[idx], allNewFiles, verbose);
+        });
+
+        Results results1, results2;
+        std::vector<size_t> results3(dstDir.size());
+        auto copyEditedFileObj = [&]() { results1 = copyObj(allEditedFiles, true); };
+        auto copyNewFileObj = [&]() { results2 = copyObj(allNewFiles, false); };
+        auto deleteFileObj = [&]() {
+            forEachDestination([&](const size_t idx) {
+                results3[idx] = sbutils::deleteFiles(allDeletedFiles, dstDir[idx], verbose);
+            });
         };
 
-        std::for_each(dstDir.begin(), dstDir.end(), runObj);
+        sbutils::Timer timer;
+        tbb::parallel_invoke(copyEditedFileObj, copyNewFileObj, deleteFileObj);
+        const double seconds = std::max(timer.toc() / timer.ticksPerSecond(), 1e-6);
+
+        for (size_t idx = 0; idx < dstDir.size(); ++idx) {
+            auto const &edited = results1[idx], &added = results2[idx];
+            const size_t numberOfFiles = std::get<0>(edited) + std::get<0>(added);
+            const size_t numberOfBytes = std::get<1>(edited) + std::get<1>(added);
+            fmt::print("==== Summary for {} ====\n", dstDir[idx]);
+            fmt::print("\tCopied {0} modified files ({1} bytes)\n", std::get<0>(edited),
+                       std::get<1>(edited));
+            fmt::print("\tCopied {0} new files ({1} bytes)\n", std::get<0>(added),
+                       std::get<1>(added));
+            fmt::print("\tDelete {0} files\n", results3[idx]);
+            fmt::print("\tThroughput: {0:.1f} MB/s, {1:.1f} files/s\n",
+                       numberOfBytes / seconds / (1 << 20), numberOfFiles / seconds);
+        }
     }
 }
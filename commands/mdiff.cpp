@@ -5,9 +5,12 @@
 
 #include <array>
 #include <chrono>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <tuple>
@@ -23,6 +26,8 @@
 #include "sbutils/DataStructures.hpp"
 #include "sbutils/FileSearch.hpp"
 #include "sbutils/FolderDiff.hpp"
+#include "sbutils/Generations.hpp"
+#include "sbutils/Query.hpp"
 #include "sbutils/Timer.hpp"
 
 #include <sstream>
@@ -32,25 +37,41 @@
 #include "tbb/task_scheduler_init.h"
 
 namespace {
-    struct NormalFilter {
-      public:
-        bool isValid(sbutils::FileInfo &item) {
-            return (std::find(ExcludedExtensions.begin(), ExcludedExtensions.end(),
-                              item.Extension) == ExcludedExtensions.end());
-        }
-
-      private:
-        std::vector<std::string> ExcludedExtensions = {};
-    };
-
     template <typename Container, typename Filter>
-    void print(Container &data, Filter &f, const std::string &prefix) {
-        for (auto item : data) {
+    void print(fmt::MemoryWriter &writer, const Container &data, const Filter &f,
+               const std::string &prefix) {
+        for (auto const &item : data) {
             if (f.isValid(item)) {
-                fmt::print("{0}{1}\n", prefix, item.Path);
+                writer << prefix << item.Path << "\n";
             }
         }
     }
+
+    /**
+     * Print the differences of each folder as soon as the folder is diffed.
+     * Differences of a folder are printed together.
+     */
+    template <typename Filter> class DiffPrinter {
+      public:
+        explicit DiffPrinter(const Filter &f) : CustomFilter(f), Mutex() {}
+
+        template <typename Container>
+        void operator()(const Container &modifiedFiles, const Container &deletedFiles,
+                        const Container &newFiles) {
+            fmt::MemoryWriter writer;
+            print(writer, modifiedFiles, CustomFilter, "*");
+            print(writer, newFiles, CustomFilter, "+");
+            print(writer, deletedFiles, CustomFilter, "-");
+            if (writer.size() > 0) {
+                std::lock_guard<std::mutex> lock(Mutex);
+                std::fwrite(writer.data(), 1, writer.size(), stdout);
+            }
+        }
+
+      private:
+        const Filter &CustomFilter;
+        std::mutex Mutex;
+    };
 } // namespace
 
 int main(int argc, char *argv[]) {
@@ -61,15 +82,26 @@ int main(int argc, char *argv[]) {
 
     std::string dataFile;
     std::vector<std::string> folders;
+    std::string expression;
+    std::string otherDatabase;
+    std::string otherFolder;
+    std::string at;
+    std::string to;
     unsigned int numberOfThreads;
 
     // clang-format off
     desc.add_options()
         ("help,h", "Print this help")
         ("verbose,v", "Display searched data.")
+        ("quick", "Do not list folders whose time stamps have not changed. Files that are modified in place are not detected.")
 		("max-threads", po::value<unsigned int>(&numberOfThreads)->default_value(2), "Specify the maximum number of used threads.")
         ("folders,f", po::value<std::vector<std::string>>(&folders), "Search folders.")
-        ("database,d", po::value<std::string>(&dataFile)->default_value(sbutils::Resources::Database), "File information database.");
+        ("query,q", po::value<std::string>(&expression), "Only display files that match a query expression e.g \"not ext:.o,.so\".")
+        ("database,d", po::value<std::string>(&dataFile)->default_value(sbutils::Resources::Database), "File information database.")
+        ("with,w", po::value<std::string>(&otherDatabase), "Compare the database with another file information database instead of the file system.")
+        ("with-folder", po::value<std::string>(&otherFolder), "The folder of the other database that matches the given folder e.g another sandbox.")
+        ("at", po::value<std::string>(&at), "Use a saved generation of the database as the baseline. A generation is given by its id, its offset from the latest generation e.g -1, or a local time e.g \"2024-05-01 13:30\".")
+        ("to", po::value<std::string>(&to), "Compare with a saved generation of the other database, or of the database if --with is not given, instead of the file system.");
     // clang-format on
 
     po::positional_options_description p;
@@ -80,11 +112,15 @@ int main(int argc, char *argv[]) {
 
     if (vm.count("help")) {
         std::cout << desc;
-        fmt::print("Example:\n\tmdiff prod/\n");
+        fmt::print("Example:\n\tmdiff prod/\n\tmdiff prod/ -q \"ext:.cpp,.hpp\"\n");
+        fmt::print("\tmdiff -d build_a.db -w build_b.db prod/\n");
+        fmt::print("\tmdiff --at=-2 --to=-1 prod/\n");
         return 0;
     }
 
-    if (folders.empty()) {
+    // All folders of two databases can be compared.
+    const bool isFileSystem = otherDatabase.empty() && to.empty();
+    if (folders.empty() && isFileSystem) {
         fmt::print("You must provide folder paths!\n");
         return EXIT_FAILURE;
     }
@@ -97,15 +133,33 @@ int main(int argc, char *argv[]) {
     {
         tbb::task_scheduler_init task_scheduler(numberOfThreads);
         sbutils::ElapsedTime<sbutils::SECOND> e("Diff time: ", verbose);
-        std::vector<sbutils::FileInfo> allEditedFiles, allNewFiles, allDeletedFiles;
 
-        std::tie(allEditedFiles, allDeletedFiles, allNewFiles) =
-            sbutils::diffFolders_tbb(dataFile, folders, verbose);
+        // Results are displayed while other folders are still being diffed.
+        const sbutils::Query f(sbutils::query::parse(expression));
+        DiffPrinter<sbutils::Query> printer(f);
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(dataFile));
+        if (isFileSystem) {
+            const auto searchFolders = sbutils::search_roots(folders);
+            const auto table = sbutils::open_vertex_table(*db, at, searchFolders, verbose);
+            sbutils::diff_folders_pipeline(table, searchFolders, printer, verbose,
+                                           vm.count("quick"));
+        } else {
+            std::unique_ptr<rocksdb::DB> other;
+            if (!otherDatabase.empty()) {
+                if (!boost::filesystem::exists(otherDatabase)) {
+                    throw std::runtime_error("File information database \"" +
+                                             otherDatabase + "\" does not exist\n");
+                }
+                other.reset(sbutils::open(otherDatabase));
+            }
 
-        // Now we will display the results
-        NormalFilter f;
-        print(allEditedFiles, f, "*");
-        print(allNewFiles, f, "+");
-        print(allDeletedFiles, f, "-");
+            // Generations of the same database only read vertexes that differ.
+            const auto firstTable = sbutils::open_vertex_table(*db, at, folders, verbose);
+            const auto secondTable = sbutils::open_vertex_table(
+                other ? *other : *db, to, sbutils::other_folders(folders, otherFolder),
+                verbose);
+            sbutils::diff_vertex_tables(firstTable, secondTable, folders, printer, verbose,
+                                        otherFolder);
+        }
     }
 }
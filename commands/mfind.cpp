@@ -3,9 +3,12 @@
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 
 #include <array>
-#include <fstream>
+#include <atomic>
+#include <cstdio>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -14,25 +17,165 @@
 
 #include "fmt/format.h"
 
+#include "sbutils/Exec.hpp"
 #include "sbutils/FileSearch.hpp"
 #include "sbutils/Print.hpp"
+#include "sbutils/Query.hpp"
 #include "sbutils/Timer.hpp"
 #include "sbutils/Utils.hpp"
+#include "sbutils/Writers.hpp"
+
+#include "tbb/concurrent_queue.h"
+#include "tbb/task_scheduler_init.h"
+
+namespace {
+    /**
+     * Write buffers to a file using a dedicated thread. Producers push
+     * buffers into a bounded concurrent queue so they never wait for the
+     * output unless the queue is full.
+     */
+    class QueueWriter {
+      public:
+        explicit QueueWriter(std::FILE *output, std::ptrdiff_t capacity = 1024)
+            : Output(output), Queue(), Writer() {
+            Queue.set_capacity(capacity);
+            Writer = std::thread([this]() { write(); });
+        }
+
+        ~QueueWriter() { close(); }
+
+        void push(std::string &&data) {
+            if (!data.empty()) {
+                Queue.push(std::move(data));
+            }
+        }
+
+        // Flush all pending buffers and stop the writer thread.
+        void close() {
+            if (Writer.joinable()) {
+                Queue.push(std::string());
+                Writer.join();
+            }
+        }
+
+      private:
+        std::FILE *Output;
+        tbb::concurrent_bounded_queue<std::string> Queue;
+        std::thread Writer;
+
+        void write() {
+            std::string data;
+            while (true) {
+                Queue.pop(data);
+                if (data.empty()) {
+                    break; // An empty buffer marks the end of the output.
+                }
+                std::fwrite(data.data(), 1, data.size(), Output);
+            }
+            std::fflush(Output);
+        }
+    };
+
+    using Formatter = void (*)(std::string &, const sbutils::FileInfo &);
+
+    // Format matched files of a folder and pass them to a writer. Matched
+    // files are also exported to a second writer if it is given.
+    class MatchPrinter {
+      public:
+        MatchPrinter(QueueWriter &writer, bool verbose, QueueWriter *exportWriter = nullptr,
+                     Formatter format = nullptr)
+            : Writer(writer), Verbose(verbose), ExportWriter(exportWriter), Format(format),
+              Counter(0) {}
+
+        void operator()(const std::vector<sbutils::FileInfo> &files) {
+            fmt::MemoryWriter buffer;
+            for (auto const &val : files) {
+                if (Verbose) {
+                    buffer.write("({0}, {1}, {2}, {3})\n", val.Path, val.Size, val.Permissions,
+                                 val.TimeStamp);
+                } else {
+                    buffer << val.Path << "\n";
+                }
+            }
+            Counter += files.size();
+            Writer.push(buffer.str());
+
+            if (ExportWriter != nullptr) {
+                std::string records;
+                for (auto const &val : files) {
+                    Format(records, val);
+                }
+                ExportWriter->push(std::move(records));
+            }
+        }
+
+        size_t size() const { return Counter; }
+
+      private:
+        QueueWriter &Writer;
+        bool Verbose;
+        QueueWriter *ExportWriter;
+        Formatter Format;
+        std::atomic<size_t> Counter;
+    };
+
+    // Pass matched files of a folder to a command executor. Matched files
+    // are also exported to a writer if it is given.
+    class MatchExecutor {
+      public:
+        explicit MatchExecutor(sbutils::CommandExecutor &executor,
+                               QueueWriter *exportWriter = nullptr, Formatter format = nullptr)
+            : Executor(executor), ExportWriter(exportWriter), Format(format), Counter(0) {}
+
+        void operator()(const std::vector<sbutils::FileInfo> &files) {
+            for (auto const &val : files) {
+                Executor.push(val.Path);
+            }
+            Counter += files.size();
+
+            if (ExportWriter != nullptr) {
+                std::string records;
+                for (auto const &val : files) {
+                    Format(records, val);
+                }
+                ExportWriter->push(std::move(records));
+            }
+        }
+
+        size_t size() const { return Counter; }
+
+      private:
+        sbutils::CommandExecutor &Executor;
+        QueueWriter *ExportWriter;
+        Formatter Format;
+        std::atomic<size_t> Counter;
+    };
+} // namespace
 
 int main(int argc, char *argv[]) {
     using namespace boost;
     namespace po = boost::program_options;
     po::options_description desc("Allowed options");
+    unsigned int numberOfThreads;
+    size_t numberOfJobs;
 
     // clang-format off
     desc.add_options()
         ("help,h", "Print this help")
         ("verbose,v", "Display searched data.")
-        ("toJSON,j", po::value<std::string>(), "Output results in a JSON file.")
+        ("toJSON,j", po::value<std::string>(), "Write matched files to a JSON Lines file.")
+        ("toBinary", po::value<std::string>(), "Write matched files to a compact binary file.")
         ("folders,f", po::value<std::vector<std::string>>(), "Search folders.")
         ("file-stems,s", po::value<std::vector<std::string>>(), "File stems.")
         ("extensions,e", po::value<std::vector<std::string>>(), "File extensions.")
-        ("pattern,p", po::value<std::string>(), "A search pattern.");
+        ("pattern,p", po::value<std::string>(), "A search pattern.")
+        ("ignore-case,i", "Ignore case when matching extensions, stems, and search patterns.")
+        ("query,q", po::value<std::string>(), "A query expression e.g \"ext:.cpp and not path:/test/\".")
+        ("exec", po::value<std::string>(), "Run a command for each matched file. \"{}\" is replaced by the file path, otherwise the path is appended.")
+        ("exec-batch", po::value<std::string>(), "Run a command for groups of matched files. Each group is as large as the system argument limit allows.")
+        ("jobs", po::value<size_t>(&numberOfJobs)->default_value(tbb::task_scheduler_init::default_num_threads()), "The maximum number of commands executed concurrently.")
+        ("parallel,P", "Search folders in parallel and display matched files as soon as they are found.")
+        ("max-threads", po::value<unsigned int>(&numberOfThreads)->default_value(tbb::task_scheduler_init::default_num_threads()), "Specify the maximum number of used threads in the parallel mode.");
     // clang-format on
 
     po::positional_options_description p;
@@ -49,9 +192,21 @@ int main(int argc, char *argv[]) {
     auto verbose = vm.count("verbose");
     sbutils::ElapsedTime<sbutils::MILLISECOND> timer("Total time: ", verbose);
     
-    std::string jsonFile;
+    // Matched files can be exported to a JSON Lines or a binary file.
+    std::string exportFile;
+    Formatter exportFormat = nullptr;
+    std::string exportHeader;
+    if (vm.count("toJSON") && vm.count("toBinary")) {
+        throw std::runtime_error("--toJSON and --toBinary cannot be used together");
+    }
     if (vm.count("toJSON")) {
-        jsonFile = vm["toJSON"].as<std::string>();
+        exportFile = vm["toJSON"].as<std::string>();
+        exportFormat = sbutils::JSONLinesFormat::append;
+        sbutils::JSONLinesFormat::header(exportHeader);
+    } else if (vm.count("toBinary")) {
+        exportFile = vm["toBinary"].as<std::string>();
+        exportFormat = sbutils::BinaryFormat::append;
+        sbutils::BinaryFormat::header(exportHeader);
     }
 
     using boost::filesystem::path;
@@ -79,23 +234,94 @@ int main(int argc, char *argv[]) {
         pattern = vm["pattern"].as<std::string>();
     }
 
+    // Compile all constraints into a single query.
+    using sbutils::query::PredicateType;
+    std::vector<sbutils::query::Expr> terms;
+    if (!extensions.empty()) {
+        terms.push_back(sbutils::query::leaf({PredicateType::Extension, extensions, 0}));
+    }
+    if (!stems.empty()) {
+        terms.push_back(sbutils::query::leaf({PredicateType::Stem, stems, 0}));
+    }
+    if (!pattern.empty()) {
+        terms.push_back(sbutils::query::leaf({PredicateType::Path, {pattern}, 0}));
+    }
+    if (vm.count("query")) {
+        terms.push_back(sbutils::query::parse(vm["query"].as<std::string>()));
+    }
+    const sbutils::Query query(sbutils::query::all_of(std::move(terms)), sbutils::StringTable(),
+                               vm.count("ignore-case"));
+
     // Search for files in the given folders.
     using path = boost::filesystem::path;
     using Container = std::vector<path>;
-    sbutils::filesystem::SimpleVisitor<Container, sbutils::filesystem::NormalPolicy> visitor;
     Container searchFolders;
     for (auto item : folders) {
         searchFolders.emplace_back(path(item));
     }
+
+    std::unique_ptr<sbutils::CommandExecutor> executor;
+    if (vm.count("exec") || vm.count("exec-batch")) {
+        const bool isBatch = vm.count("exec-batch");
+        executor = std::make_unique<sbutils::CommandExecutor>(
+            vm[isBatch ? "exec-batch" : "exec"].as<std::string>(), isBatch, numberOfJobs,
+            verbose);
+    }
+
+    // Filter files while folders are visited in parallel and stream matched
+    // files to stdout or to the executed command.
+    if (vm.count("parallel")) {
+        tbb::task_scheduler_init task_scheduler(numberOfThreads);
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> exportOutput(nullptr, std::fclose);
+        std::unique_ptr<QueueWriter> exportWriter;
+        if (!exportFile.empty()) {
+            exportOutput.reset(std::fopen(exportFile.c_str(), "wb"));
+            if (!exportOutput) {
+                throw std::runtime_error("Cannot open \"" + exportFile + "\" for writing");
+            }
+            exportWriter = std::make_unique<QueueWriter>(exportOutput.get());
+            exportWriter->push(std::move(exportHeader));
+        }
+
+        if (executor) {
+            MatchExecutor consumer(*executor, exportWriter.get(), exportFormat);
+            using Visitor =
+                sbutils::filesystem::StreamVisitor<sbutils::filesystem::NormalPolicy,
+                                                   sbutils::Query, MatchExecutor>;
+            const Visitor visitor(query, consumer);
+            sbutils::filesystem::parallel_file_search(searchFolders, visitor);
+            if (exportWriter) {
+                exportWriter->close();
+            }
+            return (executor->finish() > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
+        QueueWriter writer(stdout);
+        MatchPrinter printer(writer, verbose, exportWriter.get(), exportFormat);
+        using Visitor = sbutils::filesystem::StreamVisitor<sbutils::filesystem::NormalPolicy,
+                                                           sbutils::Query, MatchPrinter>;
+        const Visitor visitor(query, printer);
+        sbutils::filesystem::parallel_file_search(searchFolders, visitor);
+        writer.close();
+        if (exportWriter) {
+            exportWriter->close();
+        }
+        if (verbose) {
+            fmt::print("Number of files: {}\n", printer.size());
+        }
+        return 0;
+    }
+
+    sbutils::filesystem::SimpleVisitor<Container, sbutils::filesystem::NormalPolicy> visitor;
     sbutils::filesystem::dfs_file_search(searchFolders, visitor);
     auto const & results = visitor.getResults();
-    const sbutils::ExtFilter<std::vector<std::string>> f1(extensions);
-    const sbutils::StemFilter<std::vector<std::string>> f2(stems);
-    const sbutils::SimpleFilter f3(pattern);
-    auto data =
-        (pattern.empty()) ? sbutils::filter(results, f1, f2) : sbutils::filter(results, f1, f2, f3);
+    auto data = query.empty() ? results : sbutils::filter(results, query);
 
-    if (verbose) {
+    if (executor) {
+        for (auto const &val : data) {
+            executor->push(val.Path);
+        }
+    } else if (verbose) {
         fmt::print("Search folders:\n");
         for (const auto &val : folders) {
             fmt::print("{}\n", val);
@@ -111,18 +337,16 @@ int main(int argc, char *argv[]) {
                       [](auto const &val) { fmt::print("{0}\n", val.Path); });
     }
 
-	// Write results to a JSON file.
-    if (!jsonFile.empty()) {
-        std::ostringstream os;
-        {
-            cereal::JSONOutputArchive oar(os);
-            oar("Search results", results);
+    // Stream matched files to the export file.
+    if (!exportFile.empty()) {
+        sbutils::BufferedWriter output(exportFile);
+        output.write(exportHeader);
+        for (auto const &val : data) {
+            exportFormat(output.buffer(), val);
+            output.commit();
         }
-
-        // Write to a JSON file
-        std::ofstream myfile(jsonFile);
-        myfile << os.str() << std::endl;
+        output.flush();
     }
 
-    return 0;
+    return (executor && (executor->finish() > 0)) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
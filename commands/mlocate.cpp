@@ -4,24 +4,134 @@
 
 #include "boost/program_options.hpp"
 #include <array>
+#include <atomic>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "sbutils/CommandUtils.hpp"
+#include "sbutils/Exec.hpp"
 #include "sbutils/FileSearch.hpp"
 #include "sbutils/FileUtils.hpp"
 #include "sbutils/FolderDiff.hpp"
+#include "sbutils/QueryServer.hpp"
 #include "sbutils/Resources.hpp"
 #include "sbutils/Timer.hpp"
 #include "sbutils/UtilsTBB.hpp"
 
 #include "tbb/task_scheduler_init.h"
 
-template <typename Container> void print(Container &&results) {
+namespace {
+    // Write matched files to stdout as soon as they are found and stop the
+    // search after a given number of files.
+    class StreamPrinter {
+      public:
+        explicit StreamPrinter(size_t limit)
+            : Limit((limit == 0) ? std::numeric_limits<size_t>::max() : limit), Counter(0),
+              Mutex() {}
+
+        template <typename Container> bool operator()(const Container &matches) {
+            const size_t begin = Counter.fetch_add(matches.size());
+            if (begin >= Limit) {
+                return false;
+            }
+            const size_t nitems = std::min(matches.size(), Limit - begin);
+            fmt::MemoryWriter writer;
+            for (size_t idx = 0; idx < nitems; ++idx) {
+                writer << matches[idx]->Path << "\n";
+            }
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                std::fwrite(writer.data(), 1, writer.size(), stdout);
+            }
+            return (begin + nitems) < Limit;
+        }
+
+      private:
+        const size_t Limit;
+        std::atomic<size_t> Counter;
+        std::mutex Mutex;
+    };
+
+    // Pass matched files to a command executor and stop the search after a
+    // given number of files.
+    class ExecConsumer {
+      public:
+        ExecConsumer(sbutils::CommandExecutor &executor, size_t limit)
+            : Executor(executor),
+              Limit((limit == 0) ? std::numeric_limits<size_t>::max() : limit), Counter(0) {}
+
+        template <typename Container> bool operator()(const Container &matches) {
+            const size_t begin = Counter.fetch_add(matches.size());
+            if (begin >= Limit) {
+                return false;
+            }
+            const size_t nitems = std::min(matches.size(), Limit - begin);
+            for (size_t idx = 0; idx < nitems; ++idx) {
+                Executor.push(matches[idx]->Path);
+            }
+            return (begin + nitems) < Limit;
+        }
+
+      private:
+        sbutils::CommandExecutor &Executor;
+        const size_t Limit;
+        std::atomic<size_t> Counter;
+    };
+
+    // Write matched files of batch queries to stdout. Each line starts with
+    // the id of its query and the limit applies to each query.
+    class BatchPrinter {
+      public:
+        BatchPrinter(const std::vector<sbutils::BatchQuery> &queries, size_t limit)
+            : Queries(queries),
+              Limit((limit == 0) ? std::numeric_limits<size_t>::max() : limit),
+              Counters(queries.size()), NumberOfFinishedQueries(0), Mutex() {
+            for (auto &aCounter : Counters) {
+                aCounter = 0;
+            }
+        }
+
+        template <typename Container> bool operator()(const Container &matches) {
+            fmt::MemoryWriter writer;
+            for (auto const &item : matches) {
+                const size_t count = Counters[item.first]++;
+                if (count >= Limit) {
+                    continue;
+                }
+                if (count + 1 == Limit) {
+                    ++NumberOfFinishedQueries;
+                }
+                writer << Queries[item.first].Id << "\t" << item.second->Path << "\n";
+            }
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                std::fwrite(writer.data(), 1, writer.size(), stdout);
+            }
+            return NumberOfFinishedQueries < Queries.size();
+        }
+
+      private:
+        const std::vector<sbutils::BatchQuery> &Queries;
+        const size_t Limit;
+        std::vector<std::atomic<size_t>> Counters;
+        std::atomic<size_t> NumberOfFinishedQueries;
+        std::mutex Mutex;
+    };
+} // namespace
+
+template <typename Container> void print_scores(Container &&results, bool verbose) {
     fmt::MemoryWriter writer;
-    std::for_each(results.begin(), results.end(),
-                  [&writer](auto const &item) { writer << item.Path << "\n"; });
+    std::for_each(results.begin(), results.end(), [&writer, verbose](auto const &item) {
+        if (verbose) {
+            writer << item.Score << "\t";
+        }
+        writer << item.Item.Path << "\n";
+    });
     fmt::print("{}", writer.str());
 }
 
@@ -30,6 +140,7 @@ int main(int argc, char *argv[]) {
     po::options_description desc("Allowed options");
     sbutils::MLocateArgs args;
     unsigned int numberOfThreads;
+    size_t numberOfJobs;
 
     // clang-format off
     desc.add_options()
@@ -40,6 +151,22 @@ int main(int argc, char *argv[]) {
         ("stems,s", po::value<std::vector<std::string>>(&args.Stems), "File stems.")
         ("extensions,e", po::value<std::vector<std::string>>(&args.Extensions), "File extensions.")
         ("pattern,p", po::value<std::string>(&args.Pattern), "Search string pattern.")
+        ("ignore-case,i", "Ignore case when matching extensions, stems, and search patterns.")
+        ("query,q", po::value<std::string>(&args.Expression), "A query expression e.g \"ext:.cpp,.hpp and not path:/test/ and (size>1M or mtime<1d)\".")
+        ("fuzzy,z", "Rank files using fuzzy matching and display the best matches.")
+        ("top-k", po::value<size_t>(&args.TopK)->default_value(50), "The maximum number of displayed files in the fuzzy mode.")
+        ("min-size", po::value<std::string>(&args.MinSize), "Minimum file size e.g 100, 10K, 4M, or 1G.")
+        ("max-size", po::value<std::string>(&args.MaxSize), "Maximum file size e.g 100, 10K, 4M, or 1G.")
+        ("newer-than", po::value<std::string>(&args.NewerThan), "Files modified within a given duration e.g 30m, 1h, or 2d.")
+        ("perm", po::value<std::string>(&args.Permissions), "Permission bits in octal that files must have e.g 111.")
+        ("limit,n", po::value<size_t>(&args.Limit)->default_value(0), "Stop after finding a given number of files.")
+        ("count,c", "Only display the number of matched files.")
+        ("exec", po::value<std::string>(), "Run a command for each matched file. \"{}\" is replaced by the file path, otherwise the path is appended.")
+        ("exec-batch", po::value<std::string>(), "Run a command for groups of matched files. Each group is as large as the system argument limit allows.")
+        ("jobs", po::value<size_t>(&numberOfJobs)->default_value(tbb::task_scheduler_init::default_num_threads()), "The maximum number of commands executed concurrently.")
+        ("no-server", "Read the database directly instead of using a running query server.")
+        ("at", po::value<std::string>(&args.At), "Search a saved generation given by its id, its offset from the latest generation e.g -1, or a local time e.g \"2024-05-01 13:30\".")
+        ("batch", po::value<std::string>(), "Run all queries of a file, or stdin if it is \"-\", using a single database scan. Each line is a query expression optionally prefixed by an id and a tab.")
         ("database,d", po::value<std::string>(&args.Database)->default_value(sbutils::Resources::Database), "File database.");
     // clang-format on
 
@@ -54,6 +181,14 @@ int main(int argc, char *argv[]) {
         std::cout << desc;
         std::cout << "Examples:\n";
         std::cout << "\t mlocate -d .database -s AutoFix\n";
+        std::cout << "\t mlocate -z autfx -e .cpp --top-k 20\n";
+        std::cout << "\t mlocate --newer-than 1h --min-size 1M\n";
+        std::cout << "\t mlocate -e .cpp -n 10\n";
+        std::cout << "\t mlocate -i autofix\n";
+        std::cout << "\t mlocate -e .cpp --batch queries.txt\n";
+        std::cout << "\t mlocate --at=-1 -s AutoFix\n";
+        std::cout << "\t mlocate -e .cpp --exec-batch \"clang-format -i\"\n";
+        std::cout << "\t mlocate -q \"(ext:.cpp or ext:.hpp) and not stem:main\"\n";
         std::cout << "\t mlocate -s AutoFix # if the current folder contains a file "
                      "information database i.e \".database\" folder\n";
         return 0;
@@ -69,6 +204,9 @@ int main(int argc, char *argv[]) {
     }
 
     args.Verbose = vm.count("verbose");
+    args.Fuzzy = vm.count("fuzzy");
+    args.CountOnly = vm.count("count");
+    args.IgnoreCase = vm.count("ignore-case");
     sbutils::ElapsedTime<sbutils::MILLISECOND> timer("Total time: ", args.Verbose);
     tbb::task_scheduler_init task_scheduler(numberOfThreads);
 
@@ -76,6 +214,77 @@ int main(int argc, char *argv[]) {
         std::cout << "Database: " << args.Database << std::endl;
     }
 
+    // Matched files are passed to the executed command while the search is
+    // still running.
+    std::unique_ptr<sbutils::CommandExecutor> executor;
+    if (vm.count("exec") || vm.count("exec-batch")) {
+        if (args.CountOnly || vm.count("batch")) {
+            throw std::runtime_error("--exec and --exec-batch cannot be used with --count or --batch");
+        }
+        const bool isBatch = vm.count("exec-batch");
+        executor = std::make_unique<sbutils::CommandExecutor>(
+            vm[isBatch ? "exec-batch" : "exec"].as<std::string>(), isBatch, numberOfJobs,
+            args.Verbose);
+    }
+    auto finish = [&executor]() {
+        return (executor && (executor->finish() > 0)) ? EXIT_FAILURE : EXIT_SUCCESS;
+    };
+
+    // Run all batch queries using a single scan of the database.
+    if (vm.count("batch")) {
+        const auto queries = sbutils::read_batch_queries(vm["batch"].as<std::string>());
+        if (args.CountOnly) {
+            const auto counters = sbutils::BatchCountFiles(args, queries);
+            for (size_t idx = 0; idx < queries.size(); ++idx) {
+                fmt::print("{0}\t{1}\n", queries[idx].Id, counters[idx]);
+            }
+        } else if (!queries.empty()) {
+            BatchPrinter printer(queries, args.Limit);
+            sbutils::BatchLocateFiles(args, queries, printer);
+        }
+        return 0;
+    }
+
+    // Use the query server of the database if it is running. The server
+    // only has the latest state of the database.
+    if (!args.Fuzzy && !vm.count("no-server") && args.At.empty()) {
+        using sbutils::protocol::MessageType;
+        const auto type = args.CountOnly ? MessageType::Count : MessageType::Query;
+        auto writeObj = [&executor](const std::string &data) {
+            if (!executor) {
+                std::fwrite(data.data(), 1, data.size(), stdout);
+                return;
+            }
+            size_t begin = 0;
+            for (size_t end = data.find('\n'); end != std::string::npos;
+                 begin = end + 1, end = data.find('\n', begin)) {
+                executor->push(data.substr(begin, end - begin));
+            }
+        };
+        if (sbutils::request_server(sbutils::socket_path(args.Database), type,
+                                    sbutils::protocol::encode(args), writeObj)) {
+            return finish();
+        }
+    }
+
     // Display files that match given constraints.
-    print(sbutils::LocateFiles(args));
+    if (args.Fuzzy) {
+        const auto results = sbutils::FuzzyLocateFiles(args);
+        if (executor) {
+            for (auto const &item : results) {
+                executor->push(item.Item.Path);
+            }
+        } else {
+            print_scores(results, args.Verbose);
+        }
+    } else if (args.CountOnly) {
+        fmt::print("{}\n", sbutils::CountFiles(args));
+    } else if (executor) {
+        ExecConsumer consumer(*executor, args.Limit);
+        sbutils::LocateFiles(args, consumer);
+    } else {
+        StreamPrinter printer(args.Limit);
+        sbutils::LocateFiles(args, printer);
+    }
+    return finish();
 }
@@ -0,0 +1,60 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "boost/program_options.hpp"
+#include <iostream>
+#include <string>
+
+#include "sbutils/QueryServer.hpp"
+#include "sbutils/Resources.hpp"
+#include "sbutils/Timer.hpp"
+
+#include "tbb/task_scheduler_init.h"
+
+int main(int argc, char *argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    std::string database;
+    std::string socketPath;
+    unsigned int numberOfThreads;
+
+    // clang-format off
+    desc.add_options()
+        ("help,h", "Print this help")
+        ("verbose,v", "Display verbose information.")
+        ("max-threads", po::value<unsigned int>(&numberOfThreads)->default_value(tbb::task_scheduler_init::default_num_threads()), "Specify the maximum number of used threads.")
+        ("socket", po::value<std::string>(&socketPath), "The socket path. The default value is the database path followed by \".sock\".")
+        ("database,d", po::value<std::string>(&database)->default_value(sbutils::Resources::Database), "File database.");
+    // clang-format on
+
+    po::positional_options_description p;
+    p.add("database", -1);
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << "Usage: mlocated [options]\n";
+        std::cout << desc;
+        std::cout << "Examples:\n";
+        std::cout << "\t mlocated -d .database & # mlocate will use this server for "
+                     "\".database\" if it is running.\n";
+        return 0;
+    }
+
+    if (!boost::filesystem::exists(database)) {
+        throw std::runtime_error("File information database \"" + database +
+                                 "\" does not exist\n");
+    }
+
+    if (socketPath.empty()) {
+        socketPath = sbutils::socket_path(database);
+    }
+
+    bool verbose = vm.count("verbose");
+    tbb::task_scheduler_init task_scheduler(numberOfThreads);
+    sbutils::QueryServer server(database, socketPath, verbose);
+    server.run();
+    return 0;
+}
@@ -0,0 +1,157 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "boost/program_options.hpp"
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sbutils/CommandUtils.hpp"
+#include "sbutils/ContentIndex.hpp"
+#include "sbutils/ContentSearch.hpp"
+#include "sbutils/Resources.hpp"
+#include "sbutils/Timer.hpp"
+
+#include "tbb/task_scheduler_init.h"
+#include "tbb/tbb.h"
+
+namespace {
+    /**
+     * Search the content of files that are found in the database. Files of
+     * each chunk are searched in parallel and matched lines are written to
+     * stdout as soon as a group of files is searched. Files that cannot
+     * contain the searched string according to the content index are not
+     * opened.
+     */
+    class ContentPrinter {
+      public:
+        ContentPrinter(const sbutils::ContentSearcher &searcher,
+                       const sbutils::ContentCandidates &candidates)
+            : Searcher(searcher), Candidates(candidates), NumberOfFiles(0),
+              NumberOfSkippedFiles(0), NumberOfBinaryFiles(0), NumberOfMatchedLines(0),
+              Mutex() {}
+
+        template <typename Container> bool operator()(const Container &files) {
+            auto searchObj = [this, &files](const tbb::blocked_range<size_t> &r) {
+                std::string buffer;
+                std::string output;
+                for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                    if (!Candidates.isCandidate(*files[idx])) {
+                        ++NumberOfSkippedFiles;
+                        continue;
+                    }
+                    const std::string &aPath = files[idx]->Path;
+                    const sbutils::FileContent content(aPath, buffer);
+                    if (!content.isValid()) {
+                        continue;
+                    }
+                    ++NumberOfFiles;
+                    if (sbutils::is_binary(content.begin(), content.end())) {
+                        ++NumberOfBinaryFiles;
+                        continue;
+                    }
+                    NumberOfMatchedLines +=
+                        Searcher.search(aPath, content.begin(), content.end(), output);
+                }
+                if (!output.empty()) {
+                    std::lock_guard<std::mutex> lock(Mutex);
+                    std::fwrite(output.data(), 1, output.size(), stdout);
+                }
+            };
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, files.size(), 4), searchObj);
+            return true;
+        }
+
+        void print() const {
+            fmt::print("Number of searched files: {}\n", NumberOfFiles);
+            fmt::print("Number of files skipped using the content index: {}\n",
+                       NumberOfSkippedFiles);
+            fmt::print("Number of skipped binary files: {}\n", NumberOfBinaryFiles);
+            fmt::print("Number of matched lines: {}\n", NumberOfMatchedLines);
+        }
+
+      private:
+        const sbutils::ContentSearcher &Searcher;
+        const sbutils::ContentCandidates &Candidates;
+        std::atomic<size_t> NumberOfFiles;
+        std::atomic<size_t> NumberOfSkippedFiles;
+        std::atomic<size_t> NumberOfBinaryFiles;
+        std::atomic<size_t> NumberOfMatchedLines;
+        std::mutex Mutex;
+    };
+} // namespace
+
+int main(int argc, char *argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    sbutils::MLocateArgs args;
+    std::string text;
+    unsigned int numberOfThreads;
+
+    // clang-format off
+    desc.add_options()
+        ("help,h", "Print this help")
+        ("verbose,v", "Display verbose information.")
+        ("max-threads", po::value<unsigned int>(&numberOfThreads)->default_value(tbb::task_scheduler_init::default_num_threads()), "Specify the maximum number of used threads.")
+        ("text,t", po::value<std::string>(&text), "The searched string.")
+        ("folders,f", po::value<std::vector<std::string>>(&args.Folders), "Search folders.")
+        ("stems,s", po::value<std::vector<std::string>>(&args.Stems), "File stems.")
+        ("extensions,e", po::value<std::vector<std::string>>(&args.Extensions), "File extensions.")
+        ("pattern,p", po::value<std::string>(&args.Pattern), "Only search files whose paths contain a given pattern.")
+        ("query,q", po::value<std::string>(&args.Expression), "A query expression that searched files must satisfy.")
+        ("ignore-case,i", "Ignore case when matching the searched string and file names.")
+        ("files-with-matches,l", "Only display the paths of matched files.")
+        ("no-index", "Do not use the content index of the database.")
+        ("database,d", po::value<std::string>(&args.Database)->default_value(sbutils::Resources::Database), "File database.");
+    // clang-format on
+
+    po::positional_options_description p;
+    p.add("text", -1);
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || text.empty()) {
+        std::cout << "Usage: msearch [options] text\n";
+        std::cout << desc;
+        std::cout << "Examples:\n";
+        std::cout << "\t msearch -d .database -e .cpp -e .hpp read_baseline\n";
+        std::cout << "\t msearch -i -l -f src/ \"todo\"\n";
+        return vm.count("help") ? 0 : 1;
+    }
+
+    if (!boost::filesystem::exists(args.Database)) {
+        throw std::runtime_error("File information database \"" + args.Database +
+                                 "\" does not exist\n");
+    }
+
+    args.Verbose = vm.count("verbose");
+    args.IgnoreCase = vm.count("ignore-case");
+    sbutils::ElapsedTime<sbutils::MILLISECOND> timer("Total time: ", args.Verbose);
+    tbb::task_scheduler_init task_scheduler(numberOfThreads);
+
+    // Files are searched while vertexes are still being read from the database.
+    const sbutils::ContentSearcher searcher(text, args.IgnoreCase,
+                                            vm.count("files-with-matches"));
+    std::unique_ptr<sbutils::ContentCandidates> candidates;
+    {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(args.Database));
+        candidates = std::make_unique<sbutils::ContentCandidates>(
+            *db, vm.count("no-index") ? std::string() : text);
+    }
+    if (args.Verbose && candidates->enabled()) {
+        fmt::print("Number of candidate files in the content index: {}\n", candidates->size());
+    }
+    ContentPrinter printer(searcher, *candidates);
+    sbutils::LocateFiles(args, printer);
+
+    if (args.Verbose) {
+        printer.print();
+    }
+    return 0;
+}
@@ -9,9 +9,13 @@
 #include <vector>
 #include <memory>
 
+#include "sbutils/ContentIndex.hpp"
 #include "sbutils/RocksDB.hpp"
 #include "sbutils/FileSearch.hpp"
 #include "sbutils/FileUtils.hpp"
+#include "sbutils/Generations.hpp"
+#include "sbutils/Query.hpp"
+#include "sbutils/QueryServer.hpp"
 #include "sbutils/Resources.hpp"
 #include "sbutils/Timer.hpp"
 
@@ -23,12 +27,18 @@ int main(int argc, char *argv[]) {
     po::options_description desc("Allowed options");
     std::string database;
     std::string cfgFile;
+    std::string maxContentSize;
+    size_t numberOfGenerations;
 
     // clang-format off
     desc.add_options()
         ("help,h", "Print this help")
         ("verbose,v", "Display verbose information.")
         ("folders,f", po::value<std::vector<std::string>>(), "Search folders.")
+        ("content-extensions,x", po::value<std::vector<std::string>>()->multitoken(), "Build a content index for files with given extensions. The extensions are stored in the database and used by later updates.")
+        ("max-content-size", po::value<std::string>(&maxContentSize)->default_value("1M"), "Do not index the content of files larger than a given size.")
+        ("generations", po::value<size_t>(&numberOfGenerations)->default_value(0), "Also save the result as a generation and keep a given number of the latest generations. Generations share the records of unchanged folders.")
+        ("hash", "Compute and cache content hashes of all files so mdiff and mcopydiff can detect changes of files that keep their sizes.")
         ("config,c", po::value<std::string>(&cfgFile)->default_value(".mupdatedb.cfg"), "Search configuratiion.")
         ("database,d", po::value<std::string>(&database)->default_value(".database"), "File database.");
     // clang-format on
@@ -95,6 +105,37 @@ int main(int argc, char *argv[]) {
 
         results.info();
         sbutils::writeToRocksDB(database, results);
+
+        // Update the content index using the new file list.
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        std::vector<std::string> contentExtensions;
+        if (vm.count("content-extensions")) {
+            contentExtensions = vm["content-extensions"].as<std::vector<std::string>>();
+        } else {
+            sbutils::read_value(*db, sbutils::Resources::ContentExtensionKey, contentExtensions);
+        }
+        if (!contentExtensions.empty()) {
+            sbutils::update_content_index(*db, results.AllFiles, contentExtensions,
+                                          sbutils::parse_size(maxContentSize), verbose);
+        }
+
+        // Only files that are new or modified since the last update are hashed.
+        if (vm.count("hash")) {
+            sbutils::update_hashes(*db, results.AllFiles, verbose);
+        }
+
+        // Hashes of files that have been modified or removed are never used again.
+        sbutils::prune_hashes(*db, results.AllFiles, verbose);
+
+        // Keep older states so they can be searched and diffed later.
+        if (numberOfGenerations > 0) {
+            sbutils::save_generation(*db, results, numberOfGenerations, verbose);
+        }
+    }
+
+    // Let a running query server pick up the new data.
+    if (sbutils::notify_server(database) && verbose) {
+        fmt::print("Reloaded the query server of {}\n", database);
     }
 
     // Return
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace sbutils {
+    namespace ascii {
+        inline char to_lower(const char c) {
+            return (static_cast<unsigned char>(c - 'A') < 26) ? static_cast<char>(c + 32) : c;
+        }
+
+        inline std::string to_lower(std::string value) {
+            std::transform(value.begin(), value.end(), value.begin(),
+                           [](const char c) { return to_lower(c); });
+            return value;
+        }
+
+#ifdef __SSE2__
+        namespace detail {
+            // Convert upper case letters of 16 bytes to lower case.
+            inline __m128i to_lower(const __m128i data) {
+                const __m128i isUpper =
+                    _mm_and_si128(_mm_cmpgt_epi8(data, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(data, _mm_set1_epi8('Z' + 1)));
+                return _mm_or_si128(data, _mm_and_si128(isUpper, _mm_set1_epi8(0x20)));
+            }
+
+            inline __m128i load(const char *ptr) {
+                return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+            }
+        } // namespace detail
+#endif
+
+        /**
+         * Compare len bytes of data with a lower case string ignoring the
+         * case of data.
+         */
+        inline bool iequals(const char *data, const char *lowered, size_t len) {
+#ifdef __SSE2__
+            for (; len >= 16; len -= 16, data += 16, lowered += 16) {
+                const __m128i isEqual =
+                    _mm_cmpeq_epi8(detail::to_lower(detail::load(data)), detail::load(lowered));
+                if (_mm_movemask_epi8(isEqual) != 0xFFFF) {
+                    return false;
+                }
+            }
+#endif
+            for (size_t idx = 0; idx < len; ++idx) {
+                if (to_lower(data[idx]) != lowered[idx]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline bool iequals(const char *data, size_t len, const std::string &lowered) {
+            return (len == lowered.size()) && iequals(data, lowered.data(), len);
+        }
+
+        /**
+         * Find the first occurrence of a lower case needle in [begin, end)
+         * ignoring case. Return end if there is not any match.
+         *
+         * The SSE2 version folds 16 bytes at a time and compares them with
+         * the first and the last characters of the needle so only positions
+         * that match both of them are verified.
+         */
+        inline const char *ifind(const char *begin, const char *end,
+                                 const std::string &lowered) {
+            const size_t len = lowered.size();
+            if (len == 0) {
+                return begin;
+            }
+            if (static_cast<size_t>(end - begin) < len) {
+                return end;
+            }
+
+            const char *ptr = begin;
+            const char *last = end - len; // The last possible starting position.
+#ifdef __SSE2__
+            const __m128i first = _mm_set1_epi8(lowered.front());
+            const __m128i back = _mm_set1_epi8(lowered.back());
+            for (; ptr + 16 <= last + 1; ptr += 16) {
+                const __m128i x = detail::to_lower(detail::load(ptr));
+                const __m128i y = detail::to_lower(detail::load(ptr + len - 1));
+                unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(x, first), _mm_cmpeq_epi8(y, back))));
+                while (mask != 0) {
+                    const int offset = __builtin_ctz(mask);
+                    if ((len <= 2) || iequals(ptr + offset + 1, lowered.data() + 1, len - 2)) {
+                        return ptr + offset;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+#endif
+            for (; ptr <= last; ++ptr) {
+                if (iequals(ptr, lowered.data(), len)) {
+                    return ptr;
+                }
+            }
+            return end;
+        }
+
+        /**
+         * Find the first occurrence of a needle in [begin, end) using the
+         * same first and last character filter as ifind. Return end if there
+         * is not any match.
+         */
+        inline const char *find(const char *begin, const char *end, const std::string &needle) {
+            const size_t len = needle.size();
+            if (len == 0) {
+                return begin;
+            }
+            if (static_cast<size_t>(end - begin) < len) {
+                return end;
+            }
+
+            const char *ptr = begin;
+            const char *last = end - len;
+#ifdef __SSE2__
+            const __m128i first = _mm_set1_epi8(needle.front());
+            const __m128i back = _mm_set1_epi8(needle.back());
+            for (; ptr + 16 <= last + 1; ptr += 16) {
+                const __m128i x = detail::load(ptr);
+                const __m128i y = detail::load(ptr + len - 1);
+                unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(x, first), _mm_cmpeq_epi8(y, back))));
+                while (mask != 0) {
+                    const int offset = __builtin_ctz(mask);
+                    if ((len <= 2) ||
+                        (std::memcmp(ptr + offset + 1, needle.data() + 1, len - 2) == 0)) {
+                        return ptr + offset;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+#endif
+            for (; ptr <= last; ++ptr) {
+                if ((*ptr == needle.front()) && (std::memcmp(ptr, needle.data(), len) == 0)) {
+                    return ptr;
+                }
+            }
+            return end;
+        }
+    } // namespace ascii
+} // namespace sbutils
@@ -1,12 +1,18 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <ctime>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "FileUtils.hpp"
 #include "FolderDiff.hpp"
+#include "FuzzySearch.hpp"
+#include "Generations.hpp"
+#include "Query.hpp"
 #include "UtilsTBB.hpp"
 
 namespace sbutils {
@@ -17,18 +23,271 @@ namespace sbutils {
         std::vector<std::string> Stems;
         std::string Pattern;
         std::string Database;
+        bool Fuzzy;
+        size_t TopK;
+        std::string MinSize;
+        std::string MaxSize;
+        std::string NewerThan;
+        std::string Permissions;
+        size_t Limit; // Stop the search after Limit files are found. Zero means no limit.
+        bool CountOnly;
+        std::string Expression; // A query expression, see Query.hpp.
+        bool IgnoreCase;
+        std::string At; // Search a saved generation, see find_generation.
+
+        template <typename Archive> void serialize(Archive &ar) {
+            ar(Folders, Extensions, Stems, Pattern, MinSize, MaxSize, NewerThan, Permissions,
+               Limit, Expression, IgnoreCase);
+        }
     };
 
-    auto LocateFiles(MLocateArgs &args) {
-        using Container = std::vector<sbutils::FileInfo>;
+    /**
+     * Return the parsed constraints of an mlocate command including its query
+     * expression. The search pattern is not included in the fuzzy mode
+     * because it is used for ranking.
+     */
+    inline std::vector<query::Expr> query_terms(const MLocateArgs &args,
+                                                bool usePattern = true) {
+        using query::PredicateType;
+        std::vector<query::Expr> terms;
+        auto addObj = [&terms](PredicateType type, std::vector<std::string> values,
+                               std::intmax_t number) {
+            terms.push_back(query::leaf(query::Predicate{type, std::move(values), number}));
+        };
+        if (!args.Extensions.empty()) {
+            addObj(PredicateType::Extension, args.Extensions, 0);
+        }
+        if (!args.Stems.empty()) {
+            addObj(PredicateType::Stem, args.Stems, 0);
+        }
+        if (usePattern && !args.Pattern.empty()) {
+            addObj(PredicateType::Path, {args.Pattern}, 0);
+        }
+        if (!args.MinSize.empty()) {
+            addObj(PredicateType::MinSize, {}, parse_size(args.MinSize));
+        }
+        if (!args.MaxSize.empty()) {
+            addObj(PredicateType::MaxSize, {}, parse_size(args.MaxSize));
+        }
+        if (!args.NewerThan.empty()) {
+            addObj(PredicateType::NewerThan, {},
+                   std::time(nullptr) - parse_duration(args.NewerThan));
+        }
+        if (!args.Permissions.empty()) {
+            addObj(PredicateType::Permissions, {}, std::stoi(args.Permissions, nullptr, 8));
+        }
+        if (!args.Expression.empty()) {
+            terms.push_back(query::parse(args.Expression));
+        }
+        return terms;
+    }
+
+    // Compile all constraints of an mlocate command into a single query.
+    inline Query compile_query(const MLocateArgs &args, const StringTable &extensions,
+                               bool usePattern = true) {
+        Query aQuery(query::all_of(query_terms(args, usePattern)), extensions, args.IgnoreCase);
+        if (args.Verbose) {
+            fmt::print("Query: {}\n", aQuery.str());
+        }
+        return aQuery;
+    }
+
+    // Return ids of vertexes that might have files satisfying a given query.
+    // Vertex summaries are used to skip all other vertexes.
+    inline std::vector<vertex_index_type> find_candidates(const VertexTable &table,
+                                                          const MLocateArgs &args,
+                                                          const Query &aQuery) {
+        if (aQuery.empty()) {
+            return table.Selected;
+        }
+        auto isValidVertex = [&aQuery](const VertexSummary &summary) {
+            return aQuery.isValid(summary);
+        };
+        return find_vertexes_if(table, isValidVertex, args.Verbose);
+    }
+
+    /**
+     * Read, decode, and filter vertexes in a single parallel pass and pass
+     * matched files to a consumer. The baseline is never materialized so the
+     * memory usage depends on the number of matched files instead of the size
+     * of the database. The consumer gets pointers to matched files, which are
+     * valid until it returns, and returns false to stop the search.
+     */
+    template <typename Consumer>
+    void scan_files(const VertexTable &table, const MLocateArgs &args, const Query &aQuery,
+                    Consumer &&consumer) {
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Scan files: ", args.Verbose);
+        auto filterObj = [&aQuery, &consumer](const std::vector<FileInfo> &files) {
+            std::vector<const FileInfo *> matches;
+            for (auto const &info : files) {
+                if (aQuery.isValid(info)) {
+                    matches.push_back(&info);
+                }
+            }
+            return matches.empty() || consumer(matches);
+        };
+        read_vertexes_tbb(table, find_candidates(table, args, aQuery), filterObj);
+    }
+
+    // Return the vertexes that mlocate searches.
+    inline VertexTable open_vertex_table(rocksdb::DB &db, MLocateArgs &args) {
         std::sort(args.Folders.begin(), args.Folders.end());
-        auto data =
-            sbutils::read_baseline<Container>(args.Database, args.Folders, args.Verbose);
-        const sbutils::ExtFilter<std::vector<std::string>> f1(args.Extensions);
-        const sbutils::StemFilter<std::vector<std::string>> f2(args.Stems);
-        const sbutils::SimpleFilter f3(args.Pattern);
-        auto results = (args.Pattern.empty()) ? filter_tbb(data, f1, f2)
-                                              : filter_tbb(data, f1, f2, f3);
+        return open_vertex_table(db, args.At, args.Folders, args.Verbose);
+    }
+
+    inline auto LocateFiles(MLocateArgs &args) {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(args.Database));
+        const VertexTable table = open_vertex_table(*db, args);
+        const Query aQuery = compile_query(args, table.Extensions);
+        tbb::concurrent_vector<sbutils::FileInfo> results;
+        scan_files(table, args, aQuery, [&results](auto const &matches) {
+            for (auto const item : matches) {
+                results.push_back(*item);
+            }
+            return true;
+        });
+        return results;
+    }
+
+    /**
+     * Stream files that match given constraints to a consumer chunk by chunk.
+     * The consumer returns false to stop the search.
+     */
+    template <typename Consumer> void LocateFiles(MLocateArgs &args, Consumer &&consumer) {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(args.Database));
+        const VertexTable table = open_vertex_table(*db, args);
+        const Query aQuery = compile_query(args, table.Extensions);
+        scan_files(table, args, aQuery, consumer);
+    }
+
+    // Return the number of files that match given constraints.
+    inline size_t CountFiles(MLocateArgs &args) {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(args.Database));
+        const VertexTable table = open_vertex_table(*db, args);
+        const Query aQuery = compile_query(args, table.Extensions);
+        std::atomic<size_t> counter(0);
+        scan_files(table, args, aQuery, [&counter](auto const &matches) {
+            counter += matches.size();
+            return true;
+        });
+        return counter;
+    }
+
+    // Rank all files that satisfy all constraints except the search pattern
+    // using fuzzy matching and return the best TopK files. Only files that
+    // contain the pattern as a subsequence are kept in memory.
+    inline auto FuzzyLocateFiles(MLocateArgs &args) {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(args.Database));
+        const VertexTable table = open_vertex_table(*db, args);
+        const Query aQuery = compile_query(args, table.Extensions, false);
+        const sbutils::FuzzyScorer scorer(args.Pattern);
+        tbb::concurrent_vector<sbutils::FileInfo> candidates;
+        scan_files(table, args, aQuery, [&candidates, &scorer](auto const &matches) {
+            for (auto const item : matches) {
+                if (scorer.score(item->Path) != FuzzyScorer::NoMatch) {
+                    candidates.push_back(*item);
+                }
+            }
+            return true;
+        });
+        return fuzzy_filter_tbb(candidates, scorer, args.TopK);
+    }
+
+    /**
+     * Compile each batch query together with the constraints of the command.
+     * Expressions are parsed separately so a batch query that is not a
+     * valid expression, e.g has unbalanced parentheses, is rejected instead
+     * of changing the meaning of the command expression.
+     */
+    inline std::vector<Query> compile_batch(const MLocateArgs &args,
+                                            const std::vector<BatchQuery> &queries,
+                                            const StringTable &extensions) {
+        const std::vector<query::Expr> terms = query_terms(args);
+        std::vector<Query> results;
+        results.reserve(queries.size());
+        for (auto const &item : queries) {
+            std::vector<query::Expr> queryTerms = terms;
+            if (!item.Expression.empty()) {
+                queryTerms.push_back(query::parse(item.Expression));
+            }
+            results.emplace_back(query::all_of(std::move(queryTerms)), extensions,
+                                 args.IgnoreCase);
+            if (args.Verbose) {
+                fmt::print("Query {0}: {1}\n", item.Id, results.back().str());
+            }
+        }
+        return results;
+    }
+
+    // Return ids of vertexes that might have files satisfying at least one
+    // of given queries.
+    inline std::vector<vertex_index_type>
+    find_batch_candidates(const VertexTable &table, const MLocateArgs &args,
+                          const std::vector<Query> &queries) {
+        auto isEmpty = [](const Query &aQuery) { return aQuery.empty(); };
+        if (queries.empty() || std::any_of(queries.begin(), queries.end(), isEmpty)) {
+            return table.Selected;
+        }
+        auto isValidVertex = [&queries](const VertexSummary &summary) {
+            return std::any_of(
+                queries.begin(), queries.end(),
+                [&summary](const Query &aQuery) { return aQuery.isValid(summary); });
+        };
+        return find_vertexes_if(table, isValidVertex, args.Verbose);
+    }
+
+    /**
+     * Evaluate many queries using a single parallel pass over the database.
+     * The consumer gets the matches of a chunk as (query index, file) pairs
+     * and returns false to stop the search.
+     */
+    template <typename Consumer>
+    void BatchLocateFiles(MLocateArgs &args, const std::vector<BatchQuery> &batch,
+                          Consumer &&consumer) {
+        using Match = std::pair<size_t, const sbutils::FileInfo *>;
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(args.Database));
+        const VertexTable table = open_vertex_table(*db, args);
+        const auto queries = compile_batch(args, batch, table.Extensions);
+        auto searchObj = [&](const std::vector<FileInfo> &files) {
+            std::vector<Match> matches;
+            for (auto const &info : files) {
+                for (size_t qid = 0; qid < queries.size(); ++qid) {
+                    if (queries[qid].isValid(info)) {
+                        matches.emplace_back(qid, &info);
+                    }
+                }
+            }
+            return matches.empty() || consumer(matches);
+        };
+        read_vertexes_tbb(table, find_batch_candidates(table, args, queries), searchObj);
+    }
+
+    // Return the number of matched files of each query.
+    inline std::vector<size_t> BatchCountFiles(MLocateArgs &args,
+                                               const std::vector<BatchQuery> &batch) {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(args.Database));
+        const VertexTable table = open_vertex_table(*db, args);
+        const auto queries = compile_batch(args, batch, table.Extensions);
+
+        const size_t nqueries = queries.size();
+        tbb::enumerable_thread_specific<std::vector<size_t>> counters(
+            [nqueries]() { return std::vector<size_t>(nqueries, 0); });
+        auto countObj = [&](const std::vector<FileInfo> &files) {
+            auto &results = counters.local();
+            for (auto const &info : files) {
+                for (size_t qid = 0; qid < nqueries; ++qid) {
+                    results[qid] += queries[qid].isValid(info);
+                }
+            }
+            return true;
+        };
+        read_vertexes_tbb(table, find_batch_candidates(table, args, queries), countObj);
+
+        std::vector<size_t> results(nqueries, 0);
+        for (auto const &aCounter : counters) {
+            std::transform(aCounter.begin(), aCounter.end(), results.begin(), results.begin(),
+                           std::plus<size_t>());
+        }
         return results;
     }
 } // namespace sbutils
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "fmt/format.h"
+
+#include "AsciiUtils.hpp"
+#include "ContentSearch.hpp"
+#include "DataStructures.hpp"
+#include "FileSearch.hpp"
+#include "FolderDiff.hpp"
+#include "Resources.hpp"
+#include "RocksDB.hpp"
+#include "Timer.hpp"
+
+#include "tbb/tbb.h"
+
+namespace sbutils {
+    namespace content {
+        // A trigram is three case folded bytes packed into an integer.
+        using trigram_type = std::uint32_t;
+        using doc_id_type = std::uint32_t;
+        using posting_list = std::vector<doc_id_type>;
+
+        // An indexed file. Removed files leave empty slots so document ids
+        // of other files never change. Times are in nanoseconds.
+        struct IndexedFile {
+            std::string Path;
+            uintmax_t Size;
+            std::int64_t ModifiedTime;
+            std::int64_t ChangedTime;
+
+            bool empty() const { return Path.empty(); }
+
+            template <typename Archive> void serialize(Archive &ar) {
+                ar(Path, Size, ModifiedTime, ChangedTime);
+            }
+        };
+
+        inline bool is_indexed(const IndexedFile &aDoc, const FileInfo &info) {
+            return (aDoc.Size == info.Size) && (aDoc.ModifiedTime == info.ModifiedTime) &&
+                   (aDoc.ChangedTime == info.ChangedTime);
+        }
+
+        inline std::string document_key(const doc_id_type id) {
+            return Resources::ContentDocumentKey + to_fixed_string(9, id);
+        }
+
+        inline std::string trigram_key(const trigram_type value) {
+            return Resources::TrigramKey + to_fixed_string(8, value);
+        }
+
+        /**
+         * Collect sorted distinct trigrams of a buffer. Seen trigrams are
+         * marked in a bitmap of all 2^24 trigrams, which is cleared using
+         * the collected trigrams, so each buffer is processed in linear time.
+         * An extractor must not be shared between threads.
+         */
+        class TrigramExtractor {
+          public:
+            TrigramExtractor() : Seen((1 << 24) / 64, 0) {}
+
+            std::vector<trigram_type> operator()(const char *begin, const char *end) {
+                std::vector<trigram_type> results;
+                if (end - begin < 3) {
+                    return results;
+                }
+                trigram_type value = (fold(begin[0]) << 8) | fold(begin[1]);
+                for (const char *ptr = begin + 2; ptr != end; ++ptr) {
+                    value = ((value << 8) | fold(*ptr)) & 0xFFFFFF;
+                    std::uint64_t &word = Seen[value >> 6];
+                    const std::uint64_t mask = std::uint64_t(1) << (value & 63);
+                    if ((word & mask) == 0) {
+                        word |= mask;
+                        results.push_back(value);
+                    }
+                }
+                for (auto const item : results) {
+                    Seen[item >> 6] = 0;
+                }
+                std::sort(results.begin(), results.end());
+                return results;
+            }
+
+          private:
+            std::vector<std::uint64_t> Seen;
+
+            static trigram_type fold(const char c) {
+                return static_cast<unsigned char>(ascii::to_lower(c));
+            }
+        };
+
+        // Return sorted distinct trigrams of a short string such as a query.
+        inline std::vector<trigram_type> trigrams(const std::string &text) {
+            std::vector<trigram_type> results;
+            const std::string lowered = ascii::to_lower(text);
+            for (size_t idx = 2; idx < lowered.size(); ++idx) {
+                results.push_back((static_cast<unsigned char>(lowered[idx - 2]) << 16) |
+                                  (static_cast<unsigned char>(lowered[idx - 1]) << 8) |
+                                  static_cast<unsigned char>(lowered[idx]));
+            }
+            std::sort(results.begin(), results.end());
+            results.erase(std::unique(results.begin(), results.end()), results.end());
+            return results;
+        }
+
+        template <typename T> void put(rocksdb::WriteBatch &batch, const std::string &aKey,
+                                       const T &data) {
+            std::ostringstream os;
+            {
+                DefaultOArchive oar(os);
+                oar(data);
+            }
+            batch.Put(aKey, os.str());
+        }
+    } // namespace content
+
+    /**
+     * Update the trigram index of file contents stored in a file information
+     * database. Only files with given extensions and at most maxFileSize
+     * bytes are indexed. A file is re-indexed only if its size, modification
+     * time, or status change time has changed, and only posting lists of
+     * trigrams of added, modified, or removed files are read and written.
+     * Binary files are indexed without any trigram. Return the number of
+     * files that were (re)indexed.
+     */
+    template <typename Container>
+    size_t update_content_index(rocksdb::DB &db, const Container &allFiles,
+                                const std::vector<std::string> &extensions,
+                                const uintmax_t maxFileSize, bool verbose = false) {
+        using namespace content;
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Update content index: ", verbose);
+
+        std::vector<IndexedFile> docs;
+        read_value(db, Resources::ContentFileKey, docs);
+        std::unordered_map<std::string, doc_id_type> lookup;
+        for (size_t id = 0; id < docs.size(); ++id) {
+            if (!docs[id].empty()) {
+                lookup.emplace(docs[id].Path, static_cast<doc_id_type>(id));
+            }
+        }
+
+        // Find files that need to be indexed. Modified files keep their ids.
+        struct Job {
+            doc_id_type Id;
+            bool IsNew;
+            const FileInfo *Info;
+            std::vector<trigram_type> Trigrams;
+        };
+        const std::unordered_set<std::string> exts(extensions.begin(), extensions.end());
+        std::vector<bool> isAlive(docs.size(), false);
+        std::vector<Job> jobs;
+        for (auto const &info : allFiles) {
+            if ((exts.find(info.Extension) == exts.end()) || (info.Size > maxFileSize)) {
+                continue;
+            }
+            auto const pos = lookup.find(info.Path);
+            if (pos == lookup.end()) {
+                jobs.push_back({0, true, &info, {}});
+                continue;
+            }
+            const doc_id_type id = pos->second;
+            isAlive[id] = true;
+            if (!is_indexed(docs[id], info)) {
+                jobs.push_back({id, false, &info, {}});
+            }
+        }
+
+        // Read contents and extract trigrams in parallel.
+        tbb::enumerable_thread_specific<TrigramExtractor> extractors;
+        auto extractObj = [&jobs, &extractors](const tbb::blocked_range<size_t> &r) {
+            TrigramExtractor &extractor = extractors.local();
+            std::string buffer;
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                const FileContent content(jobs[idx].Info->Path, buffer);
+                if (content.isValid() && !is_binary(content.begin(), content.end())) {
+                    jobs[idx].Trigrams = extractor(content.begin(), content.end());
+                }
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, jobs.size(), 4), extractObj);
+
+        // Collect changes of posting lists. Old trigrams of modified and
+        // removed files are read from their document keys.
+        std::map<trigram_type, std::pair<posting_list, posting_list>> changes;
+        rocksdb::WriteBatch batch;
+        auto removeObj = [&db, &changes](const doc_id_type id) {
+            std::vector<trigram_type> oldTrigrams;
+            read_value(db, document_key(id), oldTrigrams);
+            for (auto const item : oldTrigrams) {
+                changes[item].first.push_back(id);
+            }
+        };
+
+        size_t numberOfRemovedFiles = 0;
+        for (size_t id = 0; id < docs.size(); ++id) {
+            if (!docs[id].empty() && !isAlive[id]) {
+                removeObj(static_cast<doc_id_type>(id));
+                batch.Delete(document_key(static_cast<doc_id_type>(id)));
+                docs[id] = IndexedFile();
+                ++numberOfRemovedFiles;
+            }
+        }
+
+        // New files reuse empty slots first.
+        size_t slot = 0;
+        for (auto &aJob : jobs) {
+            if (aJob.IsNew) {
+                while ((slot < docs.size()) && !docs[slot].empty()) {
+                    ++slot;
+                }
+                if (slot == docs.size()) {
+                    docs.emplace_back();
+                }
+                aJob.Id = static_cast<doc_id_type>(slot);
+            } else {
+                removeObj(aJob.Id);
+            }
+            docs[aJob.Id] = IndexedFile{aJob.Info->Path, aJob.Info->Size,
+                                        aJob.Info->ModifiedTime, aJob.Info->ChangedTime};
+            for (auto const item : aJob.Trigrams) {
+                changes[item].second.push_back(aJob.Id);
+            }
+            put(batch, document_key(aJob.Id), aJob.Trigrams);
+        }
+
+        // Rewrite all affected posting lists.
+        for (auto &item : changes) {
+            posting_list ids;
+            read_value(db, trigram_key(item.first), ids);
+            auto &removed = item.second.first;
+            auto &added = item.second.second;
+            std::sort(removed.begin(), removed.end());
+            std::sort(added.begin(), added.end());
+            posting_list results;
+            std::set_difference(ids.begin(), ids.end(), removed.begin(), removed.end(),
+                                std::back_inserter(results));
+            ids.clear();
+            std::set_union(results.begin(), results.end(), added.begin(), added.end(),
+                           std::back_inserter(ids));
+            if (ids.empty()) {
+                batch.Delete(trigram_key(item.first));
+            } else {
+                put(batch, trigram_key(item.first), ids);
+            }
+        }
+
+        put(batch, Resources::ContentFileKey, docs);
+        put(batch, Resources::ContentExtensionKey, extensions);
+        const rocksdb::Status s = db.Write(rocksdb::WriteOptions(), &batch);
+        if (!s.ok()) {
+            throw std::runtime_error("Cannot write the content index: " + s.ToString());
+        }
+
+        if (verbose) {
+            fmt::print("Number of indexed files: {}\n", jobs.size());
+            fmt::print("Number of removed files: {}\n", numberOfRemovedFiles);
+            fmt::print("Number of updated trigrams: {}\n", changes.size());
+        }
+        return jobs.size();
+    }
+
+    /**
+     * Candidate files of a content query. Files that are indexed and up to
+     * date are searched only if their trigrams include all trigrams of the
+     * query. Files that are not indexed are always searched. The database
+     * can be older than the files so a file that would be skipped is checked
+     * using lstat and is searched if it has changed since it was indexed.
+     * This way the index never hides a match.
+     */
+    class ContentCandidates {
+      public:
+        ContentCandidates(rocksdb::DB &db, const std::string &pattern)
+            : Docs(), Lookup(), IsCandidate(), Enabled(false) {
+            using namespace content;
+            const auto queryTrigrams = trigrams(pattern);
+            if (queryTrigrams.empty() || !read_value(db, Resources::ContentFileKey, Docs)) {
+                return; // All files have to be searched.
+            }
+
+            // Intersect the shortest posting lists first.
+            std::vector<posting_list> lists(queryTrigrams.size());
+            for (size_t idx = 0; idx < queryTrigrams.size(); ++idx) {
+                read_value(db, trigram_key(queryTrigrams[idx]), lists[idx]);
+            }
+            std::sort(lists.begin(), lists.end(),
+                      [](auto const &x, auto const &y) { return x.size() < y.size(); });
+            posting_list ids = std::move(lists.front());
+            for (size_t idx = 1; (idx < lists.size()) && !ids.empty(); ++idx) {
+                posting_list results;
+                std::set_intersection(ids.begin(), ids.end(), lists[idx].begin(),
+                                      lists[idx].end(), std::back_inserter(results));
+                ids.swap(results);
+            }
+
+            IsCandidate.assign(Docs.size(), false);
+            for (auto const id : ids) {
+                IsCandidate[id] = true;
+            }
+            Lookup.reserve(Docs.size());
+            for (size_t id = 0; id < Docs.size(); ++id) {
+                if (!Docs[id].empty()) {
+                    Lookup.emplace(Docs[id].Path, static_cast<content::doc_id_type>(id));
+                }
+            }
+            Enabled = true;
+        }
+
+        bool enabled() const { return Enabled; }
+
+        size_t size() const {
+            return std::count(IsCandidate.begin(), IsCandidate.end(), true);
+        }
+
+        // Return false if a file cannot contain the query string.
+        bool isCandidate(const FileInfo &info) const {
+            if (!Enabled) {
+                return true;
+            }
+            auto const pos = Lookup.find(info.Path);
+            if (pos == Lookup.end()) {
+                return true;
+            }
+            if (IsCandidate[pos->second]) {
+                return true;
+            }
+
+            // Only files that would be skipped need to be checked.
+            using filesystem::detail::changed_time;
+            using filesystem::detail::modified_time;
+            auto const &aDoc = Docs[pos->second];
+            struct stat st;
+            return (::lstat(info.Path.c_str(), &st) != 0) ||
+                   (aDoc.Size != static_cast<uintmax_t>(st.st_size)) ||
+                   (aDoc.ModifiedTime != modified_time(st)) ||
+                   (aDoc.ChangedTime != changed_time(st));
+        }
+
+      private:
+        std::vector<content::IndexedFile> Docs;
+        std::unordered_map<std::string, content::doc_id_type> Lookup;
+        std::vector<bool> IsCandidate;
+        bool Enabled;
+    };
+} // namespace sbutils
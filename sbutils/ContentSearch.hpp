@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AsciiUtils.hpp"
+
+namespace sbutils {
+    /**
+     * A read only view of the content of a file. Large files are memory
+     * mapped and small files are read into a caller supplied buffer so
+     * searching many small files does not pay for mmap and munmap calls.
+     */
+    class FileContent {
+      public:
+        enum : size_t { MinMappedSize = 64 * 1024 };
+
+        FileContent(const std::string &aPath, std::string &buffer)
+            : Data(nullptr), Size(0), Mapped(false), Valid(false) {
+            const int fd = ::open(aPath.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+
+            struct stat st;
+            if ((::fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+                ::close(fd);
+                return;
+            }
+
+            const size_t fileSize = static_cast<size_t>(st.st_size);
+            if (fileSize >= MinMappedSize) {
+                void *ptr = ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (ptr != MAP_FAILED) {
+                    ::madvise(ptr, fileSize, MADV_SEQUENTIAL);
+                    Data = static_cast<const char *>(ptr);
+                    Size = fileSize;
+                    Mapped = true;
+                    Valid = true;
+                }
+            } else {
+                buffer.resize(fileSize);
+                size_t nbytes = 0;
+                while (nbytes < fileSize) {
+                    const ssize_t count = ::read(fd, &buffer[nbytes], fileSize - nbytes);
+                    if (count <= 0) {
+                        break;
+                    }
+                    nbytes += static_cast<size_t>(count);
+                }
+                Data = buffer.data();
+                Size = nbytes;
+                Valid = true;
+            }
+            ::close(fd);
+        }
+
+        FileContent(const FileContent &) = delete;
+        FileContent &operator=(const FileContent &) = delete;
+
+        ~FileContent() {
+            if (Mapped) {
+                ::munmap(const_cast<char *>(Data), Size);
+            }
+        }
+
+        bool isValid() const { return Valid; }
+        const char *begin() const { return Data; }
+        const char *end() const { return Data + Size; }
+        size_t size() const { return Size; }
+
+      private:
+        const char *Data;
+        size_t Size;
+        bool Mapped;
+        bool Valid;
+    };
+
+    // Assume that a file is binary if its first 8KB has a null character.
+    inline bool is_binary(const char *begin, const char *end) {
+        const size_t len = std::min<size_t>(end - begin, 8192);
+        return (len > 0) && (std::memchr(begin, 0, len) != nullptr);
+    }
+
+    /**
+     * Search file contents for a literal string. Candidate positions are
+     * found using the SIMD filters of AsciiUtils and each matched line is
+     * reported once as "path:line:text".
+     */
+    class ContentSearcher {
+      public:
+        ContentSearcher(const std::string &pattern, bool ignoreCase, bool filesOnly = false)
+            : Pattern(ignoreCase ? ascii::to_lower(pattern) : pattern), IgnoreCase(ignoreCase),
+              FilesOnly(filesOnly) {}
+
+        /**
+         * Append matched lines of a buffer to the output and return the
+         * number of matched lines. Only the path is appended if the
+         * searcher only reports file names.
+         */
+        size_t search(const std::string &aPath, const char *begin, const char *end,
+                      std::string &output) const {
+            size_t numberOfLines = 0;
+            size_t lineNumber = 1;
+            const char *counted = begin; // Newlines before this position are counted.
+            const char *ptr = begin;
+            while (ptr < end) {
+                const char *pos = IgnoreCase ? ascii::ifind(ptr, end, Pattern)
+                                             : ascii::find(ptr, end, Pattern);
+                if (pos == end) {
+                    break;
+                }
+
+                ++numberOfLines;
+                if (FilesOnly) {
+                    output.append(aPath);
+                    output.push_back('\n');
+                    break;
+                }
+
+                const char *lineBegin = pos;
+                while ((lineBegin != begin) && (*(lineBegin - 1) != '\n')) {
+                    --lineBegin;
+                }
+                const char *lineEnd =
+                    static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+                if (lineEnd == nullptr) {
+                    lineEnd = end;
+                }
+
+                lineNumber += std::count(counted, lineBegin, '\n');
+                counted = lineBegin;
+                output.append(aPath);
+                output.push_back(':');
+                output.append(std::to_string(lineNumber));
+                output.push_back(':');
+                output.append(lineBegin, lineEnd);
+                output.push_back('\n');
+
+                // Continue with the next line.
+                ptr = lineEnd + 1;
+            }
+            return numberOfLines;
+        }
+
+      private:
+        std::string Pattern;
+        bool IgnoreCase;
+        bool FilesOnly;
+    };
+} // namespace sbutils
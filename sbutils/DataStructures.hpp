@@ -1,5 +1,11 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <numeric>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -17,11 +23,64 @@
 #include "boost/functional/hash.hpp"
 #include "graph/SparseGraph.hpp"
 
+#include "Hash.hpp"
+
 namespace sbutils {
 
     using DefaultIArchive = cereal::BinaryInputArchive;
     using DefaultOArchive = cereal::BinaryOutputArchive;
 
+    /**
+     * A table which maps strings such as file extensions to dense integer
+     * ids so that filters can compare integers instead of strings.
+     *
+     */
+    class StringTable {
+      public:
+        using id_type = std::uint32_t;
+        static constexpr id_type NotFound = std::numeric_limits<id_type>::max();
+
+        StringTable() : Strings(), Lookup() {}
+
+        id_type intern(const std::string &value) {
+            auto const pos = Lookup.find(value);
+            if (pos != Lookup.end()) {
+                return pos->second;
+            }
+            const id_type id = static_cast<id_type>(Strings.size());
+            Strings.emplace_back(value);
+            Lookup.emplace(value, id);
+            return id;
+        }
+
+        id_type find(const std::string &value) const {
+            auto const pos = Lookup.find(value);
+            return (pos != Lookup.end()) ? pos->second : NotFound;
+        }
+
+        const std::string &operator[](const id_type id) const { return Strings[id]; }
+
+        size_t size() const { return Strings.size(); }
+
+        template <typename Archive> void save(Archive &ar) const {
+            ar(cereal::make_nvp("strings", Strings));
+        }
+
+        template <typename Archive> void load(Archive &ar) {
+            ar(cereal::make_nvp("strings", Strings));
+            Lookup.clear();
+            Lookup.reserve(Strings.size());
+            for (size_t idx = 0; idx < Strings.size(); ++idx) {
+                Lookup.emplace(Strings[idx], static_cast<id_type>(idx));
+            }
+        }
+
+      private:
+        std::vector<std::string> Strings;
+        std::unordered_map<std::string, id_type> Lookup;
+    };
+    constexpr StringTable::id_type StringTable::NotFound;
+
     /**
      * Defininition for FileInfo data structure.
      *
@@ -30,22 +89,29 @@ namespace sbutils {
     struct FileInfo {
         using String = std::string;
 
-        FileInfo() : Permissions(), Size(), Path(), Stem(), Extension(), TimeStamp() {}
+        FileInfo()
+            : Permissions(), Size(), Path(), Stem(), Extension(), TimeStamp(),
+              ExtId(StringTable::NotFound), Inode(0), ModifiedTime(0), ChangedTime(0) {}
 
         template <typename T1, typename T2, typename T3, typename T4, typename T5, typename T6>
-        FileInfo(T1 &&perms, T2 &&sizes, T3 &&path, T4 &&stem, T5 &&ext,
-                 T6 &&timeStamp) noexcept
+        FileInfo(T1 &&perms, T2 &&sizes, T3 &&path, T4 &&stem, T5 &&ext, T6 &&timeStamp,
+                 StringTable::id_type extId = StringTable::NotFound) noexcept
             : Permissions(std::forward<T1>(perms)), Size(std::forward<T2>(sizes)),
               Path(std::forward<T3>(path)), Stem(std::forward<T4>(stem)),
-              Extension(std::forward<T5>(ext)), TimeStamp(std::forward<T6>(timeStamp)) {}
+              Extension(std::forward<T5>(ext)), TimeStamp(std::forward<T6>(timeStamp)),
+              ExtId(extId), Inode(0), ModifiedTime(0), ChangedTime(0) {}
 
         FileInfo(const FileInfo &info) noexcept
             : Permissions(info.Permissions), Size(info.Size), Path(info.Path), Stem(info.Stem),
-              Extension(info.Extension), TimeStamp(info.TimeStamp) {}
+              Extension(info.Extension), TimeStamp(info.TimeStamp), ExtId(info.ExtId),
+              Inode(info.Inode), ModifiedTime(info.ModifiedTime),
+              ChangedTime(info.ChangedTime) {}
 
         FileInfo(FileInfo &&info) noexcept
             : Permissions(info.Permissions), Size(info.Size), Path(std::move(info.Path)),
-              Stem(info.Stem), Extension(info.Extension), TimeStamp(info.TimeStamp) {}
+              Stem(std::move(info.Stem)), Extension(std::move(info.Extension)),
+              TimeStamp(info.TimeStamp), ExtId(info.ExtId), Inode(info.Inode),
+              ModifiedTime(info.ModifiedTime), ChangedTime(info.ChangedTime) {}
 
         FileInfo &operator=(const FileInfo &rhs) {
             if (this == &rhs) {
@@ -57,11 +123,30 @@ namespace sbutils {
             this->Stem = rhs.Stem;
             this->Extension = rhs.Extension;
             this->TimeStamp = rhs.TimeStamp;
+            this->ExtId = rhs.ExtId;
+            this->Inode = rhs.Inode;
+            this->ModifiedTime = rhs.ModifiedTime;
+            this->ChangedTime = rhs.ChangedTime;
+            return *this;
+        }
+
+        FileInfo &operator=(FileInfo &&rhs) noexcept {
+            this->Permissions = rhs.Permissions;
+            this->Size = rhs.Size;
+            this->Path = std::move(rhs.Path);
+            this->Stem = std::move(rhs.Stem);
+            this->Extension = std::move(rhs.Extension);
+            this->TimeStamp = rhs.TimeStamp;
+            this->ExtId = rhs.ExtId;
+            this->Inode = rhs.Inode;
+            this->ModifiedTime = rhs.ModifiedTime;
+            this->ChangedTime = rhs.ChangedTime;
             return *this;
         }
 
         template <typename Archive> void serialize(Archive &ar) {
-            ar(Permissions, Size, Path, Stem, Extension, TimeStamp);
+            ar(Permissions, Size, Path, Stem, Extension, TimeStamp, ExtId, Inode, ModifiedTime,
+               ChangedTime);
         }
 
         // Data members
@@ -71,6 +156,16 @@ namespace sbutils {
         String Stem;
         String Extension;
         std::time_t TimeStamp;
+
+        // The interned id of Extension. It is only set for files that are
+        // stored in the file information database.
+        StringTable::id_type ExtId;
+
+        // Attributes used to detect modified files. Times are in nanoseconds
+        // since the epoch and all of them are zero if they are unknown.
+        std::uint64_t Inode;
+        std::int64_t ModifiedTime;
+        std::int64_t ChangedTime;
     };
 
     // A file path must be unique.
@@ -80,6 +175,17 @@ namespace sbutils {
         return (lhs.Size == rhs.Size) && (lhs.Path == rhs.Path);
     }
 
+    // A hash of the attributes that StatComparator uses to detect changes.
+    inline std::uint64_t file_signature(const FileInfo &info) {
+        const std::uint64_t attributes[] = {static_cast<std::uint64_t>(info.Size), info.Inode,
+                                            static_cast<std::uint64_t>(info.ModifiedTime),
+                                            static_cast<std::uint64_t>(info.ChangedTime)};
+        XXHash64 h;
+        h.update(info.Path.data(), info.Path.size());
+        h.update(reinterpret_cast<const char *>(attributes), sizeof(attributes));
+        return h.digest();
+    }
+
     /**
      * Definition for the folder hirarchy.
      *
@@ -89,18 +195,120 @@ namespace sbutils {
         std::string Path;
         std::vector<FileInfo> Files;
 
-        explicit Vertex() : Path(), Files() {}
-        Vertex(const Vertex &data) : Path(data.Path), Files(data.Files) {}
+        // The modification time of the folder in nanoseconds or zero if it
+        // is unknown. It changes when entries are added, removed, or renamed.
+        std::int64_t ModifiedTime;
+
+        explicit Vertex() : Path(), Files(), ModifiedTime(0) {}
+        Vertex(const Vertex &data)
+            : Path(data.Path), Files(data.Files), ModifiedTime(data.ModifiedTime) {}
 
         template <typename T>
-        Vertex(T &&data) : Path(std::move(data.Path)), Files(std::move(data.Files)) {}
+        Vertex(T &&data)
+            : Path(std::move(data.Path)), Files(std::move(data.Files)),
+              ModifiedTime(data.ModifiedTime) {}
 
         template <typename T1, typename T2>
-        Vertex(T1 &&aPath, T2 &&files) : Path(std::move(aPath)), Files(std::move(files)) {}
+        Vertex(T1 &&aPath, T2 &&files, std::int64_t modifiedTime = 0)
+            : Path(std::move(aPath)), Files(std::move(files)), ModifiedTime(modifiedTime) {}
+
+        template <typename Archive> void serialize(Archive &ar) {
+            ar(cereal::make_nvp("path", Path), cereal::make_nvp("files", Files),
+               cereal::make_nvp("modified_time", ModifiedTime));
+        }
+    };
+
+    /**
+     * Return the index of the parent of each folder or -1 if the parent of
+     * a folder is not in the list. Folder paths must be normalized.
+     */
+    inline std::vector<std::int64_t> parent_indexes(const std::vector<std::string> &paths) {
+        std::unordered_map<std::string, std::int64_t> lookup;
+        lookup.reserve(paths.size());
+        for (size_t idx = 0; idx < paths.size(); ++idx) {
+            lookup.emplace(paths[idx], static_cast<std::int64_t>(idx));
+        }
+        std::vector<std::int64_t> results(paths.size(), -1);
+        for (size_t idx = 0; idx < paths.size(); ++idx) {
+            const auto pos = paths[idx].rfind('/');
+            if ((pos == std::string::npos) || (pos == 0)) {
+                continue;
+            }
+            auto const it = lookup.find(paths[idx].substr(0, pos));
+            if (it != lookup.end()) {
+                results[idx] = it->second;
+            }
+        }
+        return results;
+    }
+
+    /**
+     * A summary of the files that belong to a vertex. Queries use it to skip
+     * vertexes that cannot have any matched file without reading them.
+     *
+     */
+    struct VertexSummary {
+        VertexSummary()
+            : NumberOfFiles(0), MinSize(std::numeric_limits<uintmax_t>::max()), MaxSize(0),
+              MinTime(std::numeric_limits<std::time_t>::max()),
+              MaxTime(std::numeric_limits<std::time_t>::min()), Permissions(0), ExtBits(0),
+              DirTime(0), FileSignature(0), Signature(0) {}
+
+        template <typename Container>
+        explicit VertexSummary(const Container &files) : VertexSummary() {
+            for (auto const &info : files) {
+                update(info);
+            }
+        }
+
+        void update(const FileInfo &info) {
+            ++NumberOfFiles;
+            FileSignature += file_signature(info);
+            MinSize = std::min(MinSize, info.Size);
+            MaxSize = std::max(MaxSize, info.Size);
+            MinTime = std::min(MinTime, info.TimeStamp);
+            MaxTime = std::max(MaxTime, info.TimeStamp);
+            Permissions |= info.Permissions;
+            ExtBits |= extBit(info.ExtId);
+        }
+
+        // Extension ids are hashed into a 64 bit bitmap so a set bit only
+        // means that a vertex might have files with a given extension.
+        static std::uint64_t extBit(const StringTable::id_type id) {
+            return std::uint64_t(1) << (id & 63);
+        }
 
         template <typename Archive> void serialize(Archive &ar) {
-            ar(cereal::make_nvp("path", Path), cereal::make_nvp("files", Files));
+            ar(NumberOfFiles, MinSize, MaxSize, MinTime, MaxTime, Permissions, ExtBits, DirTime,
+               FileSignature, Signature);
+        }
+
+        // Combine the signatures of this vertex and its sub-vertexes.
+        void sign(const std::uint64_t childSignatures) {
+            const std::uint64_t values[] = {static_cast<std::uint64_t>(NumberOfFiles),
+                                            static_cast<std::uint64_t>(DirTime), FileSignature,
+                                            childSignatures};
+            Signature = xxhash64(reinterpret_cast<const char *>(values), sizeof(values));
         }
+
+        std::size_t NumberOfFiles;
+        uintmax_t MinSize;
+        uintmax_t MaxSize;
+        std::time_t MinTime;
+        std::time_t MaxTime;
+        int Permissions; // The union of permissions of all files.
+        std::uint64_t ExtBits;
+
+        // The modification time of the folder in nanoseconds.
+        std::int64_t DirTime;
+
+        // The sum of file signatures, which does not depend on the order of files.
+        std::uint64_t FileSignature;
+
+        // A Merkle signature of the whole sub-tree i.e files, folder time
+        // stamps, and signatures of sub-vertexes. Equal signatures mean that
+        // sub-trees are the same.
+        std::uint64_t Signature;
     };
 
     template <typename itype> struct FolderHierarchy {
@@ -114,13 +322,21 @@ namespace sbutils {
         using file_container = std::vector<FileInfo>;
 
         template <typename T1, typename T2>
-        FolderHierarchy(T1 &&vertexes, T2 &&edges)
+        FolderHierarchy(T1 &&vertexes, T2 &&edges, StringTable extensions = StringTable())
             : Vertexes(std::move(vertexes)), Graph(std::move(edges), Vertexes.size(), true),
-              AllFiles() {
+              AllFiles(), Extensions(std::move(extensions)), Summaries() {
             update();
         }
 
         void update() {
+            Summaries.clear();
+            Summaries.reserve(Vertexes.size());
+            std::for_each(Vertexes.cbegin(), Vertexes.cend(), [this](auto const &aFolder) {
+                Summaries.emplace_back(VertexSummary(aFolder.Files));
+                Summaries.back().DirTime = aFolder.ModifiedTime;
+            });
+            sign();
+
             std::size_t counter = 0;
             std::for_each(Vertexes.cbegin(), Vertexes.cend(),
                           [&counter](auto const &aFolder) { counter += aFolder.Files.size(); });
@@ -135,12 +351,40 @@ namespace sbutils {
 
         template <typename Archive> void serialize(Archive &ar) {
             ar(cereal::make_nvp("vertexes", Vertexes), cereal::make_nvp("graph", Graph),
-               cereal::make_nvp("all_files", AllFiles));
+               cereal::make_nvp("all_files", AllFiles),
+               cereal::make_nvp("extensions", Extensions),
+               cereal::make_nvp("summaries", Summaries));
+        }
+
+        /**
+         * Compute Merkle signatures of all vertexes bottom-up. A child path
+         * is longer than its parent path so children are signed first.
+         */
+        void sign() {
+            std::vector<std::string> paths;
+            paths.reserve(Vertexes.size());
+            for (auto const &aFolder : Vertexes) {
+                paths.emplace_back(aFolder.Path);
+            }
+            const auto parents = parent_indexes(paths);
+            std::vector<size_t> order(Vertexes.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&paths](size_t x, size_t y) {
+                return paths[x].size() > paths[y].size();
+            });
+            std::vector<std::uint64_t> childSignatures(Vertexes.size(), 0);
+            for (auto const vid : order) {
+                Summaries[vid].sign(childSignatures[vid]);
+                if (parents[vid] >= 0) {
+                    childSignatures[parents[vid]] += Summaries[vid].Signature;
+                }
+            }
         }
 
         void info() const {
             fmt::print("Number of vertexes: {}\n", Vertexes.size());
             fmt::print("Number of files: {}\n", AllFiles.size());
+            fmt::print("Number of extensions: {}\n", Extensions.size());
         }
 
         // Each vertex will have its path and files at the root level. We need
@@ -153,6 +397,12 @@ namespace sbutils {
 
         // All files that belong to given root folders.
         file_container AllFiles;
+
+        // All file extensions. The ExtId of a file is its index in this table.
+        StringTable Extensions;
+
+        // Per vertex summaries which are indexed by vertex ids.
+        std::vector<VertexSummary> Summaries;
     };
 
     struct RootFolder {
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ContentSearch.hpp"
+#include "FileCopy.hpp"
+#include "Hash.hpp"
+
+#include "tbb/parallel_for.h"
+
+namespace sbutils {
+    namespace delta {
+        /**
+         * The rolling checksum of rsync. The checksum of a window can be
+         * updated in constant time when the window moves by one byte, so a
+         * file can be searched for blocks of another file at every offset.
+         */
+        class RollingChecksum {
+          public:
+            RollingChecksum(const char *data, const size_t len) : A(0), B(0), Length(len) {
+                for (size_t idx = 0; idx < len; ++idx) {
+                    A += static_cast<unsigned char>(data[idx]);
+                    B += A;
+                }
+            }
+
+            // Move the window by one byte.
+            void roll(const char out, const char in) {
+                A += static_cast<unsigned char>(in) - static_cast<unsigned char>(out);
+                B += A - static_cast<std::uint32_t>(Length) * static_cast<unsigned char>(out);
+            }
+
+            std::uint32_t value() const { return (B << 16) | (A & 0xffff); }
+
+          private:
+            std::uint32_t A;
+            std::uint32_t B;
+            size_t Length;
+        };
+
+        // Checksums of a block of the destination file.
+        struct BlockSignature {
+            std::uint32_t Weak;
+            std::uint64_t Strong;
+        };
+
+        // A range of the source file that is also found in the destination.
+        struct Match {
+            std::uint64_t SrcOffset;
+            std::uint64_t DstOffset;
+            std::uint64_t Length;
+        };
+
+        // Use about sqrt(size) bytes per block like rsync, rounded to a power
+        // of two between 4KB and 1MB so large files have fewer signatures.
+        inline size_t block_size(const std::uint64_t size) {
+            size_t blockSize = 4096;
+            const double target = std::sqrt(static_cast<double>(size));
+            while ((blockSize < target) && (blockSize < (1 << 20))) {
+                blockSize *= 2;
+            }
+            return blockSize;
+        }
+
+        /**
+         * Compute the signatures of all full blocks of an open file in
+         * parallel. A trailing partial block has no signature and is always
+         * rewritten. Throw std::runtime_error if the file cannot be read.
+         */
+        inline std::vector<BlockSignature> signatures(const int fd, const std::uint64_t size,
+                                                      const size_t blockSize) {
+            std::vector<BlockSignature> results(size / blockSize);
+            auto signObj = [&](const tbb::blocked_range<size_t> &r) {
+                std::string buffer(blockSize, 0);
+                for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                    if (!detail::read_fully(fd, &buffer[0], blockSize, idx * blockSize)) {
+                        throw std::runtime_error(std::string("read: ") + std::strerror(errno));
+                    }
+                    results[idx].Weak = RollingChecksum(buffer.data(), blockSize).value();
+                    results[idx].Strong = xxhash64(buffer.data(), blockSize);
+                }
+            };
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, results.size(), 16), signObj);
+            return results;
+        }
+
+        /**
+         * Find blocks of the destination in the source using the rolling
+         * checksum at every offset that is not covered by a previous match
+         * and confirm candidates using their strong hashes. A block at the
+         * same offset is preferred so unchanged ranges can be kept in place.
+         * Adjacent matches are merged.
+         */
+        inline std::vector<Match> find_matches(const char *data, const size_t size,
+                                               const std::vector<BlockSignature> &blocks,
+                                               const size_t blockSize) {
+            std::vector<Match> results;
+            if (blocks.empty() || (size < blockSize)) {
+                return results;
+            }
+
+            // Sorted weak checksums and a 16-bit filter so most offsets cost
+            // a single table lookup.
+            std::vector<std::pair<std::uint32_t, size_t>> index;
+            index.reserve(blocks.size());
+            std::vector<bool> tags(1 << 16, false);
+            for (size_t idx = 0; idx < blocks.size(); ++idx) {
+                index.emplace_back(blocks[idx].Weak, idx);
+                tags[blocks[idx].Weak >> 16] = true;
+            }
+            std::sort(index.begin(), index.end());
+
+            size_t pos = 0;
+            RollingChecksum checksum(data, blockSize);
+            while (true) {
+                const std::uint32_t weak = checksum.value();
+                size_t matched = blocks.size();
+                if (tags[weak >> 16]) {
+                    auto const range = std::equal_range(
+                        index.begin(), index.end(), std::make_pair(weak, size_t(0)),
+                        [](const std::pair<std::uint32_t, size_t> &lhs,
+                           const std::pair<std::uint32_t, size_t> &rhs) {
+                            return lhs.first < rhs.first;
+                        });
+                    bool isHashed = false;
+                    std::uint64_t strong = 0;
+                    for (auto it = range.first; it != range.second; ++it) {
+                        if (!isHashed) {
+                            strong = xxhash64(data + pos, blockSize);
+                            isHashed = true;
+                        }
+                        if (blocks[it->second].Strong != strong) {
+                            continue;
+                        }
+                        if ((matched == blocks.size()) || (it->second * blockSize == pos)) {
+                            matched = it->second;
+                        }
+                    }
+                }
+
+                if (matched != blocks.size()) {
+                    const std::uint64_t dstOffset = matched * blockSize;
+                    if (!results.empty() &&
+                        (results.back().SrcOffset + results.back().Length == pos) &&
+                        (results.back().DstOffset + results.back().Length == dstOffset)) {
+                        results.back().Length += blockSize;
+                    } else {
+                        results.push_back({pos, dstOffset, blockSize});
+                    }
+                    pos += blockSize;
+                    if (pos + blockSize > size) {
+                        break;
+                    }
+                    checksum = RollingChecksum(data + pos, blockSize);
+                } else {
+                    if (pos + blockSize >= size) {
+                        break;
+                    }
+                    checksum.roll(data[pos], data[pos + blockSize]);
+                    ++pos;
+                }
+            }
+            return results;
+        }
+
+        // Copy a range of one file to a different offset of another file.
+        inline bool copy_block(const int in, std::uint64_t inOffset, const int out,
+                               std::uint64_t outOffset, std::uint64_t len,
+                               std::string &buffer) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+            while (len > 0) {
+                loff_t inPos = inOffset, outPos = outOffset;
+                const ssize_t count =
+                    ::syscall(SYS_copy_file_range, in, &inPos, out, &outPos, len, 0u);
+                if ((count < 0) && (errno == EINTR)) {
+                    continue;
+                }
+                if (count <= 0) {
+                    break;
+                }
+                inOffset += count;
+                outOffset += count;
+                len -= count;
+            }
+#endif
+            if (buffer.size() < (1 << 20)) {
+                buffer.resize(1 << 20);
+            }
+            while (len > 0) {
+                const size_t count = std::min<std::uint64_t>(len, buffer.size());
+                if (!detail::read_fully(in, &buffer[0], count, inOffset) ||
+                    !detail::write_fully(out, buffer.data(), count, outOffset)) {
+                    return false;
+                }
+                inOffset += count;
+                outOffset += count;
+                len -= count;
+            }
+            return true;
+        }
+    } // namespace delta
+
+    // The outcome of updating a destination file from its source.
+    struct DeltaCopyResult {
+        DeltaCopyResult()
+            : Method(CopyMethod::None), IsDelta(false), IsInPlace(false), WrittenBytes(0) {}
+        CopyMethod Method;   // The copy method of a full copy.
+        bool IsDelta;        // Only changed ranges are written.
+        bool IsInPlace;      // Changed ranges are written to the destination itself.
+        size_t WrittenBytes; // The number of bytes that are taken from the source.
+    };
+
+    /**
+     * Update a destination file that already has an older version of its
+     * source by writing only the ranges that have changed. Block signatures
+     * of the destination are computed in parallel and the source is searched
+     * for them using rolling checksums. If every found block is at its
+     * original offset then changed ranges are written in place and the file
+     * is truncated to the new size, so a change of a few KB in a large file
+     * costs a few KB of writes. Otherwise the new version is assembled in a
+     * temporary file next to the destination, found blocks are copied from
+     * the old version, and the temporary file replaces the destination. The
+     * destination still has to be read once to compute its signatures. Small
+     * files, new files, and files without any common block are copied using
+     * copy_file. Throw std::runtime_error if a file cannot be updated.
+     */
+    inline DeltaCopyResult delta_copy(const std::string &srcFile, const std::string &dstFile,
+                                      std::string &buffer,
+                                      const std::uint64_t minSize = 1 << 20) {
+        DeltaCopyResult result;
+        struct stat srcStat, dstStat;
+        auto fullCopy = [&]() {
+            // copy_file throws if the source cannot be read.
+            result.Method = copy_file(srcFile, dstFile, buffer);
+            if (result.Method != CopyMethod::None) {
+                result.WrittenBytes = static_cast<size_t>(srcStat.st_size);
+            }
+            return result;
+        };
+
+        if ((::stat(srcFile.c_str(), &srcStat) != 0) ||
+            (::stat(dstFile.c_str(), &dstStat) != 0) || !S_ISREG(srcStat.st_mode) ||
+            !S_ISREG(dstStat.st_mode) ||
+            (static_cast<std::uint64_t>(srcStat.st_size) < minSize) ||
+            (static_cast<std::uint64_t>(dstStat.st_size) < minSize)) {
+            return fullCopy();
+        }
+        if (detail::is_up_to_date(srcStat, dstStat)) {
+            return result;
+        }
+
+        std::string contentBuffer;
+        FileContent content(srcFile, contentBuffer);
+        FileDescriptor old(::open(dstFile.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!content.isValid() || !old.isValid()) {
+            return fullCopy();
+        }
+        const size_t blockSize = delta::block_size(dstStat.st_size);
+        const auto blocks = delta::signatures(old.get(), dstStat.st_size, blockSize);
+        const auto matches =
+            delta::find_matches(content.begin(), content.size(), blocks, blockSize);
+        if (matches.empty()) {
+            old.close();
+            return fullCopy();
+        }
+
+        auto isAligned = [](const delta::Match &item) {
+            return item.SrcOffset == item.DstOffset;
+        };
+        const bool isInPlace = std::all_of(matches.begin(), matches.end(), isAligned);
+        FileDescriptor out;
+        std::string tmpFile;
+        if (isInPlace) {
+            out = FileDescriptor(::open(dstFile.c_str(), O_WRONLY | O_CLOEXEC));
+        } else {
+            tmpFile = dstFile + ".XXXXXX";
+            out = FileDescriptor(::mkstemp(&tmpFile[0]));
+        }
+        if (!out.isValid()) {
+            // A read-only destination or folder.
+            old.close();
+            return fullCopy();
+        }
+
+        const struct timespec times[2] = {detail::access_timespec(srcStat),
+                                          detail::modification_timespec(srcStat)};
+        bool isOK = true;
+        std::uint64_t pos = 0;
+        auto writeLiteral = [&](const std::uint64_t end) {
+            if (pos < end) {
+                isOK = isOK &&
+                       detail::write_fully(out.get(), content.begin() + pos, end - pos, pos);
+                result.WrittenBytes += end - pos;
+            }
+        };
+        for (auto const &item : matches) {
+            writeLiteral(item.SrcOffset);
+            if (!isInPlace) {
+                isOK = isOK && delta::copy_block(old.get(), item.DstOffset, out.get(),
+                                                 item.SrcOffset, item.Length, buffer);
+            }
+            pos = item.SrcOffset + item.Length;
+        }
+        writeLiteral(content.size());
+        isOK = isOK && (::ftruncate(out.get(), content.size()) == 0) &&
+               (::fchmod(out.get(), srcStat.st_mode & 07777) == 0) &&
+               (::futimens(out.get(), times) == 0) && out.close();
+        if (isOK && !isInPlace && (::rename(tmpFile.c_str(), dstFile.c_str()) != 0)) {
+            isOK = false;
+        }
+        if (!isOK) {
+            const int errcode = errno;
+            if (!tmpFile.empty()) {
+                ::unlink(tmpFile.c_str());
+            }
+            errno = errcode;
+            detail::throw_copy_error("Cannot write", dstFile);
+        }
+
+        result.IsDelta = true;
+        result.IsInPlace = isInPlace;
+        return result;
+    }
+} // namespace sbutils
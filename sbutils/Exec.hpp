@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+#include "Process.hpp"
+
+#include "tbb/concurrent_queue.h"
+
+extern char **environ;
+
+namespace sbutils {
+    namespace detail {
+        /**
+         * Return the number of bytes that arguments of a command can use. The
+         * kernel counts both the strings and the argv/envp pointer arrays
+         * against ARG_MAX so the current environment and a safety margin are
+         * subtracted. Like xargs the budget is capped at 128KiB so a long
+         * list of matches is split into several commands that can run
+         * concurrently.
+         */
+        inline size_t argument_budget() {
+            const long argMax = sysconf(_SC_ARG_MAX);
+            size_t budget = (argMax > 0) ? static_cast<size_t>(argMax) : 4096;
+            size_t envSize = 0;
+            for (char **env = environ; (env != nullptr) && (*env != nullptr); ++env) {
+                envSize += std::strlen(*env) + 1 + sizeof(char *);
+            }
+            const size_t margin = 2048;
+            budget = (budget > envSize + margin) ? (budget - envSize - margin) : 0;
+            return std::min<size_t>(budget, 128 * 1024);
+        }
+
+        inline size_t argument_size(const std::string &arg) {
+            return arg.size() + 1 + sizeof(char *);
+        }
+    } // namespace detail
+
+    /**
+     * Run a command for matched files while they are still being found.
+     *
+     * The command line is split on white spaces and every "{}" argument is
+     * replaced by matched paths. Paths are appended to the command if it
+     * does not have any "{}" argument. In the batch mode paths are grouped
+     * into argument lists that fit in ARG_MAX, otherwise each path gets its
+     * own command. Commands are executed by a fixed number of threads which
+     * are not TBB workers because they spend most of their time waiting for
+     * child processes.
+     */
+    class CommandExecutor {
+      public:
+        CommandExecutor(const std::string &commandLine, bool batch, size_t jobs,
+                        bool verbose = false)
+            : Command(), Arguments(), Batch(batch), Verbose(verbose),
+              Budget(detail::argument_budget()), FixedSize(0), Paths(), PathsSize(0),
+              Mutex(), OutputMutex(), Queue(), Workers(), NumberOfFailures(0) {
+            std::istringstream is(commandLine);
+            std::string arg;
+            while (is >> arg) {
+                Arguments.emplace_back(arg);
+            }
+            if (Arguments.empty()) {
+                throw std::runtime_error("The executed command is empty");
+            }
+            Command = Arguments.front();
+            Arguments.erase(Arguments.begin());
+            if (std::none_of(Arguments.begin(), Arguments.end(), isPlaceholder)) {
+                Arguments.emplace_back("{}");
+            }
+            for (auto const &item : Arguments) {
+                FixedSize += isPlaceholder(item) ? 0 : detail::argument_size(item);
+            }
+            FixedSize += detail::argument_size(Command);
+            if (FixedSize >= Budget) {
+                throw std::runtime_error("The executed command is too long");
+            }
+
+            jobs = std::max<size_t>(jobs, 1);
+            Queue.set_capacity(static_cast<std::ptrdiff_t>(4 * jobs));
+            for (size_t idx = 0; idx < jobs; ++idx) {
+                Workers.emplace_back([this]() { work(); });
+            }
+        }
+
+        CommandExecutor(const CommandExecutor &) = delete;
+        CommandExecutor &operator=(const CommandExecutor &) = delete;
+
+        ~CommandExecutor() { finish(); }
+
+        // Add a matched path. This function is thread safe.
+        void push(const std::string &aPath) {
+            if (!Batch) {
+                Queue.push(std::vector<std::string>(1, aPath));
+                return;
+            }
+
+            const size_t len = detail::argument_size(aPath);
+            std::vector<std::string> fullList;
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                if (!Paths.empty() && (FixedSize + PathsSize + len > Budget)) {
+                    fullList.swap(Paths);
+                    PathsSize = 0;
+                }
+                Paths.emplace_back(aPath);
+                PathsSize += len;
+            }
+
+            // Do not hold the lock while waiting for a free queue slot.
+            if (!fullList.empty()) {
+                Queue.push(std::move(fullList));
+            }
+        }
+
+        /**
+         * Run the remaining paths and wait for all commands to finish. Return
+         * the number of failed commands.
+         */
+        size_t finish() {
+            if (Workers.empty()) {
+                return NumberOfFailures;
+            }
+            if (!Paths.empty()) {
+                Queue.push(std::move(Paths));
+                Paths.clear();
+                PathsSize = 0;
+            }
+            for (size_t idx = 0; idx < Workers.size(); ++idx) {
+                Queue.push(std::vector<std::string>()); // An empty list stops a worker.
+            }
+            for (auto &aWorker : Workers) {
+                aWorker.join();
+            }
+            Workers.clear();
+            return NumberOfFailures;
+        }
+
+      private:
+        std::string Command;
+        std::vector<std::string> Arguments;
+        bool Batch;
+        bool Verbose;
+        size_t Budget;
+        size_t FixedSize;
+        std::vector<std::string> Paths;
+        size_t PathsSize;
+        std::mutex Mutex;
+        std::mutex OutputMutex;
+        tbb::concurrent_bounded_queue<std::vector<std::string>> Queue;
+        std::vector<std::thread> Workers;
+        std::atomic<size_t> NumberOfFailures;
+
+        static bool isPlaceholder(const std::string &arg) { return arg == "{}"; }
+
+        void work() {
+            std::vector<std::string> paths;
+            while (true) {
+                Queue.pop(paths);
+                if (paths.empty()) {
+                    break;
+                }
+                run(paths);
+            }
+        }
+
+        void run(const std::vector<std::string> &paths) {
+            std::vector<std::string> args;
+            args.reserve(Arguments.size() + paths.size());
+            for (auto const &item : Arguments) {
+                if (isPlaceholder(item)) {
+                    args.insert(args.end(), paths.begin(), paths.end());
+                } else {
+                    args.emplace_back(item);
+                }
+            }
+
+            std::string output;
+            int errcode = -1;
+            try {
+                errcode = execute(std::make_tuple(Command, std::move(args)), output);
+            } catch (std::exception &e) {
+                output = fmt::format("Cannot execute {0}: {1}\n", Command, e.what());
+            }
+            if (errcode != 0) {
+                ++NumberOfFailures;
+            }
+
+            // Keep the output of each command together.
+            std::lock_guard<std::mutex> lock(OutputMutex);
+            if (Verbose) {
+                fmt::print("{0} with {1} files: exit code {2}\n", Command, paths.size(),
+                           errcode);
+            }
+            std::fwrite(output.data(), 1, output.size(), stdout);
+        }
+    };
+} // namespace sbutils
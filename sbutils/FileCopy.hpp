@@ -0,0 +1,415 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+namespace sbutils {
+    // The cheapest method that was used to copy the content of a file.
+    enum class CopyMethod { None, Clone, CopyFileRange, SendFile, ReadWrite };
+
+    inline const char *to_string(const CopyMethod method) {
+        switch (method) {
+        case CopyMethod::Clone:
+            return "clone";
+        case CopyMethod::CopyFileRange:
+            return "copy_file_range";
+        case CopyMethod::SendFile:
+            return "sendfile";
+        case CopyMethod::ReadWrite:
+            return "read/write";
+        default:
+            return "none";
+        }
+    }
+
+    // A file descriptor that is closed when it goes out of scope.
+    class FileDescriptor {
+      public:
+        explicit FileDescriptor(const int fd = -1) : FD(fd) {}
+        FileDescriptor(const FileDescriptor &) = delete;
+        FileDescriptor &operator=(const FileDescriptor &) = delete;
+        FileDescriptor(FileDescriptor &&rhs) noexcept : FD(rhs.FD) { rhs.FD = -1; }
+        FileDescriptor &operator=(FileDescriptor &&rhs) noexcept {
+            if (this != &rhs) {
+                close();
+                FD = rhs.FD;
+                rhs.FD = -1;
+            }
+            return *this;
+        }
+        ~FileDescriptor() {
+            if (FD >= 0) {
+                ::close(FD);
+            }
+        }
+
+        int get() const { return FD; }
+        bool isValid() const { return FD >= 0; }
+
+        // Close the descriptor and return false if close reports an error,
+        // e.g a delayed write error of a network file system.
+        bool close() {
+            const int fd = FD;
+            FD = -1;
+            return (fd < 0) || (::close(fd) == 0);
+        }
+
+      private:
+        int FD;
+    };
+
+    namespace detail {
+        [[noreturn]] inline void throw_copy_error(const std::string &message,
+                                                  const std::string &aPath) {
+            throw std::runtime_error(message + " \"" + aPath + "\": " + std::strerror(errno));
+        }
+
+        // Errors that mean a copy method is not supported by given files.
+        inline bool is_unsupported(const int errcode) {
+            return (errcode == ENOSYS) || (errcode == EXDEV) || (errcode == EINVAL) ||
+                   (errcode == EOPNOTSUPP) || (errcode == ENOTSUP) || (errcode == EBADF);
+        }
+
+        /**
+         * Copy [offset, end) using copy_file_range so data never leaves the
+         * kernel and can be copied by the file system or the storage itself.
+         * Return false if the method is not supported, in which case offset
+         * is the position of the first byte that has not been copied.
+         */
+        inline bool kernel_copy(const int in, const int out, off_t &offset, const off_t end) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+            while (offset < end) {
+                loff_t inOffset = offset, outOffset = offset;
+                const ssize_t count =
+                    ::syscall(SYS_copy_file_range, in, &inOffset, out, &outOffset,
+                              static_cast<size_t>(end - offset), 0u);
+                if (count < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (is_unsupported(errno)) {
+                        return false;
+                    }
+                    throw std::runtime_error(std::string("copy_file_range: ") +
+                                             std::strerror(errno));
+                }
+                if (count == 0) {
+                    // Some file systems return 0 instead of an error.
+                    return false;
+                }
+                offset += count;
+            }
+            return true;
+#else
+            (void)in;
+            (void)out;
+            (void)offset;
+            (void)end;
+            return false;
+#endif
+        }
+
+        // Copy [offset, end) using sendfile. See kernel_copy.
+        inline bool sendfile_copy(const int in, const int out, off_t &offset, const off_t end) {
+#ifdef __linux__
+            if (::lseek(out, offset, SEEK_SET) != offset) {
+                return false;
+            }
+            while (offset < end) {
+                const ssize_t count =
+                    ::sendfile(out, in, &offset, static_cast<size_t>(end - offset));
+                if (count < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (is_unsupported(errno)) {
+                        return false;
+                    }
+                    throw std::runtime_error(std::string("sendfile: ") + std::strerror(errno));
+                }
+                if (count == 0) {
+                    return false;
+                }
+            }
+            return true;
+#else
+            (void)in;
+            (void)out;
+            (void)offset;
+            (void)end;
+            return false;
+#endif
+        }
+
+        // Copy [offset, end) using a user space buffer. Stop at the end of
+        // the source file if it is shorter than expected.
+        inline void buffered_copy(const int in, const int out, off_t &offset, const off_t end,
+                                  std::string &buffer) {
+            while (offset < end) {
+                const size_t len = std::min<size_t>(buffer.size(), end - offset);
+                const ssize_t count = ::pread(in, &buffer[0], len, offset);
+                if (count < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("read: ") + std::strerror(errno));
+                }
+                if (count == 0) {
+                    return;
+                }
+                size_t nbytes = 0;
+                while (nbytes < static_cast<size_t>(count)) {
+                    const ssize_t written =
+                        ::pwrite(out, buffer.data() + nbytes, count - nbytes, offset + nbytes);
+                    if (written < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        throw std::runtime_error(std::string("write: ") +
+                                                 std::strerror(errno));
+                    }
+                    nbytes += static_cast<size_t>(written);
+                }
+                offset += count;
+            }
+        }
+
+        // Read or write exactly len bytes at offset and return false on an error
+        // or a premature end of file.
+        inline bool read_fully(const int fd, char *data, const size_t len,
+                               const std::uint64_t offset) {
+            size_t nbytes = 0;
+            while (nbytes < len) {
+                const ssize_t count = ::pread(fd, data + nbytes, len - nbytes, offset + nbytes);
+                if (count < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                if (count == 0) {
+                    return false;
+                }
+                nbytes += static_cast<size_t>(count);
+            }
+            return true;
+        }
+
+        inline bool write_fully(const int fd, const char *data, const size_t len,
+                                const std::uint64_t offset) {
+            size_t nbytes = 0;
+            while (nbytes < len) {
+                const ssize_t count =
+                    ::pwrite(fd, data + nbytes, len - nbytes, offset + nbytes);
+                if (count < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                nbytes += static_cast<size_t>(count);
+            }
+            return true;
+        }
+
+#ifdef __APPLE__
+        inline const struct timespec &access_timespec(const struct stat &st) {
+            return st.st_atimespec;
+        }
+        inline const struct timespec &modification_timespec(const struct stat &st) {
+            return st.st_mtimespec;
+        }
+#else
+        inline const struct timespec &access_timespec(const struct stat &st) {
+            return st.st_atim;
+        }
+        inline const struct timespec &modification_timespec(const struct stat &st) {
+            return st.st_mtim;
+        }
+#endif
+
+        /**
+         * Return true if a copy has the same size and modification time as
+         * its source. Times are compared at the precision of the copy, which
+         * is the largest power of ten that divides its fraction of a second,
+         * because file systems such as ext3, HFS+, and many network shares
+         * drop nanoseconds, and utimes keeps only microseconds. For example
+         * only seconds are compared if the copy has no fraction. Time is any
+         * type with tv_sec and tv_nsec members, e.g. timespec or statx_timestamp.
+         */
+        template <typename Time>
+        bool is_up_to_date(const std::uint64_t srcSize, const Time &srcTime,
+                           const std::uint64_t dstSize, const Time &dstTime) {
+            if ((srcSize != dstSize) || (srcTime.tv_sec != dstTime.tv_sec)) {
+                return false;
+            }
+            const auto dstFraction = static_cast<std::int64_t>(dstTime.tv_nsec);
+            std::int64_t unit = 1000000000;
+            while ((dstFraction % unit) != 0) {
+                unit /= 10;
+            }
+            return (static_cast<std::int64_t>(srcTime.tv_nsec) / unit) == (dstFraction / unit);
+        }
+
+        inline bool is_up_to_date(const struct stat &srcStat, const struct stat &dstStat) {
+            return S_ISREG(dstStat.st_mode) &&
+                   is_up_to_date(srcStat.st_size, modification_timespec(srcStat),
+                                 dstStat.st_size, modification_timespec(dstStat));
+        }
+    } // namespace detail
+
+    // Clone a file on a copy-on-write file system. Return false if the
+    // file systems do not support clones.
+    inline bool clone_content(const int in, const int out) {
+#if defined(__linux__) && defined(FICLONE)
+        return ::ioctl(out, FICLONE, in) == 0;
+#else
+        (void)in;
+        (void)out;
+        return false;
+#endif
+    }
+
+    /**
+     * Copy [offset, end) of a file to the same range of another file using
+     * explicit offsets, so different ranges of a file can be copied
+     * concurrently using the same descriptors. copy_file_range is used if
+     * it is supported and pread/pwrite otherwise.
+     */
+    inline CopyMethod copy_range(const int in, const int out, off_t offset, const off_t end,
+                                 std::string &buffer) {
+        if (detail::kernel_copy(in, out, offset, end)) {
+            return CopyMethod::CopyFileRange;
+        }
+        if (buffer.size() < (1 << 20)) {
+            buffer.resize(1 << 20);
+        }
+        detail::buffered_copy(in, out, offset, end, buffer);
+        return CopyMethod::ReadWrite;
+    }
+
+    /**
+     * Copy the content of a file between two open descriptors using the
+     * cheapest method that both file systems support. A FICLONE reflink
+     * shares the extents of the source on copy-on-write file systems such
+     * as btrfs and XFS, so it is a metadata operation. copy_file_range and
+     * sendfile copy data inside the kernel, and a read/write loop using a
+     * large caller supplied buffer is the fallback. Each method continues
+     * where the previous one stopped. Throw std::runtime_error if the file
+     * cannot be copied.
+     */
+    inline CopyMethod copy_content(const int in, const int out, const off_t size,
+                                   std::string &buffer) {
+        if (clone_content(in, out)) {
+            return CopyMethod::Clone;
+        }
+        off_t offset = 0;
+        if (detail::kernel_copy(in, out, offset, size)) {
+            return CopyMethod::CopyFileRange;
+        }
+        if (detail::sendfile_copy(in, out, offset, size)) {
+            return CopyMethod::SendFile;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(in, offset, size - offset, POSIX_FADV_SEQUENTIAL);
+#endif
+        if (buffer.size() < (1 << 20)) {
+            buffer.resize(1 << 20);
+        }
+        detail::buffered_copy(in, out, offset, size, buffer);
+        return CopyMethod::ReadWrite;
+    }
+
+    /**
+     * An open copy of a file. Opening a copy needs one stat call for each
+     * file. The destination is up to date, and the copy is empty, if it has
+     * the same size and modification time as the source, see
+     * detail::is_up_to_date. Otherwise the destination is truncated, and a
+     * read-only destination is made writable first. The content is copied
+     * by the caller and finish sets the mode and time stamps of the source
+     * using the open destination. Throw std::runtime_error if a file cannot
+     * be opened or written.
+     */
+    class FileCopy {
+      public:
+        FileCopy(const std::string &srcFile, const std::string &dstFile)
+            : DstFile(dstFile), In(::open(srcFile.c_str(), O_RDONLY | O_CLOEXEC)), Out(),
+              SrcStat() {
+            if (!In.isValid() || (::fstat(In.get(), &SrcStat) != 0)) {
+                detail::throw_copy_error("Cannot read", srcFile);
+            }
+
+            struct stat dstStat;
+            const bool hasDestination = (::stat(dstFile.c_str(), &dstStat) == 0);
+            if (hasDestination && detail::is_up_to_date(SrcStat, dstStat)) {
+                In.close();
+                return;
+            }
+
+            const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            Out = FileDescriptor(::open(dstFile.c_str(), flags, S_IRUSR | S_IWUSR));
+            if (!Out.isValid() && (errno == EACCES) && hasDestination &&
+                (::chmod(dstFile.c_str(), (dstStat.st_mode & 07777) | S_IWUSR) == 0)) {
+                Out = FileDescriptor(::open(dstFile.c_str(), flags, S_IRUSR | S_IWUSR));
+            }
+            if (!Out.isValid()) {
+                detail::throw_copy_error("Cannot write", dstFile);
+            }
+        }
+
+        bool empty() const { return !Out.isValid(); }
+        int source() const { return In.get(); }
+        int destination() const { return Out.get(); }
+        off_t size() const { return SrcStat.st_size; }
+        const std::string &path() const { return DstFile; }
+
+        void finish() {
+            const struct timespec times[2] = {detail::access_timespec(SrcStat),
+                                              detail::modification_timespec(SrcStat)};
+            if ((::fchmod(Out.get(), SrcStat.st_mode & 07777) != 0) ||
+                (::futimens(Out.get(), times) != 0) || !Out.close()) {
+                detail::throw_copy_error("Cannot write", DstFile);
+            }
+            In.close();
+        }
+
+      private:
+        std::string DstFile;
+        FileDescriptor In;
+        FileDescriptor Out;
+        struct stat SrcStat;
+    };
+
+    /**
+     * Copy a file and its mode and time stamps unless the destination is up
+     * to date. Return CopyMethod::None if the destination is up to date.
+     * See FileCopy and copy_content.
+     */
+    inline CopyMethod copy_file(const std::string &srcFile, const std::string &dstFile,
+                                std::string &buffer) {
+        FileCopy aCopy(srcFile, dstFile);
+        if (aCopy.empty()) {
+            return CopyMethod::None;
+        }
+        const CopyMethod method =
+            copy_content(aCopy.source(), aCopy.destination(), aCopy.size(), buffer);
+        aCopy.finish();
+        return method;
+    }
+} // namespace sbutils
@@ -2,6 +2,7 @@
 
 // STL headers
 #include <array>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -13,11 +14,58 @@
 #include "boost/filesystem.hpp"
 #include "fmt/format.h"
 
+#include <sys/stat.h>
+
 #include "tbb/parallel_sort.h"
+#include "tbb/task_group.h"
 #include "tbb/tbb.h"
 
 namespace sbutils {
     namespace filesystem {
+        namespace detail {
+            inline std::int64_t to_nanoseconds(const struct timespec &value) {
+                return static_cast<std::int64_t>(value.tv_sec) * 1000000000 + value.tv_nsec;
+            }
+
+#ifdef __APPLE__
+            inline std::int64_t modified_time(const struct stat &st) {
+                return to_nanoseconds(st.st_mtimespec);
+            }
+            inline std::int64_t changed_time(const struct stat &st) {
+                return to_nanoseconds(st.st_ctimespec);
+            }
+#else
+            inline std::int64_t modified_time(const struct stat &st) {
+                return to_nanoseconds(st.st_mtim);
+            }
+            inline std::int64_t changed_time(const struct stat &st) {
+                return to_nanoseconds(st.st_ctim);
+            }
+#endif
+
+            // Return the modification time of a folder or zero if it is unknown.
+            inline std::int64_t folder_time(const boost::filesystem::path &aPath) {
+                struct stat st;
+                return (::stat(aPath.c_str(), &st) == 0) ? modified_time(st) : 0;
+            }
+
+            /**
+             * Create a FileInfo object from the result of a stat call. A
+             * single stat call gives the type, size, permissions, inode, and
+             * nanosecond time stamps of a file.
+             */
+            inline FileInfo make_file_info(const struct stat &st, std::string aPath,
+                                           std::string aStem, std::string anExtension,
+                                           StringTable::id_type extId = StringTable::NotFound) {
+                FileInfo info(static_cast<int>(st.st_mode & 07777),
+                              static_cast<uintmax_t>(st.st_size), std::move(aPath),
+                              std::move(aStem), std::move(anExtension), st.st_mtime, extId);
+                info.Inode = static_cast<std::uint64_t>(st.st_ino);
+                info.ModifiedTime = modified_time(st);
+                info.ChangedTime = changed_time(st);
+                return info;
+            }
+        } // namespace detail
 
         struct DoNothingPolicy {
             bool isValidStem(const std::string &) { return true; }
@@ -56,6 +104,10 @@ namespace sbutils {
                 directory_iterator endIter;
                 boost::system::error_code errcode, no_error;
 
+                // The folder time is read before the folder is listed so
+                // entries that are added while listing change the folder time.
+                const std::int64_t folderTime = detail::folder_time(aPath);
+
                 // Return early if we cannot construct the directory iterator.
                 directory_iterator dirIter(aPath, errcode);
                 if (errcode != no_error) {
@@ -64,39 +116,32 @@ namespace sbutils {
 
                 for (; dirIter != endIter; ++dirIter) {
                     auto const currentPath = dirIter->path();
-                    auto const status = dirIter->status(errcode);
-                    if (errcode != no_error) {
+                    struct stat st;
+                    if (::stat(currentPath.c_str(), &st) != 0) {
                         continue; // Move on if we cannot get the status of a current path.
                     }
-                    auto const ftype = status.type();
-                    const auto aStem = currentPath.stem().string();
-                    const auto anExtension = currentPath.extension().string();
-                    switch (ftype) {
-                    case boost::filesystem::symlink_file:
-                    // Treat symlink as a regular file.
-                    case boost::filesystem::regular_file:
-                        vertex_data.emplace_back(FileInfo(
-                            status.permissions(), fs::file_size(currentPath, errcode),
-                            currentPath.string(), std::move(aStem), std::move(anExtension),
-                            fs::last_write_time(aPath, errcode)));
-                        break;
-                    case boost::filesystem::directory_file:
+                    auto aStem = currentPath.stem().string();
+                    auto anExtension = currentPath.extension().string();
+                    if (S_ISREG(st.st_mode)) {
+                        // Symlinks are followed and treated as regular files.
+                        const auto extId = Extensions.intern(anExtension);
+                        vertex_data.emplace_back(detail::make_file_info(
+                            st, currentPath.string(), std::move(aStem), std::move(anExtension),
+                            extId));
+                    } else if (S_ISDIR(st.st_mode)) {
                         if (CustomFilter.isValidStem(aStem) &&
                             CustomFilter.isValidExt(anExtension)) {
                             Edges.emplace_back(
                                 std::make_tuple(aPath.string(), currentPath.string()));
                             stack.emplace_back(currentPath);
                         }
-                        break;
-                    default:
-                        // Do not know how to handle this case.
-                        break;
                     }
                 }
 
                 // Each vertex will store its path and a list of files at the
                 // root level of the current folder.
-                Vertexes.emplace_back(vertex_type{aPath.string(), std::move(vertex_data)});
+                Vertexes.emplace_back(
+                    vertex_type{aPath.string(), std::move(vertex_data), folderTime});
                 vertex_data.clear();
             }
 
@@ -145,7 +190,8 @@ namespace sbutils {
                                                        lookupTable[std::get<1>(anEdge)]));
                 }
                 tbb::parallel_sort(allEdges.begin(), allEdges.end());
-                return FolderHierarchy<index_type>(std::move(Vertexes), std::move(allEdges));
+                return FolderHierarchy<index_type>(std::move(Vertexes), std::move(allEdges),
+                                                   std::move(Extensions));
             }
 
           private:
@@ -158,6 +204,9 @@ namespace sbutils {
             std::vector<edge_type> Edges;
             std::vector<vertex_type> Vertexes;
 
+            // Interned file extensions of all visited files.
+            StringTable Extensions;
+
             // Data that will be used to filter search space.
             std::array<std::string, 1> ExcludedExtensions = {{".git"}};
             std::array<std::string, 1> ExcludedStems = {{"CMakeFiles"}};
@@ -187,32 +236,22 @@ namespace sbutils {
 
                 for (; dirIter != endIter; ++dirIter) {
                     const auto currentPath = dirIter->path();
-                    const auto status = dirIter->status(errcode);
-                    if (errcode != no_error) {
+                    struct stat st;
+                    if (::stat(currentPath.c_str(), &st) != 0) {
                         continue; // Move on if we cannot get the status of the current path.
                     }
-                    const auto perms = status.permissions();
-                    const auto ftype = status.type();
-                    const auto aStem = currentPath.stem().string();
-                    const auto anExtension = currentPath.extension().string();
-                    switch (ftype) {
-                    case boost::filesystem::symlink_file: // Treat symbolic link as a regular
-                                                          // file.
-                    case boost::filesystem::regular_file:
-                        Results.emplace_back(FileInfo(
-                            perms, fs::file_size(currentPath, errcode), currentPath.string(),
-                            std::move(aStem), std::move(anExtension),
-                            fs::last_write_time(aPath, errcode)));
-                        break;
-                    case boost::filesystem::directory_file:
+                    auto aStem = currentPath.stem().string();
+                    auto anExtension = currentPath.extension().string();
+                    if (S_ISREG(st.st_mode)) {
+                        // Symbolic links are followed and treated as regular files.
+                        Results.emplace_back(detail::make_file_info(st, currentPath.string(),
+                                                                    std::move(aStem),
+                                                                    std::move(anExtension)));
+                    } else if (S_ISDIR(st.st_mode)) {
                         if (CustomFilter.isValidStem(aStem) &&
                             CustomFilter.isValidExt(anExtension)) {
                             folders.emplace_back(currentPath);
                         }
-                        break;
-                    default:
-                        // Do not know how to handle this case.
-                        break;
                     }
                 }
             }
@@ -283,6 +322,91 @@ namespace sbutils {
             std::vector<std::string> Results;
         };
 
+        /**
+         * A thread-safe visitor that filters files while folders are visited
+         * and passes the matched files of each folder to a consumer, so
+         * results are available as soon as they are found. FileFilter must
+         * have isValid(const FileInfo &) and the consumer is called
+         * concurrently.
+         */
+        template <typename Filter, typename FileFilter, typename Consumer>
+        class StreamVisitor {
+          public:
+            using path = boost::filesystem::path;
+            using directory_iterator = boost::filesystem::directory_iterator;
+
+            StreamVisitor(const FileFilter &fileFilter, Consumer &consumer)
+                : CustomFilter(), CustomFileFilter(fileFilter), Output(consumer) {}
+
+            template <typename PathContainer>
+            void visit(const path &aPath, PathContainer &folders) const {
+                namespace fs = boost::filesystem;
+                boost::system::error_code errcode;
+                boost::system::error_code no_error;
+                directory_iterator endIter;
+                directory_iterator dirIter(aPath, errcode);
+                if (errcode != no_error) {
+                    return;
+                }
+
+                std::vector<FileInfo> matches;
+                for (; dirIter != endIter; ++dirIter) {
+                    const auto currentPath = dirIter->path();
+                    struct stat st;
+                    if (::stat(currentPath.c_str(), &st) != 0) {
+                        continue;
+                    }
+                    auto aStem = currentPath.stem().string();
+                    auto anExtension = currentPath.extension().string();
+                    if (S_ISREG(st.st_mode)) {
+                        FileInfo info = detail::make_file_info(
+                            st, currentPath.string(), std::move(aStem), std::move(anExtension));
+                        if (CustomFileFilter.isValid(info)) {
+                            matches.emplace_back(std::move(info));
+                        }
+                    } else if (S_ISDIR(st.st_mode)) {
+                        if (CustomFilter.isValidStem(aStem) &&
+                            CustomFilter.isValidExt(anExtension)) {
+                            folders.emplace_back(currentPath);
+                        }
+                    }
+                }
+
+                if (!matches.empty()) {
+                    Output(matches);
+                }
+            }
+
+          private:
+            mutable Filter CustomFilter;
+            const FileFilter &CustomFileFilter;
+            Consumer &Output;
+        };
+
+        /**
+         * Search for files in given folders in parallel. Each folder is
+         * visited by a TBB task and its subfolders are visited by new tasks,
+         * so the visitor must be thread-safe.
+         */
+        template <typename Container, typename Visitor>
+        void parallel_file_search(const Container &searchPaths, const Visitor &visitor,
+                                  bool verbose = false) {
+            using path = boost::filesystem::path;
+            ElapsedTime<MILLISECOND> timer("Search files: ", verbose);
+            tbb::task_group tasks;
+            std::function<void(const path &)> visitObj = [&](const path &aPath) {
+                std::vector<path> folders;
+                visitor.visit(aPath, folders);
+                for (auto &aFolder : folders) {
+                    tasks.run([&visitObj, aFolder]() { visitObj(aFolder); });
+                }
+            };
+            for (auto const &aPath : searchPaths) {
+                tasks.run([&visitObj, aPath]() { visitObj(path(aPath)); });
+            }
+            tasks.wait();
+        }
+
         /**
          * Search for files in given folders using depth-first-search algorithm.
          *
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CommandUtils.hpp"
+#include "DataStructures.hpp"
+#include "FolderDiff.hpp"
+#include "Query.hpp"
+#include "Utils.hpp"
+
+#include "tbb/tbb.h"
+
+namespace sbutils {
+    /**
+     * A columnar, in-memory copy of a file information database. All paths
+     * are stored in a single buffer and each file attribute has its own column
+     * so a query only touches the columns that it needs. Rows are grouped by
+     * vertexes and vertexes are sorted by their paths.
+     */
+    class FileTable {
+      public:
+        FileTable()
+            : VertexPaths(), VertexOffsets(1, 0), Summaries(), Extensions(), PathData(),
+              PathOffsets(1, 0), StemOffsets(), StemSizes(), ExtIds(), Sizes(), TimeStamps(),
+              Permissions() {}
+
+        void load(rocksdb::DB &db, bool verbose = false) {
+            sbutils::ElapsedTime<sbutils::MILLISECOND> t("Load file table: ", verbose);
+            Extensions = read_extensions(db);
+            read_value(db, Resources::SummaryKey, Summaries);
+
+            const auto allVids = find_vertexes(db, {}, verbose);
+            const auto readOpts = rocksdb::ReadOptions();
+            for (auto const vid : allVids) {
+                std::string value;
+                auto const s = db.Get(readOpts, sbutils::to_fixed_string(9, vid), &value);
+                assert(s.ok());
+                (void)s;
+                std::istringstream is(value);
+                Vertex<vertex_index_type> aVertex;
+                {
+                    DefaultIArchive input(is);
+                    input(aVertex);
+                }
+                append(aVertex);
+            }
+
+            if (verbose) {
+                fmt::print("Number of vertexes: {}\n", VertexPaths.size());
+                fmt::print("Number of files: {}\n", size());
+            }
+        }
+
+        template <typename Vertex> void append(const Vertex &aVertex) {
+            VertexPaths.emplace_back(aVertex.Path);
+            for (auto const &info : aVertex.Files) {
+                PathData.append(info.Path);
+                PathOffsets.push_back(PathData.size());
+                StemOffsets.push_back(
+                    static_cast<std::uint32_t>(info.Path.size() - info.Stem.size() -
+                                               info.Extension.size()));
+                StemSizes.push_back(static_cast<std::uint32_t>(info.Stem.size()));
+                ExtIds.push_back(info.ExtId);
+                Sizes.push_back(info.Size);
+                TimeStamps.push_back(info.TimeStamp);
+                Permissions.push_back(info.Permissions);
+            }
+            VertexOffsets.push_back(ExtIds.size());
+        }
+
+        size_t size() const { return ExtIds.size(); }
+
+        size_t numberOfVertexes() const { return VertexPaths.size(); }
+
+        const char *path(const size_t row) const { return PathData.data() + PathOffsets[row]; }
+
+        size_t pathSize(const size_t row) const {
+            return PathOffsets[row + 1] - PathOffsets[row];
+        }
+
+        /**
+         * Return sorted and disjoint ranges of vertexes that belong to given
+         * folders. A folder is a range of its own because siblings whose
+         * names extend its name sort between it and its descendants, see
+         * descendant_range.
+         */
+        std::vector<std::pair<size_t, size_t>>
+        vertexRanges(const std::vector<std::string> &folders) const {
+            std::vector<std::pair<size_t, size_t>> ranges;
+            if (folders.empty()) {
+                ranges.emplace_back(0, VertexPaths.size());
+                return ranges;
+            }
+            auto position = [this](std::vector<std::string>::const_iterator it) {
+                return static_cast<size_t>(std::distance(VertexPaths.begin(), it));
+            };
+            for (auto const &item : folders) {
+                const std::string aFolder = normalize_path(item);
+                auto first = std::lower_bound(VertexPaths.begin(), VertexPaths.end(), aFolder);
+                if ((first == VertexPaths.end()) || (*first != aFolder)) {
+                    continue;
+                }
+                auto const range = descendant_range(first, VertexPaths.end(), aFolder);
+                ranges.emplace_back(position(first), position(first) + 1);
+                ranges.emplace_back(position(range.first), position(range.second));
+            }
+
+            // Merge ranges of nested or repeated folders.
+            std::sort(ranges.begin(), ranges.end());
+            std::vector<std::pair<size_t, size_t>> results;
+            for (auto const &aRange : ranges) {
+                if (aRange.first == aRange.second) {
+                    continue;
+                }
+                if (!results.empty() && (aRange.first <= results.back().second)) {
+                    results.back().second = std::max(results.back().second, aRange.second);
+                } else {
+                    results.push_back(aRange);
+                }
+            }
+            return results;
+        }
+
+        std::vector<std::string> VertexPaths;
+        // Rows of vertex i are in [VertexOffsets[i], VertexOffsets[i + 1]).
+        std::vector<std::uint64_t> VertexOffsets;
+        std::vector<VertexSummary> Summaries;
+        StringTable Extensions;
+
+        // Columns
+        std::string PathData;
+        std::vector<std::uint64_t> PathOffsets;
+        std::vector<std::uint32_t> StemOffsets; // Offsets of stems in their paths.
+        std::vector<std::uint32_t> StemSizes;
+        std::vector<StringTable::id_type> ExtIds;
+        std::vector<uintmax_t> Sizes;
+        std::vector<std::time_t> TimeStamps;
+        std::vector<int> Permissions;
+    };
+
+    // A row of a FileTable.
+    struct FileTableRow {
+        const FileTable &Table;
+        size_t Index;
+    };
+
+    namespace query {
+        template <> struct FileAttributes<FileTableRow> {
+            static StringTable::id_type extId(const FileTableRow &row) {
+                return row.Table.ExtIds[row.Index];
+            }
+
+            static boost::string_ref extension(const FileTableRow &row) {
+                const auto id = row.Table.ExtIds[row.Index];
+                if (id >= row.Table.Extensions.size()) {
+                    return boost::string_ref();
+                }
+                return row.Table.Extensions[id];
+            }
+
+            static boost::string_ref stem(const FileTableRow &row) {
+                return boost::string_ref(path(row).data() + row.Table.StemOffsets[row.Index],
+                                         row.Table.StemSizes[row.Index]);
+            }
+
+            static boost::string_ref path(const FileTableRow &row) {
+                return boost::string_ref(row.Table.path(row.Index),
+                                         row.Table.pathSize(row.Index));
+            }
+
+            static uintmax_t size(const FileTableRow &row) {
+                return row.Table.Sizes[row.Index];
+            }
+
+            static std::time_t timeStamp(const FileTableRow &row) {
+                return row.Table.TimeStamps[row.Index];
+            }
+
+            static int permissions(const FileTableRow &row) {
+                return row.Table.Permissions[row.Index];
+            }
+        };
+    } // namespace query
+
+    /**
+     * Evaluate mlocate constraints against the columns of a FileTable.
+     */
+    class FileTableQuery {
+      public:
+        FileTableQuery(const FileTable &table, const MLocateArgs &args)
+            : Table(table), Constraints(compile_query(args, table.Extensions)) {}
+
+        bool isValid(const VertexSummary &summary) const {
+            return Constraints.isValid(summary);
+        }
+
+        bool isValid(const size_t row) const {
+            return Constraints.isValid(FileTableRow{Table, row});
+        }
+
+        /**
+         * Pass matched rows of each vertex to a consumer. Vertexes whose
+         * summaries cannot satisfy the query are skipped. The consumer
+         * returns false to stop the search.
+         */
+        template <typename Consumer>
+        void run(const std::vector<std::string> &folders, Consumer &&consumer) const {
+            tbb::task_group_context context;
+            for (auto const &aRange : Table.vertexRanges(folders)) {
+                auto searchObj = [&](const tbb::blocked_range<size_t> &r) {
+                    std::vector<size_t> rows;
+                    for (size_t vid = r.begin(); vid != r.end(); ++vid) {
+                        if ((vid < Table.Summaries.size()) && !isValid(Table.Summaries[vid])) {
+                            continue;
+                        }
+                        for (size_t row = Table.VertexOffsets[vid];
+                             row != Table.VertexOffsets[vid + 1]; ++row) {
+                            if (isValid(row)) {
+                                rows.push_back(row);
+                            }
+                        }
+                    }
+                    if (!rows.empty() && !consumer(rows)) {
+                        context.cancel_group_execution();
+                    }
+                };
+                tbb::parallel_for(tbb::blocked_range<size_t>(aRange.first, aRange.second, 64),
+                                  searchObj, tbb::auto_partitioner(), context);
+                if (context.is_group_execution_cancelled()) {
+                    break;
+                }
+            }
+        }
+
+        size_t count(const std::vector<std::string> &folders) const {
+            std::atomic<size_t> counter(0);
+            run(folders, [&counter](auto const &rows) {
+                counter += rows.size();
+                return true;
+            });
+            return counter;
+        }
+
+      private:
+        const FileTable &Table;
+        Query Constraints;
+    };
+} // namespace sbutils
@@ -1,204 +1,1028 @@
 #pragma once
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <future>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "DataStructures.hpp"
 #include "FileSearch.hpp"
 #include "FileUtils.hpp"
+#include "Hash.hpp"
+#include "MergeDiff.hpp"
 #include "RocksDB.hpp"
 #include "Timer.hpp"
 #include "Utils.hpp"
 #include "graph/SparseGraph.hpp"
 
 #include "tbb/parallel_invoke.h"
+#include "tbb/tbb.h"
 
 namespace sbutils {
+    using vertex_index_type = unsigned int;
+
+    // Deserialize the value of a given key. Return false if the key does not
+    // exist.
+    template <typename T> bool read_value(rocksdb::DB &db, const std::string &aKey, T &data) {
+        std::string value;
+        rocksdb::Status s = db.Get(rocksdb::ReadOptions(), aKey, &value);
+        if (!s.ok()) {
+            return false;
+        }
+        std::istringstream is(value);
+        sbutils::DefaultIArchive input(is);
+        input(data);
+        return true;
+    }
+
+    // Read the interned file extensions from a given database.
+    inline StringTable read_extensions(rocksdb::DB &db) {
+        StringTable extensions;
+        read_value(db, Resources::ExtensionKey, extensions);
+        return extensions;
+    }
+
+    /**
+     * Return the range of path sorted items that are descendants of a
+     * folder. Descendants have paths in [folder/, folder0) because '0' is the
+     * character right after '/', so siblings whose names extend the folder
+     * name, e.g "/a/b-c" or "/a/b.d" of "/a/b", are outside of the range. The
+     * folder itself sorts before the range and is not included.
+     */
+    template <typename Iterator, typename Compare>
+    std::pair<Iterator, Iterator> descendant_range(Iterator first, Iterator last,
+                                                   std::string aFolder, Compare isLess) {
+        if (aFolder.empty() || (aFolder.back() != '/')) {
+            aFolder.push_back('/');
+        }
+        auto const begin = std::lower_bound(first, last, aFolder, isLess);
+        aFolder.back() = '0';
+        return std::make_pair(begin, std::lower_bound(begin, last, aFolder, isLess));
+    }
+
+    template <typename Iterator>
+    std::pair<Iterator, Iterator> descendant_range(Iterator first, Iterator last,
+                                                   const std::string &aFolder) {
+        return descendant_range(first, last, aFolder, std::less<std::string>());
+    }
+
+    /**
+     * Return sorted ids of vertexes that belong to given folders using only
+     * the sorted vertex paths, so it also works for generations that do not
+     * store a graph. See descendant_range.
+     */
+    inline std::vector<vertex_index_type>
+    select_vertexes(const std::vector<std::string> &vids,
+                    const std::vector<std::string> &folders) {
+        std::vector<vertex_index_type> results;
+        if (folders.empty()) {
+            results.resize(vids.size());
+            std::iota(results.begin(), results.end(), 0);
+            return results;
+        }
+        for (auto const &item : folders) {
+            const std::string aKey = normalize_path(item);
+            auto const it = std::lower_bound(vids.begin(), vids.end(), aKey);
+            if ((it == vids.end()) || (*it != aKey)) {
+                fmt::print("Could not find key {} in database\n", aKey);
+                continue;
+            }
+            auto const range = descendant_range(it, vids.end(), aKey);
+            results.push_back(static_cast<vertex_index_type>(std::distance(vids.begin(), it)));
+            for (auto pos = range.first; pos != range.second; ++pos) {
+                results.push_back(
+                    static_cast<vertex_index_type>(std::distance(vids.begin(), pos)));
+            }
+        }
+        std::sort(results.begin(), results.end());
+        results.erase(std::unique(results.begin(), results.end()), results.end());
+        return results;
+    }
+
+    /**
+     * Return sorted ids of all vertexes that belong to given folders. All
+     * vertexes will be returned if folders is empty. The vertex ids of the
+     * database are given.
+     */
+    inline std::vector<vertex_index_type> find_vertexes(const std::vector<std::string> &vids,
+                                                        const std::vector<std::string> &folders,
+                                                        bool verbose = false) {
+        // Vertex ids are sorted by path so the descendants of each folder
+        // are found using binary searches instead of a traversal of the graph.
+        if (verbose) {
+            fmt::print("Number of vertexes: {0}\n", vids.size());
+        }
+        return select_vertexes(vids, folders);
+    }
+
+    /**
+     * Return sorted ids of all vertexes that belong to given folders. All
+     * vertexes will be returned if folders is empty.
+     */
+    inline std::vector<vertex_index_type> find_vertexes(rocksdb::DB &db,
+                                                        const std::vector<std::string> &folders,
+                                                        bool verbose = false) {
+        std::vector<std::string> vids;
+        const bool isOK = read_value(db, Resources::VIDKey, vids);
+        assert(isOK);
+        (void)isOK;
+        return find_vertexes(vids, folders, verbose);
+    }
+
+    // Read files of given vertexes and append them to allFiles.
     template <typename Container>
-    Container read_baseline(const std::string &database,
-                            const std::vector<std::string> &folders, bool verbose = false) {
+    void read_vertexes(rocksdb::DB &db, const std::vector<vertex_index_type> &allVids,
+                       Container &allFiles) {
         using IArchive = sbutils::DefaultIArchive;
+        const auto readOpts = rocksdb::ReadOptions();
+        for (auto const &index : allVids) {
+            const std::string aKey = sbutils::to_fixed_string(9, index);
+            std::string value;
+            auto const s = db.Get(readOpts, aKey, &value);
+            assert(s.ok());
+
+            std::istringstream is(value);
+            Vertex<vertex_index_type> aVertex;
+            {
+                IArchive input(is);
+                input(aVertex);
+            }
+            std::move(aVertex.Files.begin(), aVertex.Files.end(), std::back_inserter(allFiles));
+        }
+    }
+
+    template <typename Container>
+    Container read_baseline(rocksdb::DB &db, const std::vector<std::string> &folders,
+                            bool verbose = false) {
         Container allFiles;
 
         sbutils::ElapsedTime<sbutils::MILLISECOND> t("Read baseline: ", verbose);
 
-        // Open the database
-        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
         if (folders.empty()) {
-            std::string value;
-            rocksdb::Status s =
-                db->Get(rocksdb::ReadOptions(), sbutils::Resources::AllFileKey, &value);
-            assert(s.ok());
-            std::istringstream is(value);
-            IArchive input(is);
-            input(allFiles);
+            const bool isOK = read_value(db, sbutils::Resources::AllFileKey, allFiles);
+            assert(isOK);
+            (void)isOK;
             if (verbose) {
                 fmt::print("Number of files: {0}\n", allFiles.size());
             }
         } else {
-            using index_type = unsigned int;
-            using edge_type = graph::BasicEdgeData<index_type>;
-            using Graph = graph::SparseGraph<index_type, edge_type>;
+            read_vertexes(db, find_vertexes(db, folders, verbose), allFiles);
+        }
 
-            // Read vertex ids
-            std::vector<std::string> vids;
-            auto readVidObj = [&db, &vids]() {
-                std::string value;
-                rocksdb::Status s = db->Get(rocksdb::ReadOptions(), Resources::VIDKey, &value);
-                assert(s.ok());
-                std::istringstream is(value);
-                IArchive input(is);
-                input(vids);
+        return allFiles;
+    }
+
+    /**
+     * Return sorted ids of vertexes that belong to given folders and whose
+     * summaries satisfy a given predicate.
+     */
+    template <typename VertexFilter>
+    std::vector<vertex_index_type> find_vertexes_if(rocksdb::DB &db,
+                                                    const std::vector<std::string> &folders,
+                                                    VertexFilter &&isValidVertex,
+                                                    bool verbose = false) {
+        std::vector<VertexSummary> summaries;
+        auto allVids = find_vertexes(db, folders, verbose);
+        if (read_value(db, Resources::SummaryKey, summaries)) {
+            auto isSkipped = [&summaries, &isValidVertex](const vertex_index_type vid) {
+                return (vid < summaries.size()) && !isValidVertex(summaries[vid]);
             };
+            const size_t numberOfVertexes = allVids.size();
+            allVids.erase(std::remove_if(allVids.begin(), allVids.end(), isSkipped),
+                          allVids.end());
+            if (verbose) {
+                fmt::print("Skipped vertexes: {0}/{1}\n", numberOfVertexes - allVids.size(),
+                           numberOfVertexes);
+            }
+        }
+        return allVids;
+    }
+
+    /**
+     * Read files of vertexes whose summaries satisfy a given predicate. All
+     * other vertexes are skipped without being read from the database.
+     */
+    template <typename Container, typename VertexFilter>
+    Container read_baseline_if(rocksdb::DB &db, const std::vector<std::string> &folders,
+                               VertexFilter &&isValidVertex, bool verbose = false) {
+        Container allFiles;
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Read baseline: ", verbose);
+        read_vertexes(db, find_vertexes_if(db, folders, isValidVertex, verbose), allFiles);
+        return allFiles;
+    }
+
+    namespace detail {
+        inline std::vector<FileInfo> decode_files(const std::string &value) {
+            std::istringstream is(value);
+            Vertex<vertex_index_type> aVertex;
+            {
+                DefaultIArchive input(is);
+                input(aVertex);
+            }
+            return std::move(aVertex.Files);
+        }
 
-            // Read graph info
-            Graph g;
-            auto readGraphObj = [&db, &g]() {
+        // See read_vertexes_tbb. The reader gets the encoded record of a vertex.
+        template <typename Reader, typename Function>
+        void read_records_tbb(const Reader &read, const std::vector<vertex_index_type> &allVids,
+                              Function &&func) {
+            constexpr size_t NumberOfVertexesPerTask = 16;
+            tbb::task_group_context context;
+            auto readObj = [&](const tbb::blocked_range<size_t> &r) {
+                std::vector<FileInfo> files;
                 std::string value;
-                rocksdb::Status s =
-                    db->Get(rocksdb::ReadOptions(), sbutils::Resources::GraphKey, &value);
-                assert(s.ok());
-                std::istringstream is(value);
-                IArchive input(is);
-                input(g);
+                for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                    const bool isOK = read(allVids[idx], value);
+                    assert(isOK);
+                    (void)isOK;
+                    auto vertexFiles = decode_files(value);
+                    std::move(vertexFiles.begin(), vertexFiles.end(),
+                              std::back_inserter(files));
+                }
+                if (!files.empty() && !func(files)) {
+                    context.cancel_group_execution();
+                }
             };
+            tbb::parallel_for(
+                tbb::blocked_range<size_t>(0, allVids.size(), NumberOfVertexesPerTask), readObj,
+                tbb::simple_partitioner(), context);
+        }
+    } // namespace detail
 
-            tbb::parallel_invoke(readVidObj, readGraphObj);
+    /**
+     * Read and decode given vertexes in parallel and pass their files to a
+     * function a few vertexes at a time, so only a small part of the database
+     * is in memory at any time. The function returns false to stop reading.
+     * It is called concurrently so it must be thread-safe.
+     */
+    template <typename Function>
+    void read_vertexes_tbb(rocksdb::DB &db, const std::vector<vertex_index_type> &allVids,
+                           Function &&func) {
+        const auto readOpts = rocksdb::ReadOptions();
+        auto readObj = [&db, &readOpts](const vertex_index_type vid, std::string &value) {
+            return db.Get(readOpts, sbutils::to_fixed_string(9, vid), &value).ok();
+        };
+        detail::read_records_tbb(readObj, allVids, func);
+    }
 
-            if (verbose) {
-                fmt::print("Number of vertexes: {0}\n", g.numberOfVertexes());
+    inline std::string blob_key(const std::uint64_t hash) {
+        return Resources::BlobKey + to_fixed_string(20, hash);
+    }
+
+    /**
+     * The vertexes of a database, or of one of its generations, that belong
+     * to given folders. The records of a generation are blobs that are
+     * shared by all generations and are addressed by their hashes.
+     */
+    struct VertexTable {
+        // The latest state of a database.
+        VertexTable(rocksdb::DB &db, const std::vector<std::string> &folders,
+                    bool verbose = false)
+            : DB(db), Vids(), Summaries(), RecordHashes(), Extensions(), Selected() {
+            read_value(db, Resources::VIDKey, Vids);
+            read_value(db, Resources::SummaryKey, Summaries);
+            read_value(db, Resources::ExtensionKey, Extensions);
+            Selected = find_vertexes(Vids, folders, verbose);
+        }
+
+        // A generation of a database.
+        VertexTable(rocksdb::DB &db, std::vector<std::string> &&vids,
+                    std::vector<VertexSummary> &&summaries,
+                    std::vector<std::uint64_t> &&recordHashes, StringTable &&extensions,
+                    const std::vector<std::string> &folders)
+            : DB(db), Vids(std::move(vids)), Summaries(std::move(summaries)),
+              RecordHashes(std::move(recordHashes)), Extensions(std::move(extensions)),
+              Selected(select_vertexes(Vids, folders)) {
+            if (RecordHashes.size() != Vids.size()) {
+                throw std::runtime_error("Invalid generation manifest");
             }
+        }
 
-            assert(vids.size() == g.numberOfVertexes());
+        bool isGeneration() const { return !RecordHashes.empty(); }
 
-            /**
-             * Find all vertexes that belong to given folders.
-             *
-             */
+        const VertexSummary *summary(const vertex_index_type vid) const {
+            return (vid < Summaries.size()) ? &Summaries[vid] : nullptr;
+        }
 
-            // Now find indexes for given folders using O(n) algorithm. Below
-            // code block assume that folders is sorted.
-            std::vector<index_type> indexes;
-            for (auto const &item : folders) {
-                const std::string aKey = sbutils::normalize_path(item);
-                auto it = std::lower_bound(vids.begin(), vids.end(), aKey);
-                if (*it == aKey) {
-                    indexes.push_back(static_cast<index_type>(std::distance(vids.begin(), it)));
-                } else {
-                    fmt::print("Could not find key {} in database\n", aKey);
+        bool read(const vertex_index_type vid, std::string &value) const {
+            const std::string aKey =
+                isGeneration() ? blob_key(RecordHashes[vid]) : to_fixed_string(9, vid);
+            return DB.Get(rocksdb::ReadOptions(), aKey, &value).ok();
+        }
+
+        rocksdb::DB &DB;
+        std::vector<std::string> Vids;
+        std::vector<VertexSummary> Summaries;
+        std::vector<std::uint64_t> RecordHashes; // Only generations have record hashes.
+        StringTable Extensions;
+        std::vector<vertex_index_type> Selected;
+    };
+
+    // Read selected vertexes of a table. See read_vertexes_tbb.
+    template <typename Function>
+    void read_vertexes_tbb(const VertexTable &table,
+                           const std::vector<vertex_index_type> &allVids, Function &&func) {
+        auto readObj = [&table](const vertex_index_type vid, std::string &value) {
+            return table.read(vid, value);
+        };
+        detail::read_records_tbb(readObj, allVids, func);
+    }
+
+    /**
+     * Return selected vertexes of a table whose summaries satisfy a given
+     * predicate.
+     */
+    template <typename VertexFilter>
+    std::vector<vertex_index_type> find_vertexes_if(const VertexTable &table,
+                                                    VertexFilter &&isValidVertex,
+                                                    bool verbose = false) {
+        std::vector<vertex_index_type> results;
+        for (auto const vid : table.Selected) {
+            const VertexSummary *aSummary = table.summary(vid);
+            if ((aSummary == nullptr) || isValidVertex(*aSummary)) {
+                results.push_back(vid);
+            }
+        }
+        if (verbose) {
+            fmt::print("Skipped vertexes: {0}/{1}\n", table.Selected.size() - results.size(),
+                       table.Selected.size());
+        }
+        return results;
+    }
+
+    template <typename Container>
+    Container read_baseline(const std::string &database,
+                            const std::vector<std::string> &folders, bool verbose = false) {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        return read_baseline<Container>(*db, folders, verbose);
+    }
+
+    namespace detail {
+        // Content hashes are keyed by the identity of a file version so a
+        // cached hash stays valid across database updates. The change time
+        // is included because the modification time can be set back by
+        // tools such as touch -r or rsync -t after the content has changed.
+        inline std::string hash_key(const FileInfo &info) {
+            return Resources::HashKey + std::to_string(info.Inode) + "_" +
+                   std::to_string(info.Size) + "_" + std::to_string(info.ModifiedTime) + "_" +
+                   std::to_string(info.ChangedTime);
+        }
+
+        // Store new hashes. The file of a given index is returned by getFile.
+        template <typename Function>
+        void write_hashes(rocksdb::DB &db, const std::vector<std::uint64_t> &hashes,
+                          const std::vector<char> &isNew, Function getFile) {
+            rocksdb::WriteBatch batch;
+            bool hasNewHashes = false;
+            for (size_t idx = 0; idx < isNew.size(); ++idx) {
+                if (isNew[idx]) {
+                    batch.Put(hash_key(getFile(idx)),
+                              rocksdb::Slice(reinterpret_cast<const char *>(&hashes[idx]),
+                                             sizeof(std::uint64_t)));
+                    hasNewHashes = true;
                 }
             }
+            if (!hasNewHashes) {
+                return;
+            }
+            const rocksdb::Status s = db.Write(rocksdb::WriteOptions(), &batch);
+            if (!s.ok()) {
+                throw std::runtime_error("Cannot write content hashes: " + s.ToString());
+            }
+        }
+    } // namespace detail
 
-            std::vector<index_type> allVids =
-                graph::dfs_preordering<std::vector<index_type>>(g, indexes);
+    // Read the cached content hash of a file. Return false if it is not cached.
+    inline bool read_hash(rocksdb::DB &db, const FileInfo &info, std::uint64_t &value) {
+        if (info.ModifiedTime == 0) {
+            return false;
+        }
+        std::string data;
+        const rocksdb::Status s = db.Get(rocksdb::ReadOptions(), detail::hash_key(info), &data);
+        if (!s.ok() || (data.size() != sizeof(value))) {
+            return false;
+        }
+        std::memcpy(&value, data.data(), sizeof(value));
+        return true;
+    }
 
-            // Need to sort vids to maximize the read performance.
-            tbb::parallel_sort(allVids.begin(), allVids.end());
+    /**
+     * Compute content hashes of files that are not cached in the database
+     * in parallel and store them. Return the number of hashed files.
+     */
+    template <typename Container>
+    size_t update_hashes(rocksdb::DB &db, const Container &files, bool verbose = false) {
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Update content hashes: ", verbose);
+        std::vector<std::uint64_t> hashes(files.size());
+        std::vector<char> isNew(files.size(), 0);
+        auto hashObj = [&db, &files, &hashes, &isNew](const tbb::blocked_range<size_t> &r) {
+            std::string buffer;
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                std::uint64_t value;
+                if ((files[idx].ModifiedTime == 0) || read_hash(db, files[idx], value)) {
+                    continue;
+                }
+                isNew[idx] = hash_file(files[idx].Path, hashes[idx], buffer);
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, files.size(), 16), hashObj);
+        auto getFile = [&files](const size_t idx) -> const FileInfo & { return files[idx]; };
+        detail::write_hashes(db, hashes, isNew, getFile);
 
-            {
-                std::sort(allVids.begin(), allVids.end());
-                const auto readOpts = rocksdb::ReadOptions();
-                for (auto const &index : allVids) {
-                    const std::string aKey = sbutils::to_fixed_string(9, index);
-                    std::string value;
-                    auto const s = db->Get(readOpts, aKey, &value);
-                    assert(s.ok());
-
-                    std::istringstream is(value);
-                    Vertex<index_type> aVertex;
-                    {
-                        IArchive input(is);
-                        input(aVertex);
+        const size_t numberOfHashedFiles = std::count(isNew.begin(), isNew.end(), 1);
+        if (verbose) {
+            fmt::print("Number of hashed files: {}\n", numberOfHashedFiles);
+        }
+        return numberOfHashedFiles;
+    }
+
+    /**
+     * Delete cached content hashes of file versions that are not in a given
+     * list of files, i.e hashes of files that have been modified or removed
+     * since they were hashed. Return the number of deleted hashes.
+     */
+    template <typename Container>
+    size_t prune_hashes(rocksdb::DB &db, const Container &files, bool verbose = false) {
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Prune content hashes: ", verbose);
+        const std::string &prefix = Resources::HashKey;
+        std::unique_ptr<rocksdb::Iterator> it(db.NewIterator(rocksdb::ReadOptions()));
+        auto isHashKey = [&it, &prefix]() {
+            return it->Valid() && (it->key().ToString().compare(0, prefix.size(), prefix) == 0);
+        };
+        it->Seek(prefix);
+        if (!isHashKey()) {
+            return 0;
+        }
+
+        std::unordered_set<std::string> liveKeys;
+        liveKeys.reserve(files.size());
+        for (auto const &info : files) {
+            if (info.ModifiedTime != 0) {
+                liveKeys.emplace(detail::hash_key(info));
+            }
+        }
+        rocksdb::WriteBatch batch;
+        size_t numberOfDeletedHashes = 0;
+        for (; isHashKey(); it->Next()) {
+            const std::string aKey = it->key().ToString();
+            if (liveKeys.find(aKey) == liveKeys.end()) {
+                batch.Delete(aKey);
+                ++numberOfDeletedHashes;
+            }
+        }
+        if (numberOfDeletedHashes > 0) {
+            const rocksdb::Status s = db.Write(rocksdb::WriteOptions(), &batch);
+            if (!s.ok()) {
+                throw std::runtime_error("Cannot delete content hashes: " + s.ToString());
+            }
+        }
+
+        if (verbose) {
+            fmt::print("Number of deleted hashes: {}\n", numberOfDeletedHashes);
+        }
+        return numberOfDeletedHashes;
+    }
+
+    /**
+     * Compare the contents of files whose metadata cannot tell whether they
+     * are modified. Baseline hashes are read from the database and current
+     * files are hashed in parallel unless their hashes are cached. A file is
+     * assumed to be modified if its baseline hash is not available. Modified
+     * files are taken from the baseline and appended to modifiedFiles.
+     */
+    template <typename Container, typename PairContainer>
+    void resolve_changes(rocksdb::DB &db, PairContainer &ambiguous, Container &modifiedFiles,
+                         bool verbose = false) {
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Content comparison time: ", verbose);
+        std::vector<std::uint64_t> hashes(ambiguous.size());
+        std::vector<char> isModified(ambiguous.size(), 1), isNew(ambiguous.size(), 0);
+        auto compareObj = [&](const tbb::blocked_range<size_t> &r) {
+            std::string buffer;
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                auto const &current = ambiguous[idx].second;
+                std::uint64_t expected;
+                if (!read_hash(db, ambiguous[idx].first, expected)) {
+                    continue;
+                }
+                if (!read_hash(db, current, hashes[idx])) {
+                    if (!hash_file(current.Path, hashes[idx], buffer)) {
+                        continue;
                     }
-                    std::move(aVertex.Files.begin(), aVertex.Files.end(),
-                              std::back_inserter(allFiles));
+                    isNew[idx] = (current.ModifiedTime != 0);
                 }
+                isModified[idx] = (hashes[idx] != expected);
             }
-        }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, ambiguous.size(), 1), compareObj);
 
-        // fmt::print("Number of files: {}\n", allFiles.size());
+        auto getFile = [&ambiguous](const size_t idx) -> const FileInfo & {
+            return ambiguous[idx].second;
+        };
+        detail::write_hashes(db, hashes, isNew, getFile);
 
-        return allFiles;
+        for (size_t idx = 0; idx < ambiguous.size(); ++idx) {
+            if (isModified[idx]) {
+                modifiedFiles.emplace_back(std::move(ambiguous[idx].first));
+            }
+        }
+
+        if (verbose) {
+            fmt::print("Number of compared files: {}\n", ambiguous.size());
+            fmt::print("Number of hashed files: {}\n",
+                       std::count(isNew.begin(), isNew.end(), 1));
+        }
     }
 
     /**
      * This methods will return a tuple which has
-     *     1. Items in first and not in second.
-     *     2. Items in both first and second but they are different.
+     *     1. Items in both first and second but they are different.
+     *     2. Items in first and not in second.
      *     3. Items which are in second and not in first.
-     * The first item of each data element is a using string which is a full
-     * file name.
+     * Modified items are taken from first. See sorted_diff for details.
      */
     template <typename Container>
     std::tuple<Container, Container, Container> diff(Container &&first, Container &&second,
                                                      bool verbose = false) {
         sbutils::ElapsedTime<sbutils::MILLISECOND> t("Diff time: ", verbose);
-        Container modifiedFiles;
-        Container results;
-        Container newFiles;
-        Container deletedFiles;
+        return sorted_diff(first, second);
+    }
 
-        // Create a lookup table
+    /**
+     * A tiered version of diff. Files are compared using their sizes, inodes,
+     * and nanosecond time stamps first and only the contents of files that
+     * cannot be classified that way are hashed. Content hashes are cached in
+     * the database.
+     */
+    template <typename Container>
+    std::tuple<Container, Container, Container> diff(rocksdb::DB &db, Container &&first,
+                                                     Container &&second, bool verbose = false) {
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Diff time: ", verbose);
         using value_type = typename Container::value_type;
-        std::unordered_set<FileInfo> dict(second.begin(), second.end());
+        std::vector<std::pair<value_type, value_type>> ambiguous;
+        auto results = sorted_diff(first, second, StatComparator(), ambiguous);
+        if (!ambiguous.empty()) {
+            auto &modifiedFiles = std::get<0>(results);
+            resolve_changes(db, ambiguous, modifiedFiles, verbose);
+            tbb::parallel_sort(modifiedFiles.begin(), modifiedFiles.end(),
+                               [](const value_type &lhs, const value_type &rhs) {
+                                   return lhs.Path < rhs.Path;
+                               });
+        }
+        return results;
+    }
+
+    /**
+     * A thread-safe visitor that diffs each visited folder against its
+     * baseline vertex as soon as the folder is listed. A folder whose file
+     * signature matches its baseline summary is skipped without reading its
+     * vertex. In quick mode a folder whose time stamp has not changed is not
+     * listed at all and its baseline sub-folders are visited instead, so
+     * files that are modified in place are not detected. The consumer is
+     * called concurrently with the modified, deleted, and new files of a
+     * folder.
+     */
+    template <typename Consumer> class DiffVisitor {
+      public:
+        using path = boost::filesystem::path;
+        using directory_iterator = boost::filesystem::directory_iterator;
+
+        DiffVisitor(const VertexTable &table, Consumer &consumer, bool quick = false)
+            : Table(table), Children(), Quick(quick), IsVisited(table.Vids.size(), 0),
+              NumberOfSkippedFolders(0), NumberOfTrustedFolders(0), Output(consumer) {
+            if (Quick) {
+                const auto parents = parent_indexes(Table.Vids);
+                Children.resize(Table.Vids.size());
+                for (size_t vid = 0; vid < parents.size(); ++vid) {
+                    if (parents[vid] >= 0) {
+                        Children[parents[vid]].push_back(static_cast<vertex_index_type>(vid));
+                    }
+                }
+            }
+        }
+
+        template <typename PathContainer>
+        void visit(const path &aPath, PathContainer &folders) const {
+            const std::int64_t vid = findVertex(aPath.string());
+            const VertexSummary *aSummary = nullptr;
+            if (vid >= 0) {
+                IsVisited[vid] = 1;
+                aSummary = Table.summary(static_cast<vertex_index_type>(vid));
+            }
 
+            // Entries of a folder whose time stamp has not changed are the same.
+            if (Quick && (aSummary != nullptr) && (aSummary->DirTime != 0) &&
+                (filesystem::detail::folder_time(aPath) == aSummary->DirTime)) {
+                for (auto const child : Children[vid]) {
+                    folders.emplace_back(Table.Vids[child]);
+                }
+                ++NumberOfTrustedFolders;
+                return;
+            }
+
+            std::vector<FileInfo> current;
+            list(aPath, current, folders);
+
+            // Skip unchanged folders without reading their vertexes.
+            if (aSummary != nullptr) {
+                std::uint64_t signature = 0;
+                for (auto const &info : current) {
+                    signature += file_signature(info);
+                }
+                if ((aSummary->NumberOfFiles == current.size()) &&
+                    (aSummary->FileSignature == signature)) {
+                    ++NumberOfSkippedFolders;
+                    return;
+                }
+            }
+
+            std::vector<FileInfo> baseline;
+            if (vid >= 0) {
+                readVertex(static_cast<vertex_index_type>(vid), baseline);
+            }
+
+            // Both lists are small so they are diffed by the visiting thread.
+            auto isLess = [](const FileInfo &lhs, const FileInfo &rhs) {
+                return lhs.Path < rhs.Path;
+            };
+            std::sort(baseline.begin(), baseline.end(), isLess);
+            std::sort(current.begin(), current.end(), isLess);
+            std::vector<FileInfo> modifiedFiles, deletedFiles, newFiles;
+            std::vector<std::pair<FileInfo, FileInfo>> ambiguous;
+            detail::merge_diff(baseline.begin(), baseline.end(), current.begin(), current.end(),
+                               modifiedFiles, deletedFiles, newFiles, StatComparator(),
+                               ambiguous);
+            if (!ambiguous.empty()) {
+                resolve_changes(Table.DB, ambiguous, modifiedFiles);
+                std::sort(modifiedFiles.begin(), modifiedFiles.end(), isLess);
+            }
+            if (!modifiedFiles.empty() || !deletedFiles.empty() || !newFiles.empty()) {
+                Output(modifiedFiles, deletedFiles, newFiles);
+            }
+        }
+
+        // Return sorted ids of vertexes that have been visited.
+        std::vector<vertex_index_type> visitedVertexes() const {
+            std::vector<vertex_index_type> results;
+            for (size_t vid = 0; vid < IsVisited.size(); ++vid) {
+                if (IsVisited[vid]) {
+                    results.push_back(static_cast<vertex_index_type>(vid));
+                }
+            }
+            return results;
+        }
+
+        void print() const {
+            fmt::print("Number of folders skipped using signatures: {}\n",
+                       NumberOfSkippedFolders);
+            fmt::print("Number of folders skipped using time stamps: {}\n",
+                       NumberOfTrustedFolders);
+        }
+
+      private:
+        const VertexTable &Table;
+        std::vector<std::vector<vertex_index_type>> Children;
+        bool Quick;
+        mutable std::vector<char> IsVisited; // Each element is written by one task only.
+        mutable std::atomic<size_t> NumberOfSkippedFolders;
+        mutable std::atomic<size_t> NumberOfTrustedFolders;
+        Consumer &Output;
+
+        // Return the id of a folder in the baseline or -1 for a new folder.
+        std::int64_t findVertex(const std::string &aPath) const {
+            auto const &vids = Table.Vids;
+            auto const it = std::lower_bound(vids.begin(), vids.end(), aPath);
+            if ((it == vids.end()) || (*it != aPath)) {
+                return -1;
+            }
+            return std::distance(vids.begin(), it);
+        }
+
+        template <typename PathContainer>
+        void list(const path &aPath, std::vector<FileInfo> &files,
+                  PathContainer &folders) const {
+            boost::system::error_code errcode;
+            directory_iterator endIter;
+            directory_iterator dirIter(aPath, errcode);
+            if (errcode) {
+                return;
+            }
+            filesystem::NormalPolicy filter;
+            for (; dirIter != endIter; ++dirIter) {
+                const auto currentPath = dirIter->path();
+                struct stat st;
+                if (::stat(currentPath.c_str(), &st) != 0) {
+                    continue;
+                }
+                auto aStem = currentPath.stem().string();
+                auto anExtension = currentPath.extension().string();
+                if (S_ISREG(st.st_mode)) {
+                    files.emplace_back(filesystem::detail::make_file_info(
+                        st, currentPath.string(), std::move(aStem), std::move(anExtension)));
+                } else if (S_ISDIR(st.st_mode) && filter.isValidStem(aStem) &&
+                           filter.isValidExt(anExtension)) {
+                    folders.emplace_back(currentPath);
+                }
+            }
+        }
+
+        void readVertex(const vertex_index_type vid, std::vector<FileInfo> &files) const {
+            std::string value;
+            if (Table.read(vid, value)) {
+                files = detail::decode_files(value);
+            }
+        }
+    };
+
+    // Return normalized roots of given folders. Nested folders are removed.
+    inline std::vector<std::string> search_roots(const std::vector<std::string> &folders) {
+        std::vector<std::string> allFolders, results;
+        for (auto const &aFolder : folders) {
+            allFolders.emplace_back(normalize_path(aFolder));
+        }
+        std::sort(allFolders.begin(), allFolders.end());
+        for (auto const &aFolder : allFolders) {
+            auto isParent = [&aFolder](const std::string &parent) {
+                return (aFolder.compare(0, parent.size(), parent) == 0) &&
+                       ((aFolder.size() == parent.size()) || (aFolder[parent.size()] == '/'));
+            };
+            if (std::none_of(results.begin(), results.end(), isParent)) {
+                results.push_back(aFolder);
+            }
+        }
+        return results;
+    }
+
+    /**
+     * Diff given folders against a baseline one folder at a time. Folders
+     * are listed in parallel and each folder is diffed against its baseline
+     * vertex as soon as it is listed, so traversal, database reads, and
+     * diffs overlap and only the differences are passed to the consumer.
+     * Files of baseline folders that do not exist anymore are reported as
+     * deleted at the end. The consumer is called concurrently with the
+     * modified, deleted, and new files of a folder. See DiffVisitor for the
+     * quick mode. Folders must be the search roots of selected vertexes of
+     * the baseline table.
+     */
+    template <typename Consumer>
+    void diff_folders_pipeline(const VertexTable &table,
+                               const std::vector<std::string> &searchFolders,
+                               Consumer &consumer, bool verbose = false, bool quick = false) {
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Pipelined diff time: ", verbose);
+        DiffVisitor<Consumer> visitor(table, consumer, quick);
+        filesystem::parallel_file_search(searchFolders, visitor, verbose);
+
+        // Report files of removed folders.
+        const auto visitedVids = visitor.visitedVertexes();
+        std::vector<vertex_index_type> removedVids;
+        std::set_difference(table.Selected.begin(), table.Selected.end(), visitedVids.begin(),
+                            visitedVids.end(), std::back_inserter(removedVids));
         if (verbose) {
-            std::cout << "---- Dictionary sizes: " << dict.size() << " \n";
+            visitor.print();
+            fmt::print("Number of visited vertexes: {}\n", visitedVids.size());
+            fmt::print("Number of removed vertexes: {}\n", removedVids.size());
         }
+        auto removeObj = [&consumer](std::vector<FileInfo> &files) {
+            std::vector<FileInfo> modifiedFiles, newFiles;
+            consumer(modifiedFiles, files, newFiles);
+            files.clear();
+            return true;
+        };
+        read_vertexes_tbb(table, removedVids, removeObj);
+    }
 
-        // Remove items that belong to both. We assume that the number of
-        // modified files is significantly less than the total number of files.
-        auto getDiff = [&dict, &results](const auto &item) {
-            auto const pos = dict.find(item);
-            if (pos != dict.end()) {
-                dict.erase(pos);
-            } else {
-                results.emplace_back(item);
+    // Diff given folders against the latest state of a database.
+    template <typename Consumer>
+    void diff_folders_pipeline(rocksdb::DB &db, const std::vector<std::string> &folders,
+                               Consumer &consumer, bool verbose = false, bool quick = false) {
+        // Nested folders would be visited twice so only their roots are kept.
+        const auto searchFolders = search_roots(folders);
+        const VertexTable table(db, searchFolders, verbose);
+        diff_folders_pipeline(table, searchFolders, consumer, verbose, quick);
+    }
+
+    namespace detail {
+        /**
+         * Compare two versions of a file that are stored in two databases.
+         * Files are the same if cached content hashes are available and
+         * equal, or if their sizes and modification times are equal.
+         */
+        struct DatabaseComparator {
+            rocksdb::DB &First;
+            rocksdb::DB &Second;
+
+            Change operator()(const FileInfo &lhs, const FileInfo &rhs) const {
+                if (lhs.Size != rhs.Size) {
+                    return Change::Modified;
+                }
+                std::uint64_t x, y;
+                if (read_hash(First, lhs, x) && read_hash(Second, rhs, y)) {
+                    return (x == y) ? Change::Same : Change::Modified;
+                }
+                return ((lhs.ModifiedTime != 0) && (lhs.ModifiedTime == rhs.ModifiedTime))
+                           ? Change::Same
+                           : Change::Modified;
             }
         };
+    } // namespace detail
 
-        std::for_each(first.begin(), first.end(), getDiff);
-
-        // Get modified and deleted items.
-        std::unordered_map<std::string, value_type> map;
-        map.reserve(dict.size());
-        for (auto item : dict) {
-            map.emplace(std::make_pair(item.Path, item));
-        }
-
-        // Note: Modified files are files that are also in the dictionary,
-        // however, they have a different size and permission.
-        if (!map.empty()) {
-            for (auto item : results) {
-                const auto pos = map.find(item.Path);
-                if (pos != map.end()) {
-                    auto dictItem = pos->second;
-                    bool isOK = (item.Size == dictItem.Size) &&
-                                (item.Permissions == dictItem.Permissions);
-                    if (!isOK) {
-                        modifiedFiles.emplace_back(item);
-                    }
-                    map.erase(item.Path);
+    /**
+     * Return the folders of the second table of a diff. If otherFolder is
+     * not empty then it is the folder of the second table that matches the
+     * only given folder.
+     */
+    inline std::vector<std::string> other_folders(const std::vector<std::string> &folders,
+                                                  const std::string &otherFolder) {
+        if (otherFolder.empty()) {
+            return folders;
+        }
+        if (folders.size() != 1) {
+            throw std::runtime_error("A folder of the other database must be paired with "
+                                     "exactly one folder");
+        }
+        return {otherFolder};
+    }
+
+    /**
+     * Diff two vertex tables without visiting the file system. Selected
+     * vertexes are matched by path. Sub-trees whose Merkle signatures are
+     * equal are skipped as a whole, and vertexes whose record hashes, file
+     * signatures, or encoded records are equal are skipped without being
+     * decoded. Two generations of a database share records of unchanged
+     * vertexes so only vertexes that differ are read. All other vertexes
+     * are decoded and merged in parallel. Vertexes of the second table must
+     * be selected using other_folders, and its paths are mapped to the only
+     * given folder if otherFolder is not empty. The consumer is called
+     * concurrently with the modified, deleted, and new files of a folder.
+     */
+    template <typename Consumer>
+    void diff_vertex_tables(const VertexTable &firstTable, const VertexTable &secondTable,
+                            const std::vector<std::string> &folders, Consumer &consumer,
+                            bool verbose = false,
+                            const std::string &otherFolder = std::string()) {
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Database diff time: ", verbose);
+        const bool isMapped = !otherFolder.empty();
+        const std::string root = isMapped ? normalize_path(folders.front()) : std::string();
+        const std::string otherRoot = isMapped ? normalize_path(otherFolder) : std::string();
+        auto mapPath = [&](std::string &aPath) {
+            if (isMapped) {
+                aPath = root + aPath.substr(otherRoot.size());
+            }
+        };
+        const bool isShared = firstTable.isGeneration() && secondTable.isGeneration() &&
+                              (&firstTable.DB == &secondTable.DB) && !isMapped;
+
+        // Match vertexes by path. Mapping a common prefix keeps paths sorted.
+        struct Job {
+            std::string Path;
+            std::int64_t First;
+            std::int64_t Second;
+        };
+        std::vector<Job> jobs;
+        {
+            auto firstIt = firstTable.Selected.begin();
+            auto secondIt = secondTable.Selected.begin();
+            while ((firstIt != firstTable.Selected.end()) ||
+                   (secondIt != secondTable.Selected.end())) {
+                std::string secondPath;
+                if (secondIt != secondTable.Selected.end()) {
+                    secondPath = secondTable.Vids[*secondIt];
+                    mapPath(secondPath);
+                }
+                const int order = (firstIt == firstTable.Selected.end())
+                                      ? 1
+                                      : (secondIt == secondTable.Selected.end())
+                                            ? -1
+                                            : firstTable.Vids[*firstIt].compare(secondPath);
+                if (order < 0) {
+                    jobs.push_back({firstTable.Vids[*firstIt], *firstIt, -1});
+                    ++firstIt;
+                } else if (order > 0) {
+                    jobs.push_back({std::move(secondPath), -1, *secondIt});
+                    ++secondIt;
                 } else {
-                    newFiles.emplace_back(item);
+                    jobs.push_back({std::move(secondPath), *firstIt, *secondIt});
+                    ++firstIt;
+                    ++secondIt;
                 }
             }
-        } else {
-            newFiles = std::move(results);
         }
 
-        // Get deleted items
-        std::for_each(map.begin(), map.end(), [&deletedFiles](auto const &item) {
-            deletedFiles.emplace_back(item.second);
-        });
+        // Sub-trees with the same Merkle signature are the same. Signatures
+        // include paths so they can only be compared if paths are not mapped.
+        std::vector<char> isSkipped(jobs.size(), 0);
+        auto isLess = [](const Job &aJob, const std::string &aPath) {
+            return aJob.Path < aPath;
+        };
+        for (size_t idx = 0; !isMapped && (idx < jobs.size()); ++idx) {
+            const Job &aJob = jobs[idx];
+            if (isSkipped[idx] || (aJob.First < 0) || (aJob.Second < 0)) {
+                continue;
+            }
+            const auto lhs = firstTable.summary(aJob.First);
+            const auto rhs = secondTable.summary(aJob.Second);
+            if ((lhs != nullptr) && (rhs != nullptr) && (lhs->Signature != 0) &&
+                (lhs->Signature == rhs->Signature)) {
+                const auto range =
+                    descendant_range(jobs.begin() + idx, jobs.end(), aJob.Path, isLess);
+                isSkipped[idx] = 1;
+                std::fill(isSkipped.begin() + std::distance(jobs.begin(), range.first),
+                          isSkipped.begin() + std::distance(jobs.begin(), range.second), 1);
+            }
+        }
+
+        std::atomic<size_t> numberOfDecodedVertexes(0);
+        const detail::DatabaseComparator compare{firstTable.DB, secondTable.DB};
+        auto diffObj = [&](const tbb::blocked_range<size_t> &r) {
+            std::string firstValue, secondValue;
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                const Job &aJob = jobs[idx];
+                if (isSkipped[idx]) {
+                    continue;
+                }
+                if (isShared && (aJob.First >= 0) && (aJob.Second >= 0) &&
+                    (firstTable.RecordHashes[aJob.First] ==
+                     secondTable.RecordHashes[aJob.Second])) {
+                    continue;
+                }
+                if ((aJob.First >= 0) && (aJob.Second >= 0) && !isMapped) {
+                    const auto lhs = firstTable.summary(aJob.First);
+                    const auto rhs = secondTable.summary(aJob.Second);
+                    if ((lhs != nullptr) && (rhs != nullptr) &&
+                        (lhs->NumberOfFiles == rhs->NumberOfFiles) &&
+                        (lhs->FileSignature == rhs->FileSignature)) {
+                        continue;
+                    }
+                }
+
+                firstValue.clear();
+                secondValue.clear();
+                if (aJob.First >= 0) {
+                    firstTable.read(aJob.First, firstValue);
+                }
+                if (aJob.Second >= 0) {
+                    secondTable.read(aJob.Second, secondValue);
+                }
+                if (!isMapped && (aJob.First >= 0) && (aJob.Second >= 0) &&
+                    (firstValue == secondValue)) {
+                    continue;
+                }
+
+                ++numberOfDecodedVertexes;
+                std::vector<FileInfo> firstFiles, secondFiles;
+                if (!firstValue.empty()) {
+                    firstFiles = detail::decode_files(firstValue);
+                }
+                if (!secondValue.empty()) {
+                    secondFiles = detail::decode_files(secondValue);
+                }
+                for (auto &info : secondFiles) {
+                    mapPath(info.Path);
+                }
+                auto isLessFile = [](const FileInfo &lhs, const FileInfo &rhs) {
+                    return lhs.Path < rhs.Path;
+                };
+                std::sort(firstFiles.begin(), firstFiles.end(), isLessFile);
+                std::sort(secondFiles.begin(), secondFiles.end(), isLessFile);
+                std::vector<FileInfo> modifiedFiles, deletedFiles, newFiles;
+                std::vector<std::pair<FileInfo, FileInfo>> ambiguous;
+                detail::merge_diff(firstFiles.begin(), firstFiles.end(), secondFiles.begin(),
+                                   secondFiles.end(), modifiedFiles, deletedFiles, newFiles,
+                                   compare, ambiguous);
+                if (!modifiedFiles.empty() || !deletedFiles.empty() || !newFiles.empty()) {
+                    consumer(modifiedFiles, deletedFiles, newFiles);
+                }
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, jobs.size(), 16), diffObj);
+
+        if (verbose) {
+            fmt::print("Number of matched vertexes: {}\n", jobs.size());
+            fmt::print("Number of skipped vertexes: {}\n",
+                       std::count(isSkipped.begin(), isSkipped.end(), 1));
+            fmt::print("Number of decoded vertexes: {}\n", numberOfDecodedVertexes.load());
+        }
+    }
 
-        // Return
-        return std::make_tuple(modifiedFiles, newFiles, deletedFiles);
+    /**
+     * Diff the latest states of two file databases. See diff_vertex_tables.
+     */
+    template <typename Consumer>
+    void diff_databases(rocksdb::DB &first, rocksdb::DB &second,
+                        const std::vector<std::string> &folders, Consumer &consumer,
+                        bool verbose = false, const std::string &otherFolder = std::string()) {
+        const VertexTable firstTable(first, folders, verbose);
+        const VertexTable secondTable(second, other_folders(folders, otherFolder), verbose);
+        diff_vertex_tables(firstTable, secondTable, folders, consumer, verbose, otherFolder);
     }
 
     auto diffFolders(const std::string &dataFile, const std::vector<std::string> &folders,
@@ -242,44 +1066,45 @@ namespace sbutils {
             fmt::print("Number of files in the baseline: {}\n", baseline.size());
         }
 
-        return sbutils::diff(std::move(baseline), std::move(results));
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(dataFile));
+        return sbutils::diff(*db, std::move(baseline), std::move(results), verbose);
     }
 
     auto diffFolders_tbb(const std::string &dataFile, const std::vector<std::string> &folders,
-                         bool verbose) {
-        // Search for files in the given folders.
-        using path = boost::filesystem::path;
-        using PathContainer = std::vector<path>;
+                         bool verbose, bool quick = false) {
         using Container = std::vector<sbutils::FileInfo>;
-
-        PathContainer searchFolders;
-        for (auto item : folders) {
-            searchFolders.emplace_back(path(item));
-        }
-
-        // We do real work here
-        Container baseline, results;
-        using Visitor = sbutils::filesystem::SimpleVisitor<PathContainer,
-                                                           sbutils::filesystem::NormalPolicy>;
-
-        auto searchObj = [&searchFolders, &results]() {
-            Visitor visitor;
-            sbutils::filesystem::dfs_file_search(searchFolders, visitor);
-            results = visitor.getResults();
+        Container allModifiedFiles, allDeletedFiles, allNewFiles;
+        std::mutex mutex;
+        auto collectObj = [&](Container &modifiedFiles, Container &deletedFiles,
+                              Container &newFiles) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::move(modifiedFiles.begin(), modifiedFiles.end(),
+                      std::back_inserter(allModifiedFiles));
+            std::move(deletedFiles.begin(), deletedFiles.end(),
+                      std::back_inserter(allDeletedFiles));
+            std::move(newFiles.begin(), newFiles.end(), std::back_inserter(allNewFiles));
         };
 
-        auto readObj = [dataFile, &folders, &baseline, verbose]() {
-            baseline = sbutils::read_baseline<Container>(dataFile, folders, verbose);
-        };
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(dataFile));
+        diff_folders_pipeline(*db, folders, collectObj, verbose, quick);
 
-        tbb::parallel_invoke(searchObj, readObj);
-
-        // Return the differences between baseline and current state.
+        // Keep the output independent of the order in which folders are visited.
+        auto sortObj = [](Container &files) {
+            tbb::parallel_sort(files.begin(), files.end(),
+                               [](const FileInfo &lhs, const FileInfo &rhs) {
+                                   return lhs.Path < rhs.Path;
+                               });
+        };
+        tbb::parallel_invoke([&]() { sortObj(allModifiedFiles); },
+                             [&]() { sortObj(allDeletedFiles); },
+                             [&]() { sortObj(allNewFiles); });
+        auto results = std::make_tuple(std::move(allModifiedFiles), std::move(allDeletedFiles),
+                                       std::move(allNewFiles));
         if (verbose) {
-            fmt::print("Number of files: {}\n", results.size());
-            fmt::print("Number of files in the baseline: {}\n", baseline.size());
+            fmt::print("Number of modified files: {}\n", std::get<0>(results).size());
+            fmt::print("Number of deleted files: {}\n", std::get<1>(results).size());
+            fmt::print("Number of new files: {}\n", std::get<2>(results).size());
         }
-
-        return sbutils::diff(std::move(baseline), std::move(results));
+        return results;
     }
 } // namespace sbutils
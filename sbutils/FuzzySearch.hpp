@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DataStructures.hpp"
+
+#include "tbb/enumerable_thread_specific.h"
+#include "tbb/tbb.h"
+
+namespace sbutils {
+    /**
+     * Score file paths against a fuzzy pattern. A path matches if all
+     * characters of the pattern appear in the path in the same order. Matches
+     * that start at word boundaries, consecutive matches, and matches inside
+     * the file name get bonuses, gaps get penalties. Matching is smart-case i.e
+     * case insensitive unless the pattern has an upper case character.
+     */
+    class FuzzyScorer {
+      public:
+        enum : int { NoMatch = std::numeric_limits<int>::min() };
+
+        explicit FuzzyScorer(const std::string &pattern)
+            : Pattern(pattern), CaseSensitive(false) {
+            CaseSensitive = std::any_of(Pattern.begin(), Pattern.end(),
+                                        [](const char c) { return (c >= 'A') && (c <= 'Z'); });
+            for (int idx = 0; idx < 256; ++idx) {
+                const char c = static_cast<char>(idx);
+                Table[idx] = (!CaseSensitive && (c >= 'A') && (c <= 'Z')) ? (c + 'a' - 'A') : c;
+            }
+            std::transform(Pattern.begin(), Pattern.end(), Pattern.begin(),
+                           [this](const char c) { return fold(c); });
+        }
+
+        bool empty() const { return Pattern.empty(); }
+
+        // Return the score of a given path or NoMatch if the pattern is not a
+        // subsequence of the path.
+        int score(const std::string &aPath) const {
+            const char *begin = aPath.data();
+            const char *end = begin + aPath.size();
+            if (Pattern.empty()) {
+                return 0;
+            }
+
+            // Prefer matches in the file name then fall back to the full path.
+            const char *basename = begin;
+            for (const char *ptr = end; ptr != begin; --ptr) {
+                if (*(ptr - 1) == '/') {
+                    basename = ptr;
+                    break;
+                }
+            }
+
+            const char *last = forward(basename, end);
+            if (last != nullptr) {
+                return evaluate(begin, backward(basename, last), last) + BonusBasename;
+            }
+
+            last = forward(begin, end);
+            if (last == nullptr) {
+                return NoMatch;
+            }
+            return evaluate(begin, backward(begin, last), last);
+        }
+
+      private:
+        static constexpr int ScoreMatch = 16;
+        static constexpr int PenaltyGapStart = -3;
+        static constexpr int PenaltyGapExtension = -1;
+        static constexpr int BonusBoundary = 8;
+        static constexpr int BonusPathSeparator = 10;
+        static constexpr int BonusCamelCase = 7;
+        static constexpr int BonusConsecutive = 4;
+        static constexpr int BonusFirstCharMultiplier = 2;
+        static constexpr int BonusBasename = 32;
+
+        std::string Pattern;
+        bool CaseSensitive;
+        std::array<char, 256> Table;
+
+        char fold(const char c) const { return Table[static_cast<unsigned char>(c)]; }
+
+        // Find the position right after the last matched character using a
+        // greedy forward scan.
+        const char *forward(const char *begin, const char *end) const {
+            const char *ptr = begin;
+            for (const char c : Pattern) {
+                if (CaseSensitive) {
+                    ptr = static_cast<const char *>(std::memchr(ptr, c, end - ptr));
+                    if (ptr == nullptr) {
+                        return nullptr;
+                    }
+                } else {
+                    while ((ptr != end) && (fold(*ptr) != c)) {
+                        ++ptr;
+                    }
+                    if (ptr == end) {
+                        return nullptr;
+                    }
+                }
+                ++ptr;
+            }
+            return ptr;
+        }
+
+        // Scan backward from the end of a forward match to get the shortest
+        // window that still contains the pattern.
+        const char *backward(const char *begin, const char *last) const {
+            const char *ptr = last;
+            for (auto it = Pattern.rbegin(); it != Pattern.rend(); ++it) {
+                do {
+                    --ptr;
+                } while ((ptr != begin) && (fold(*ptr) != *it));
+            }
+            return ptr;
+        }
+
+        int bonus(const char prev, const char current) const {
+            if (prev == '/') {
+                return BonusPathSeparator;
+            }
+            if ((prev == '_') || (prev == '-') || (prev == '.') || (prev == ' ')) {
+                return BonusBoundary;
+            }
+            const bool isPrevLower = (prev >= 'a') && (prev <= 'z');
+            const bool isUpper = (current >= 'A') && (current <= 'Z');
+            return (isPrevLower && isUpper) ? BonusCamelCase : 0;
+        }
+
+        int evaluate(const char *begin, const char *first, const char *last) const {
+            int total = 0;
+            int chunkBonus = 0;
+            bool inGap = false;
+            bool isConsecutive = false;
+            size_t pidx = 0;
+            for (const char *ptr = first; ptr != last; ++ptr) {
+                if ((pidx < Pattern.size()) && (fold(*ptr) == Pattern[pidx])) {
+                    const char prev = (ptr == begin) ? '/' : *(ptr - 1);
+                    int aBonus = bonus(prev, *ptr);
+                    if (isConsecutive) {
+                        // Consecutive matches inherit the bonus of the first
+                        // character of the current chunk.
+                        chunkBonus = std::max({chunkBonus, aBonus, BonusConsecutive});
+                        aBonus = chunkBonus;
+                    } else {
+                        chunkBonus = aBonus;
+                    }
+                    total += ScoreMatch;
+                    total += (pidx == 0) ? BonusFirstCharMultiplier * aBonus : aBonus;
+                    isConsecutive = true;
+                    inGap = false;
+                    ++pidx;
+                } else {
+                    total += inGap ? PenaltyGapExtension : PenaltyGapStart;
+                    isConsecutive = false;
+                    inGap = true;
+                }
+            }
+            return total;
+        }
+    };
+
+    template <typename T> struct ScoredItem {
+        int Score;
+        T Item;
+    };
+
+    namespace detail {
+        // A candidate is better if it has a higher score. Shorter paths win ties.
+        template <typename Container> struct BetterCandidate {
+            const Container *Data;
+
+            bool operator()(const ScoredItem<size_t> &lhs,
+                            const ScoredItem<size_t> &rhs) const {
+                if (lhs.Score != rhs.Score) {
+                    return lhs.Score > rhs.Score;
+                }
+                auto const &x = (*Data)[lhs.Item].Path;
+                auto const &y = (*Data)[rhs.Item].Path;
+                return (x.size() != y.size()) ? (x.size() < y.size()) : (x < y);
+            }
+        };
+    } // namespace detail
+
+    /**
+     * Return k items which have the highest fuzzy scores sorted in descending
+     * order. Each thread keeps its own top-k heap and all heaps are merged at
+     * the end so the scoring loop does not need any synchronization.
+     */
+    template <typename Container>
+    auto fuzzy_filter_tbb(const Container &data, const FuzzyScorer &scorer, const size_t k) {
+        using value_type = typename Container::value_type;
+        using Candidate = ScoredItem<size_t>;
+        using Heap = std::vector<Candidate>;
+        std::vector<ScoredItem<value_type>> results;
+        if (k == 0) {
+            return results;
+        }
+
+        // The heap front is the worst candidate of each heap.
+        const detail::BetterCandidate<Container> isBetter{&data};
+        tbb::enumerable_thread_specific<Heap> heaps([k]() {
+            Heap aHeap;
+            aHeap.reserve(k);
+            return aHeap;
+        });
+
+        auto scoreObj = [&](const tbb::blocked_range<size_t> &r) {
+            Heap &aHeap = heaps.local();
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                const int score = scorer.score(data[idx].Path);
+                if (score == FuzzyScorer::NoMatch) {
+                    continue;
+                }
+                const Candidate aCandidate{score, idx};
+                if (aHeap.size() < k) {
+                    aHeap.push_back(aCandidate);
+                    std::push_heap(aHeap.begin(), aHeap.end(), isBetter);
+                } else if (isBetter(aCandidate, aHeap.front())) {
+                    std::pop_heap(aHeap.begin(), aHeap.end(), isBetter);
+                    aHeap.back() = aCandidate;
+                    std::push_heap(aHeap.begin(), aHeap.end(), isBetter);
+                }
+            }
+        };
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, data.size(), 4096), scoreObj);
+
+        // Merge all local heaps.
+        Heap candidates;
+        for (auto const &aHeap : heaps) {
+            candidates.insert(candidates.end(), aHeap.begin(), aHeap.end());
+        }
+        const size_t nitems = std::min(k, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + nitems, candidates.end(),
+                          isBetter);
+
+        results.reserve(nitems);
+        for (size_t idx = 0; idx < nitems; ++idx) {
+            results.push_back({candidates[idx].Score, data[candidates[idx].Item]});
+        }
+        return results;
+    }
+} // namespace sbutils
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "DataStructures.hpp"
+#include "FolderDiff.hpp"
+#include "Hash.hpp"
+#include "Resources.hpp"
+#include "RocksDB.hpp"
+#include "Timer.hpp"
+
+#include "tbb/tbb.h"
+
+namespace sbutils {
+    // A saved state of a file information database.
+    struct Generation {
+        std::uint64_t Id;
+        std::int64_t TimeStamp; // Seconds since the epoch.
+        std::uint64_t NumberOfVertexes;
+        std::uint64_t NumberOfFiles;
+
+        template <typename Archive> void serialize(Archive &ar) {
+            ar(Id, TimeStamp, NumberOfVertexes, NumberOfFiles);
+        }
+    };
+
+    /**
+     * The manifest of a generation maps each vertex id to the hash of its
+     * encoded record. A record is stored once as a blob and is shared by all
+     * generations that have it, so a generation only costs the records of
+     * folders that have changed since the previous generations.
+     */
+    struct Manifest {
+        Generation Info;
+        std::vector<std::string> Vids;
+        std::vector<std::uint64_t> RecordHashes;
+        std::vector<VertexSummary> Summaries;
+        StringTable Extensions;
+
+        template <typename Archive> void serialize(Archive &ar) {
+            ar(Info, Vids, RecordHashes, Summaries, Extensions);
+        }
+    };
+
+    namespace generations {
+        inline std::string manifest_key(const std::uint64_t id) {
+            return Resources::ManifestKey + to_fixed_string(9, id);
+        }
+
+        template <typename T> void put(rocksdb::WriteBatch &batch, const std::string &aKey,
+                                       const T &data) {
+            std::ostringstream os;
+            {
+                DefaultOArchive oar(os);
+                oar(data);
+            }
+            batch.Put(aKey, os.str());
+        }
+
+        inline bool is_number(const std::string &value) {
+            return !value.empty() && std::all_of(value.begin(), value.end(), [](char c) {
+                return (c >= '0') && (c <= '9');
+            });
+        }
+
+        // Parse a local time such as "2024-05-01", "2024-05-01 13:30", or
+        // "2024-05-01 13:30:15". Return false if the value is not a time.
+        inline bool parse_time(const std::string &value, std::time_t &timeStamp) {
+            for (auto const format : {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"}) {
+                std::tm tm = {};
+                std::istringstream is(value);
+                is >> std::get_time(&tm, format);
+                if (!is.fail() && (is.peek() == std::char_traits<char>::eof())) {
+                    tm.tm_isdst = -1;
+                    timeStamp = std::mktime(&tm);
+                    return timeStamp != -1;
+                }
+            }
+            return false;
+        }
+    } // namespace generations
+
+    // Return saved generations of a database from the oldest to the latest.
+    inline std::vector<Generation> read_generations(rocksdb::DB &db) {
+        std::vector<Generation> results;
+        read_value(db, Resources::GenerationKey, results);
+        return results;
+    }
+
+    /**
+     * Find a generation using its id, its position relative to the latest
+     * generation e.g "-1" for the one before the latest, or a local time
+     * e.g "2024-05-01 13:30" for the latest generation that was saved at or
+     * before that time.
+     */
+    inline Generation find_generation(const std::vector<Generation> &generations,
+                                      const std::string &spec) {
+        using namespace generations;
+        if (is_number(spec)) {
+            const std::uint64_t id = std::stoull(spec);
+            auto isMatched = [id](const Generation &item) { return item.Id == id; };
+            auto const pos = std::find_if(generations.begin(), generations.end(), isMatched);
+            if (pos != generations.end()) {
+                return *pos;
+            }
+        } else if ((spec.size() > 1) && (spec[0] == '-') && is_number(spec.substr(1))) {
+            const size_t offset = std::stoull(spec.substr(1));
+            if (offset < generations.size()) {
+                return generations[generations.size() - 1 - offset];
+            }
+        } else {
+            std::time_t timeStamp;
+            if (!parse_time(spec, timeStamp)) {
+                throw std::runtime_error("Invalid generation: " + spec);
+            }
+            for (auto it = generations.rbegin(); it != generations.rend(); ++it) {
+                if (it->TimeStamp <= timeStamp) {
+                    return *it;
+                }
+            }
+        }
+        throw std::runtime_error("Cannot find generation " + spec);
+    }
+
+    inline void print_generations(const std::vector<Generation> &generations) {
+        for (auto const &item : generations) {
+            const std::time_t timeStamp = item.TimeStamp;
+            std::ostringstream os;
+            os << std::put_time(std::localtime(&timeStamp), "%Y-%m-%d %H:%M:%S");
+            fmt::print("Generation {0}: {1}, {2} folders, {3} files\n", item.Id, os.str(),
+                       item.NumberOfVertexes, item.NumberOfFiles);
+        }
+    }
+
+    /**
+     * Save the state of a folder hierarchy as the latest generation of a
+     * database and remove the oldest generations so at most maxGenerations
+     * generations are kept. Records are encoded and hashed in parallel and
+     * only records that are not stored yet are written. Blobs that are only
+     * used by removed generations are deleted. Records are identified by
+     * their 64-bit hashes so a hash collision is assumed to never happen.
+     * Return the id of the new generation.
+     */
+    template <typename Hierarchy>
+    std::uint64_t save_generation(rocksdb::DB &db, const Hierarchy &hierarchy,
+                                  const size_t maxGenerations, bool verbose = false) {
+        using namespace generations;
+        sbutils::ElapsedTime<sbutils::MILLISECOND> t("Save generation: ", verbose);
+        if (maxGenerations == 0) {
+            throw std::runtime_error("The number of kept generations must be positive");
+        }
+
+        auto const &vertexes = hierarchy.Vertexes;
+        auto allGenerations = read_generations(db);
+        Manifest aManifest;
+        aManifest.Info.Id = allGenerations.empty() ? 1 : allGenerations.back().Id + 1;
+        aManifest.Info.TimeStamp = std::time(nullptr);
+        aManifest.Info.NumberOfVertexes = vertexes.size();
+        aManifest.Info.NumberOfFiles = hierarchy.AllFiles.size();
+        aManifest.Vids.reserve(vertexes.size());
+        for (auto const &aVertex : vertexes) {
+            aManifest.Vids.emplace_back(aVertex.Path);
+        }
+        aManifest.Summaries = hierarchy.Summaries;
+        aManifest.Extensions = hierarchy.Extensions;
+
+        // Records are encoded exactly like the vertexes of the latest state.
+        std::vector<std::string> records(vertexes.size());
+        aManifest.RecordHashes.resize(vertexes.size());
+        auto encodeObj = [&](const tbb::blocked_range<size_t> &r) {
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                std::ostringstream os;
+                {
+                    DefaultOArchive oar(os);
+                    oar(vertexes[idx]);
+                }
+                records[idx] = os.str();
+                aManifest.RecordHashes[idx] =
+                    xxhash64(records[idx].data(), records[idx].size());
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, vertexes.size(), 16), encodeObj);
+
+        // Every stored blob is used by at least one saved generation.
+        const size_t numberOfRemoved = (allGenerations.size() >= maxGenerations)
+                                           ? allGenerations.size() + 1 - maxGenerations
+                                           : 0;
+        std::unordered_set<std::uint64_t> stored, kept, removed;
+        kept.insert(aManifest.RecordHashes.begin(), aManifest.RecordHashes.end());
+        rocksdb::WriteBatch batch;
+        for (size_t idx = 0; idx < allGenerations.size(); ++idx) {
+            Manifest oldManifest;
+            const std::string aKey = manifest_key(allGenerations[idx].Id);
+            if (!read_value(db, aKey, oldManifest)) {
+                continue;
+            }
+            auto const &hashes = oldManifest.RecordHashes;
+            stored.insert(hashes.begin(), hashes.end());
+            if (idx < numberOfRemoved) {
+                removed.insert(hashes.begin(), hashes.end());
+                batch.Delete(aKey);
+            } else {
+                kept.insert(hashes.begin(), hashes.end());
+            }
+        }
+
+        size_t numberOfNewBlobs = 0;
+        for (size_t idx = 0; idx < records.size(); ++idx) {
+            if (stored.insert(aManifest.RecordHashes[idx]).second) {
+                batch.Put(blob_key(aManifest.RecordHashes[idx]), records[idx]);
+                ++numberOfNewBlobs;
+            }
+        }
+        size_t numberOfDeletedBlobs = 0;
+        for (auto const hash : removed) {
+            if (kept.find(hash) == kept.end()) {
+                batch.Delete(blob_key(hash));
+                ++numberOfDeletedBlobs;
+            }
+        }
+
+        allGenerations.erase(allGenerations.begin(), allGenerations.begin() + numberOfRemoved);
+        allGenerations.push_back(aManifest.Info);
+        put(batch, manifest_key(aManifest.Info.Id), aManifest);
+        put(batch, Resources::GenerationKey, allGenerations);
+        const rocksdb::Status s = db.Write(rocksdb::WriteOptions(), &batch);
+        if (!s.ok()) {
+            throw std::runtime_error("Cannot save a generation: " + s.ToString());
+        }
+
+        if (verbose) {
+            fmt::print("Number of new blobs: {}\n", numberOfNewBlobs);
+            fmt::print("Number of shared blobs: {}\n", records.size() - numberOfNewBlobs);
+            fmt::print("Number of removed generations: {}\n", numberOfRemoved);
+            fmt::print("Number of deleted blobs: {}\n", numberOfDeletedBlobs);
+            print_generations(allGenerations);
+        }
+        return aManifest.Info.Id;
+    }
+
+    /**
+     * Return the vertexes of given folders in a generation of a database,
+     * or in its latest state if the generation is empty. See find_generation
+     * for supported generations.
+     */
+    inline VertexTable open_vertex_table(rocksdb::DB &db, const std::string &at,
+                                         const std::vector<std::string> &folders,
+                                         bool verbose = false) {
+        if (at.empty()) {
+            return VertexTable(db, folders, verbose);
+        }
+        const Generation aGeneration = find_generation(read_generations(db), at);
+        Manifest aManifest;
+        if (!read_value(db, generations::manifest_key(aGeneration.Id), aManifest)) {
+            throw std::runtime_error("Cannot read the manifest of generation " +
+                                     std::to_string(aGeneration.Id));
+        }
+        if (verbose) {
+            print_generations({aGeneration});
+        }
+        return VertexTable(db, std::move(aManifest.Vids), std::move(aManifest.Summaries),
+                           std::move(aManifest.RecordHashes), std::move(aManifest.Extensions),
+                           folders);
+    }
+} // namespace sbutils
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace sbutils {
+    /**
+     * A streaming implementation of the 64-bit xxHash algorithm. Data can be
+     * added using any number of update calls and the digest of all added
+     * data is the same as the digest of a single buffer.
+     */
+    class XXHash64 {
+      public:
+        explicit XXHash64(const std::uint64_t seed = 0)
+            : V1(seed + Prime1 + Prime2), V2(seed + Prime2), V3(seed), V4(seed - Prime1),
+              Seed(seed), TotalLength(0), Memory(), MemorySize(0) {}
+
+        void update(const char *data, size_t len) {
+            TotalLength += len;
+
+            // Fill the stripe left by the previous call first.
+            if (MemorySize + len < StripeSize) {
+                std::memcpy(Memory + MemorySize, data, len);
+                MemorySize += len;
+                return;
+            }
+            if (MemorySize > 0) {
+                const size_t count = StripeSize - MemorySize;
+                std::memcpy(Memory + MemorySize, data, count);
+                consume(Memory);
+                data += count;
+                len -= count;
+                MemorySize = 0;
+            }
+
+            const char *end = data + len;
+            for (; data + StripeSize <= end; data += StripeSize) {
+                consume(data);
+            }
+            MemorySize = end - data;
+            std::memcpy(Memory, data, MemorySize);
+        }
+
+        std::uint64_t digest() const {
+            std::uint64_t h;
+            if (TotalLength >= StripeSize) {
+                h = rotl(V1, 1) + rotl(V2, 7) + rotl(V3, 12) + rotl(V4, 18);
+                h = merge(h, V1);
+                h = merge(h, V2);
+                h = merge(h, V3);
+                h = merge(h, V4);
+            } else {
+                h = Seed + Prime5;
+            }
+            h += TotalLength;
+
+            const char *ptr = Memory;
+            const char *end = Memory + MemorySize;
+            for (; ptr + 8 <= end; ptr += 8) {
+                h ^= round(0, read64(ptr));
+                h = rotl(h, 27) * Prime1 + Prime4;
+            }
+            if (ptr + 4 <= end) {
+                h ^= static_cast<std::uint64_t>(read32(ptr)) * Prime1;
+                h = rotl(h, 23) * Prime2 + Prime3;
+                ptr += 4;
+            }
+            for (; ptr != end; ++ptr) {
+                h ^= static_cast<unsigned char>(*ptr) * Prime5;
+                h = rotl(h, 11) * Prime1;
+            }
+
+            h ^= h >> 33;
+            h *= Prime2;
+            h ^= h >> 29;
+            h *= Prime3;
+            h ^= h >> 32;
+            return h;
+        }
+
+      private:
+        enum : size_t { StripeSize = 32 };
+        enum : std::uint64_t {
+            Prime1 = 11400714785074694791ULL,
+            Prime2 = 14029467366897019727ULL,
+            Prime3 = 1609587929392839161ULL,
+            Prime4 = 9650029242287828579ULL,
+            Prime5 = 2870177450012600261ULL
+        };
+
+        std::uint64_t V1, V2, V3, V4;
+        std::uint64_t Seed;
+        std::uint64_t TotalLength;
+        char Memory[StripeSize];
+        size_t MemorySize;
+
+        static std::uint64_t rotl(const std::uint64_t x, const int r) {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        static std::uint64_t read64(const char *ptr) {
+            std::uint64_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        static std::uint32_t read32(const char *ptr) {
+            std::uint32_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        static std::uint64_t round(std::uint64_t acc, const std::uint64_t input) {
+            acc += input * Prime2;
+            acc = rotl(acc, 31);
+            return acc * Prime1;
+        }
+
+        static std::uint64_t merge(std::uint64_t acc, const std::uint64_t value) {
+            acc ^= round(0, value);
+            return acc * Prime1 + Prime4;
+        }
+
+        void consume(const char *ptr) {
+            V1 = round(V1, read64(ptr));
+            V2 = round(V2, read64(ptr + 8));
+            V3 = round(V3, read64(ptr + 16));
+            V4 = round(V4, read64(ptr + 24));
+        }
+    };
+
+    inline std::uint64_t xxhash64(const char *data, const size_t len,
+                                  const std::uint64_t seed = 0) {
+        XXHash64 h(seed);
+        h.update(data, len);
+        return h.digest();
+    }
+
+    /**
+     * Compute the xxHash of a file content using a caller supplied buffer
+     * so large files are read with a few large read calls. Return false if
+     * the file cannot be read.
+     */
+    inline bool hash_file(const std::string &aPath, std::uint64_t &value, std::string &buffer,
+                          const size_t bufferSize = 1 << 20) {
+        const int fd = ::open(aPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        buffer.resize(bufferSize);
+        XXHash64 h;
+        bool isOK = true;
+        while (true) {
+            const ssize_t count = ::read(fd, &buffer[0], buffer.size());
+            if (count == 0) {
+                break;
+            }
+            if (count < 0) {
+                isOK = false;
+                break;
+            }
+            h.update(buffer.data(), static_cast<size_t>(count));
+        }
+        ::close(fd);
+        value = h.digest();
+        return isOK;
+    }
+} // namespace sbutils
@@ -0,0 +1,597 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "DataStructures.hpp"
+#include "FileCopy.hpp"
+#include "UtilsTBB.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+// Openat, close, and statx requests need the io_uring interface of Linux 5.6.
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(SYS_io_uring_setup) && defined(STATX_BASIC_STATS)
+#define SBUTILS_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace sbutils {
+#ifdef SBUTILS_HAS_IO_URING
+    /**
+     * A minimal io_uring instance that is set up using raw system calls so
+     * there is no dependency on liburing. Requests are added using getSqe
+     * and submitted using submit, and completions are consumed using
+     * forEachCompletion. An instance must not be shared between threads.
+     */
+    class IoUring {
+      public:
+        explicit IoUring(const unsigned entries)
+            : FD(-1), SqRing(nullptr), CqRing(nullptr), Sqes(nullptr), SqRingSize(0),
+              CqRingSize(0), SqesSize(0), SqHead(nullptr), SqTail(nullptr), SqMask(0),
+              SqEntries(0), SqArray(nullptr), CqHead(nullptr), CqTail(nullptr), CqMask(0),
+              Cqes(nullptr), LocalTail(0) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            FD = static_cast<int>(::syscall(SYS_io_uring_setup, entries, &params));
+            if (FD < 0) {
+                return;
+            }
+
+            SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool isSingleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (isSingleMap) {
+                SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize);
+            }
+            SqRing = map(SqRingSize, IORING_OFF_SQ_RING);
+            CqRing = isSingleMap ? SqRing : map(CqRingSize, IORING_OFF_CQ_RING);
+            SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            Sqes = static_cast<io_uring_sqe *>(map(SqesSize, IORING_OFF_SQES));
+            if ((SqRing == nullptr) || (CqRing == nullptr) || (Sqes == nullptr)) {
+                release();
+                return;
+            }
+
+            char *sq = static_cast<char *>(SqRing);
+            SqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            SqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            SqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            SqEntries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+            SqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            LocalTail = *SqTail;
+
+            char *cq = static_cast<char *>(CqRing);
+            CqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            CqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            CqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            Cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        }
+
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+        ~IoUring() { release(); }
+
+        // Return false if io_uring is not supported or not permitted.
+        bool isValid() const { return FD >= 0; }
+
+        bool registerBuffers(const std::vector<iovec> &buffers) {
+            return ::syscall(SYS_io_uring_register, FD, IORING_REGISTER_BUFFERS,
+                             buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+        }
+
+        // Return a cleared request or nullptr if the submission queue is full.
+        io_uring_sqe *getSqe() {
+            const unsigned head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+            if (LocalTail - head >= SqEntries) {
+                return nullptr;
+            }
+            const unsigned idx = LocalTail & SqMask;
+            io_uring_sqe *sqe = &Sqes[idx];
+            std::memset(sqe, 0, sizeof(*sqe));
+            SqArray[idx] = idx;
+            ++LocalTail;
+            return sqe;
+        }
+
+        // Submit all added requests and wait for at least waitNr completions.
+        void submit(const unsigned waitNr) {
+            __atomic_store_n(SqTail, LocalTail, __ATOMIC_RELEASE);
+            while (true) {
+                const unsigned pending = LocalTail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+                const unsigned flags = (waitNr > 0) ? IORING_ENTER_GETEVENTS : 0;
+                const long ret =
+                    ::syscall(SYS_io_uring_enter, FD, pending, waitNr, flags, nullptr, 0);
+                if (ret >= 0) {
+                    return;
+                }
+                if (errno != EINTR) {
+                    throw std::runtime_error(std::string("io_uring_enter: ") +
+                                             std::strerror(errno));
+                }
+            }
+        }
+
+        // Pass each available completion to a function and consume it.
+        template <typename Function> void forEachCompletion(Function &&func) {
+            unsigned head = *CqHead;
+            const unsigned tail = __atomic_load_n(CqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe &cqe = Cqes[head & CqMask];
+                const auto userData = cqe.user_data;
+                const auto res = cqe.res;
+                __atomic_store_n(CqHead, head + 1, __ATOMIC_RELEASE);
+                func(userData, res);
+            }
+        }
+
+      private:
+        int FD;
+        void *SqRing;
+        void *CqRing;
+        io_uring_sqe *Sqes;
+        size_t SqRingSize;
+        size_t CqRingSize;
+        size_t SqesSize;
+        unsigned *SqHead;
+        unsigned *SqTail;
+        unsigned SqMask;
+        unsigned SqEntries;
+        unsigned *SqArray;
+        unsigned *CqHead;
+        unsigned *CqTail;
+        unsigned CqMask;
+        io_uring_cqe *Cqes;
+        unsigned LocalTail;
+
+        void *map(const size_t len, const off_t offset) {
+            void *ptr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               FD, offset);
+            return (ptr == MAP_FAILED) ? nullptr : ptr;
+        }
+
+        void release() {
+            if (Sqes != nullptr) {
+                ::munmap(Sqes, SqesSize);
+            }
+            if ((CqRing != nullptr) && (CqRing != SqRing)) {
+                ::munmap(CqRing, CqRingSize);
+            }
+            if (SqRing != nullptr) {
+                ::munmap(SqRing, SqRingSize);
+            }
+            if (FD >= 0) {
+                ::close(FD);
+            }
+            FD = -1;
+            Sqes = nullptr;
+            SqRing = CqRing = nullptr;
+        }
+    };
+
+    /**
+     * Copy many files at once using io_uring. Each of QueueDepth slots
+     * copies one file at a time using a chain of statx, openat, read, write,
+     * optional fsync, and close requests, and a slot starts the next file
+     * as soon as its file is closed, so up to QueueDepth files are in
+     * flight and the throughput is limited by the devices instead of the
+     * latency of each call. Reads and writes use registered buffers when
+     * the memory lock limit allows it. A file whose requests fail, e.g a
+     * read-only destination, is copied again using copy_file. A file that
+     * cannot be copied does not stop the other files, and all errors are
+     * reported using std::runtime_error after the other files are copied.
+     */
+    class UringCopier {
+      public:
+        using path = boost::filesystem::path;
+        enum : size_t { BufferSize = 1 << 20 };
+
+        UringCopier(const path &dstDir, const std::vector<FileInfo> &files, bool verbose,
+                    const unsigned queueDepth, bool sync)
+            : DstDir(dstDir), Files(files), Verbose(verbose), Sync(sync),
+              Ring(2 * std::max(queueDepth, 1u)), Slots(std::max(queueDepth, 1u)),
+              Buffers(nullptr), IsFixed(false), NumberOfCopiedFiles(0),
+              NumberOfCopiedBytes(0), FallbackBuffer(), InFlight(0), Errors() {
+            for (auto &aSlot : Slots) {
+                aSlot.Src = aSlot.Dst = -1;
+            }
+            if (!Ring.isValid()) {
+                return;
+            }
+            void *ptr = ::mmap(nullptr, Slots.size() * BufferSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED) {
+                throw std::runtime_error("Cannot allocate io_uring buffers");
+            }
+            Buffers = static_cast<char *>(ptr);
+            std::vector<iovec> iovecs(Slots.size());
+            for (size_t idx = 0; idx < Slots.size(); ++idx) {
+                iovecs[idx].iov_base = Buffers + idx * BufferSize;
+                iovecs[idx].iov_len = BufferSize;
+            }
+            IsFixed = Ring.registerBuffers(iovecs);
+        }
+
+        UringCopier(const UringCopier &) = delete;
+        UringCopier &operator=(const UringCopier &) = delete;
+        ~UringCopier() {
+            if (Buffers != nullptr) {
+                ::munmap(Buffers, Slots.size() * BufferSize);
+            }
+        }
+
+        bool isValid() const { return Ring.isValid(); }
+
+        // Copy all files and return the number of copied files and bytes.
+        std::tuple<size_t, size_t> run() {
+            size_t next = 0, active = 0;
+            try {
+                for (size_t idx = 0; (idx < Slots.size()) && (next < Files.size()); ++idx) {
+                    start(idx, next++);
+                    ++active;
+                }
+                while (active > 0) {
+                    Ring.submit(1);
+                    Ring.forEachCompletion([&](const std::uint64_t userData, const int res) {
+                        --InFlight;
+                        const size_t idx = userData >> 3;
+                        if (!complete(Slots[idx], static_cast<Request>(userData & 7), res)) {
+                            return;
+                        }
+                        if (next < Files.size()) {
+                            start(idx, next++);
+                        } else {
+                            --active;
+                        }
+                    });
+                }
+            } catch (...) {
+                drain();
+                throw;
+            }
+
+            if (!Errors.empty()) {
+                std::string message = fmt::format("Cannot copy {} files:", Errors.size());
+                for (auto const &anError : Errors) {
+                    message += "\n" + anError;
+                }
+                throw std::runtime_error(message);
+            }
+            return std::make_tuple(NumberOfCopiedFiles, NumberOfCopiedBytes);
+        }
+
+      private:
+        enum Request : unsigned {
+            StatSource,
+            StatDestination,
+            OpenSource,
+            OpenDestination,
+            Read,
+            Write,
+            Fsync,
+            Close
+        };
+
+        struct Slot {
+            size_t Index;
+            const FileInfo *Info;
+            std::string DstFile;
+            struct statx SrcStat;
+            struct statx DstStat;
+            bool HasDestination;
+            bool HasError;
+            int Src;
+            int Dst;
+            off_t Offset;
+            size_t Length;  // The number of bytes of the current read.
+            size_t Written; // The number of written bytes of the current read.
+            unsigned Pending;
+        };
+
+        const path DstDir;
+        const std::vector<FileInfo> &Files;
+        bool Verbose;
+        bool Sync;
+        IoUring Ring;
+        std::vector<Slot> Slots;
+        char *Buffers;
+        bool IsFixed;
+        size_t NumberOfCopiedFiles;
+        size_t NumberOfCopiedBytes;
+        std::string FallbackBuffer;
+        size_t InFlight; // The number of submitted requests that are not completed.
+        std::vector<std::string> Errors;
+
+        io_uring_sqe *prepare(const Slot &aSlot, const Request type, const unsigned char op,
+                              const int fd) {
+            io_uring_sqe *sqe = Ring.getSqe();
+            if (sqe == nullptr) {
+                Ring.submit(0);
+                sqe = Ring.getSqe();
+            }
+            sqe->opcode = op;
+            sqe->fd = fd;
+            sqe->user_data = (static_cast<std::uint64_t>(aSlot.Index) << 3) | type;
+            ++InFlight;
+            return sqe;
+        }
+
+        /**
+         * Wait for all requests in flight and close the descriptors of all
+         * slots. The kernel writes to slots and buffers until a request is
+         * completed, so this must be done before they are destroyed.
+         */
+        void drain() noexcept {
+            try {
+                while (InFlight > 0) {
+                    Ring.submit(1);
+                    Ring.forEachCompletion([this](const std::uint64_t userData, const int res) {
+                        --InFlight;
+                        const auto type = static_cast<Request>(userData & 7);
+                        if (((type == OpenSource) || (type == OpenDestination)) && (res >= 0)) {
+                            ::close(res);
+                        }
+                    });
+                }
+            } catch (std::exception &) {
+                // The ring is broken so there is nothing left to wait for.
+            }
+            for (auto &aSlot : Slots) {
+                for (int *fd : {&aSlot.Src, &aSlot.Dst}) {
+                    if (*fd >= 0) {
+                        ::close(*fd);
+                        *fd = -1;
+                    }
+                }
+            }
+        }
+
+        void start(const size_t idx, const size_t fileIndex) {
+            Slot &aSlot = Slots[idx];
+            aSlot.Index = idx;
+            aSlot.Info = &Files[fileIndex];
+            aSlot.DstFile = (DstDir / path(aSlot.Info->Path)).string();
+            aSlot.HasDestination = true;
+            aSlot.HasError = false;
+            aSlot.Src = aSlot.Dst = -1;
+            aSlot.Offset = 0;
+            aSlot.Pending = 2;
+            statx(aSlot, StatSource, aSlot.Info->Path.c_str(), aSlot.SrcStat);
+            statx(aSlot, StatDestination, aSlot.DstFile.c_str(), aSlot.DstStat);
+        }
+
+        void statx(const Slot &aSlot, const Request type, const char *aPath,
+                   struct statx &st) {
+            io_uring_sqe *sqe = prepare(aSlot, type, IORING_OP_STATX, AT_FDCWD);
+            sqe->addr = reinterpret_cast<std::uint64_t>(aPath);
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = reinterpret_cast<std::uint64_t>(&st);
+        }
+
+        void open(const Slot &aSlot, const Request type, const char *aPath, const int flags,
+                  const mode_t mode) {
+            io_uring_sqe *sqe = prepare(aSlot, type, IORING_OP_OPENAT, AT_FDCWD);
+            sqe->addr = reinterpret_cast<std::uint64_t>(aPath);
+            sqe->len = mode;
+            sqe->open_flags = flags;
+        }
+
+        void readOrWrite(const Slot &aSlot, const Request type) {
+            const bool isRead = (type == Read);
+            const unsigned char op = IsFixed ? (isRead ? IORING_OP_READ_FIXED
+                                                       : IORING_OP_WRITE_FIXED)
+                                             : (isRead ? IORING_OP_READ : IORING_OP_WRITE);
+            io_uring_sqe *sqe = prepare(aSlot, type, op, isRead ? aSlot.Src : aSlot.Dst);
+            const size_t skipped = isRead ? 0 : aSlot.Written;
+            sqe->addr = reinterpret_cast<std::uint64_t>(Buffers + aSlot.Index * BufferSize +
+                                                        skipped);
+            sqe->len = static_cast<unsigned>(aSlot.Length - skipped);
+            sqe->off = aSlot.Offset + skipped;
+            sqe->buf_index = static_cast<std::uint16_t>(aSlot.Index);
+        }
+
+        void read(Slot &aSlot) {
+            aSlot.Length =
+                std::min<std::uint64_t>(BufferSize, aSlot.SrcStat.stx_size - aSlot.Offset);
+            aSlot.Written = 0;
+            aSlot.Pending = 1;
+            readOrWrite(aSlot, Read);
+        }
+
+        void close(Slot &aSlot) {
+            aSlot.Pending = 0;
+            for (int *fd : {&aSlot.Src, &aSlot.Dst}) {
+                if (*fd >= 0) {
+                    prepare(aSlot, Close, IORING_OP_CLOSE, *fd);
+                    *fd = -1;
+                    ++aSlot.Pending;
+                }
+            }
+        }
+
+        // Set the mode and time stamps of a copied file and close it.
+        void finish(Slot &aSlot) {
+            const struct timespec times[2] = {
+                {aSlot.SrcStat.stx_atime.tv_sec, aSlot.SrcStat.stx_atime.tv_nsec},
+                {aSlot.SrcStat.stx_mtime.tv_sec, aSlot.SrcStat.stx_mtime.tv_nsec}};
+            if ((::fchmod(aSlot.Dst, aSlot.SrcStat.stx_mode & 07777) != 0) ||
+                (::futimens(aSlot.Dst, times) != 0)) {
+                aSlot.HasError = true;
+            }
+            if (Sync && !aSlot.HasError) {
+                aSlot.Pending = 1;
+                prepare(aSlot, Fsync, IORING_OP_FSYNC, aSlot.Dst);
+                return;
+            }
+            close(aSlot);
+        }
+
+        // Copy a file whose requests failed using copy_file. An error is
+        // recorded so the other files are still copied.
+        void fallback(Slot &aSlot) {
+            try {
+                const CopyMethod method =
+                    copy_file(aSlot.Info->Path, aSlot.DstFile, FallbackBuffer);
+                if (method != CopyMethod::None) {
+                    done(aSlot, to_string(method));
+                }
+            } catch (std::exception &e) {
+                Errors.emplace_back(e.what());
+            }
+        }
+
+        void done(const Slot &aSlot, const char *method) {
+            ++NumberOfCopiedFiles;
+            NumberOfCopiedBytes += aSlot.Info->Size;
+            if (Verbose) {
+                fmt::print("Copy {0} to {1} using {2}\n", aSlot.Info->Path, aSlot.DstFile,
+                           method);
+            }
+        }
+
+        bool isUpToDate(const Slot &aSlot) const {
+            const auto &src = aSlot.SrcStat;
+            const auto &dst = aSlot.DstStat;
+            return aSlot.HasDestination && S_ISREG(dst.stx_mode) &&
+                   detail::is_up_to_date(src.stx_size, src.stx_mtime, dst.stx_size,
+                                         dst.stx_mtime);
+        }
+
+        // Handle a completion and return true if the file of a slot is done.
+        bool complete(Slot &aSlot, const Request type, const int res) {
+            --aSlot.Pending;
+            switch (type) {
+            case StatSource:
+                aSlot.HasError |= (res < 0);
+                break;
+            case StatDestination:
+                aSlot.HasDestination = (res == 0);
+                break;
+            case OpenSource:
+            case OpenDestination:
+                if (res < 0) {
+                    aSlot.HasError = true;
+                } else {
+                    ((type == OpenSource) ? aSlot.Src : aSlot.Dst) = res;
+                }
+                break;
+            case Read:
+                if (res <= 0) {
+                    // A source that got shorter is copied up to its end.
+                    aSlot.HasError |= (res < 0);
+                    if (!aSlot.HasError) {
+                        finish(aSlot);
+                        return false;
+                    }
+                    break;
+                }
+                aSlot.Length = static_cast<size_t>(res);
+                aSlot.Pending = 1;
+                readOrWrite(aSlot, Write);
+                return false;
+            case Write:
+                if (res <= 0) {
+                    aSlot.HasError = true;
+                    break;
+                }
+                aSlot.Written += static_cast<size_t>(res);
+                aSlot.Pending = 1;
+                if (aSlot.Written < aSlot.Length) {
+                    readOrWrite(aSlot, Write);
+                    return false;
+                }
+                aSlot.Offset += aSlot.Length;
+                if (static_cast<std::uint64_t>(aSlot.Offset) < aSlot.SrcStat.stx_size) {
+                    read(aSlot);
+                } else {
+                    aSlot.Pending = 0;
+                    finish(aSlot);
+                }
+                return false;
+            case Fsync:
+                aSlot.HasError |= (res < 0);
+                close(aSlot);
+                return false;
+            case Close:
+                aSlot.HasError |= (res < 0);
+                if (aSlot.Pending > 0) {
+                    return false;
+                }
+                if (aSlot.HasError) {
+                    fallback(aSlot);
+                } else {
+                    done(aSlot, "io_uring");
+                }
+                return true;
+            }
+
+            if (aSlot.Pending > 0) {
+                return false;
+            }
+
+            // Both requests of a stage are completed.
+            if (aSlot.HasError) {
+                close(aSlot);
+                if (aSlot.Pending == 0) {
+                    fallback(aSlot);
+                    return true;
+                }
+                return false;
+            }
+            if ((type == StatSource) || (type == StatDestination)) {
+                if (isUpToDate(aSlot)) {
+                    return true;
+                }
+                aSlot.Pending = 2;
+                open(aSlot, OpenSource, aSlot.Info->Path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+                open(aSlot, OpenDestination, aSlot.DstFile.c_str(),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+                return false;
+            }
+            if (aSlot.SrcStat.stx_size == 0) {
+                finish(aSlot);
+            } else {
+                read(aSlot);
+            }
+            return false;
+        }
+    };
+#endif
+
+    /**
+     * Copy files to dstDir using io_uring with a given queue depth and
+     * return the number of copied files and bytes. Copied files are
+     * flushed to the storage if sync is true. Files are copied using
+     * copyFiles_tbb if io_uring is not available.
+     */
+    inline std::tuple<size_t, size_t> copyFiles_uring(const std::vector<FileInfo> &files,
+                                                      const boost::filesystem::path &dstDir,
+                                                      bool verbose = false,
+                                                      const unsigned queueDepth = 32,
+                                                      bool sync = false) {
+#ifdef SBUTILS_HAS_IO_URING
+        UringCopier copier(dstDir, files, verbose, queueDepth, sync);
+        if (copier.isValid()) {
+            return copier.run();
+        }
+#else
+        (void)queueDepth;
+        (void)sync;
+#endif
+        if (verbose) {
+            fmt::print("io_uring is not available, files are copied using threads\n");
+        }
+        return copyFiles_tbb(files, dstDir, verbose);
+    }
+} // namespace sbutils
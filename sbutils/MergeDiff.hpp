@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_sort.h"
+
+namespace sbutils {
+    // The result of comparing two versions of a file that have the same path.
+    enum class Change { Same, Modified, Unknown };
+
+    // Files that have the same path and size are equal, which is the
+    // definition of FileInfo equality.
+    struct SizeComparator {
+        template <typename T> Change operator()(const T &lhs, const T &rhs) const {
+            return (lhs.Size == rhs.Size) ? Change::Same : Change::Modified;
+        }
+    };
+
+    /**
+     * The fast path of change detection. Files that have different sizes
+     * are modified and files that have the same inode, modification time,
+     * and status change time are not. The content of any other file has to
+     * be compared.
+     */
+    struct StatComparator {
+        template <typename T> Change operator()(const T &lhs, const T &rhs) const {
+            if (lhs.Size != rhs.Size) {
+                return Change::Modified;
+            }
+            if ((lhs.ModifiedTime != 0) && (lhs.Inode == rhs.Inode) &&
+                (lhs.ModifiedTime == rhs.ModifiedTime) &&
+                (lhs.ChangedTime == rhs.ChangedTime)) {
+                return Change::Same;
+            }
+            return Change::Unknown;
+        }
+    };
+
+    namespace detail {
+        /**
+         * Merge-join two path sorted ranges and move their differences to
+         * given containers. Pairs of items that the comparator cannot
+         * classify are moved to the ambiguous container.
+         */
+        template <typename Iterator, typename Container, typename Comparator,
+                  typename PairContainer>
+        void merge_diff(Iterator first, Iterator firstEnd, Iterator second, Iterator secondEnd,
+                        Container &modifiedFiles, Container &firstOnly, Container &secondOnly,
+                        const Comparator &compare, PairContainer &ambiguous) {
+            while ((first != firstEnd) && (second != secondEnd)) {
+                const int order = first->Path.compare(second->Path);
+                if (order < 0) {
+                    firstOnly.emplace_back(std::move(*first));
+                    ++first;
+                } else if (order > 0) {
+                    secondOnly.emplace_back(std::move(*second));
+                    ++second;
+                } else {
+                    switch (compare(*first, *second)) {
+                    case Change::Modified:
+                        modifiedFiles.emplace_back(std::move(*first));
+                        break;
+                    case Change::Unknown:
+                        ambiguous.emplace_back(std::move(*first), std::move(*second));
+                        break;
+                    default:
+                        break;
+                    }
+                    ++first;
+                    ++second;
+                }
+            }
+            firstOnly.insert(firstOnly.end(), std::make_move_iterator(first),
+                             std::make_move_iterator(firstEnd));
+            secondOnly.insert(secondOnly.end(), std::make_move_iterator(second),
+                              std::make_move_iterator(secondEnd));
+        }
+
+        template <typename Container>
+        void move_append(Container &results, std::vector<Container> &parts) {
+            size_t total = results.size();
+            for (auto const &aPart : parts) {
+                total += aPart.size();
+            }
+            results.reserve(total);
+            for (auto &aPart : parts) {
+                results.insert(results.end(), std::make_move_iterator(aPart.begin()),
+                               std::make_move_iterator(aPart.end()));
+            }
+        }
+    } // namespace detail
+
+    /**
+     * Return the differences between two lists of files in a single linear
+     * pass without any hash table. The returned tuple has
+     *     1. Items in both first and second but they are different.
+     *     2. Items in first and not in second.
+     *     3. Items in second and not in first.
+     * Modified items are taken from first and all items are moved out of
+     * the inputs. Inputs are sorted by path if they are not sorted yet. The
+     * path space is split into partitions using evenly spaced paths of the
+     * larger input and partitions are merged in parallel. Pairs of items
+     * that have the same path but cannot be classified by the comparator
+     * are moved to ambiguous so callers can compare their contents.
+     */
+    template <typename Container, typename Comparator>
+    std::tuple<Container, Container, Container>
+    sorted_diff(Container &first, Container &second, const Comparator &compare,
+                std::vector<std::pair<typename Container::value_type,
+                                      typename Container::value_type>> &ambiguous) {
+        using value_type = typename Container::value_type;
+        using PairContainer = std::vector<std::pair<value_type, value_type>>;
+        auto isLess = [](const value_type &lhs, const value_type &rhs) {
+            return lhs.Path < rhs.Path;
+        };
+        if (!std::is_sorted(first.begin(), first.end(), isLess)) {
+            tbb::parallel_sort(first.begin(), first.end(), isLess);
+        }
+        if (!std::is_sorted(second.begin(), second.end(), isLess)) {
+            tbb::parallel_sort(second.begin(), second.end(), isLess);
+        }
+
+        // Find partition boundaries in both inputs.
+        const size_t PartitionSize = 1 << 16;
+        const Container &larger = (first.size() >= second.size()) ? first : second;
+        const size_t numberOfPartitions = std::max<size_t>(1, larger.size() / PartitionSize);
+        std::vector<std::pair<size_t, size_t>> bounds(numberOfPartitions + 1);
+        bounds.front() = std::make_pair(0, 0);
+        bounds.back() = std::make_pair(first.size(), second.size());
+        for (size_t idx = 1; idx < numberOfPartitions; ++idx) {
+            const value_type &aKey = larger[idx * larger.size() / numberOfPartitions];
+            bounds[idx].first = std::distance(
+                first.begin(), std::lower_bound(first.begin(), first.end(), aKey, isLess));
+            bounds[idx].second = std::distance(
+                second.begin(), std::lower_bound(second.begin(), second.end(), aKey, isLess));
+        }
+
+        std::vector<Container> modifiedFiles(numberOfPartitions),
+            firstOnly(numberOfPartitions), secondOnly(numberOfPartitions);
+        std::vector<PairContainer> ambiguousFiles(numberOfPartitions);
+        auto mergeObj = [&](const tbb::blocked_range<size_t> &r) {
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                detail::merge_diff(first.begin() + bounds[idx].first,
+                                   first.begin() + bounds[idx + 1].first,
+                                   second.begin() + bounds[idx].second,
+                                   second.begin() + bounds[idx + 1].second, modifiedFiles[idx],
+                                   firstOnly[idx], secondOnly[idx], compare,
+                                   ambiguousFiles[idx]);
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, numberOfPartitions, 1), mergeObj);
+
+        std::tuple<Container, Container, Container> results;
+        detail::move_append(std::get<0>(results), modifiedFiles);
+        detail::move_append(std::get<1>(results), firstOnly);
+        detail::move_append(std::get<2>(results), secondOnly);
+        detail::move_append(ambiguous, ambiguousFiles);
+        return results;
+    }
+
+    // Items that have the same path are different if their sizes are different.
+    template <typename Container>
+    std::tuple<Container, Container, Container> sorted_diff(Container &first,
+                                                            Container &second) {
+        using value_type = typename Container::value_type;
+        std::vector<std::pair<value_type, value_type>> ambiguous;
+        return sorted_diff(first, second, SizeComparator(), ambiguous);
+    }
+} // namespace sbutils
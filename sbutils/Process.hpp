@@ -4,18 +4,19 @@
 #include "Poco/Process.h"
 #include "Poco/StreamCopier.h"
 #include <string>
+#include <tuple>
 #include <vector>
 
 namespace sbutils {
-    void run(const std::string &command, const std::vector<std::string> args,
-             std::string &output) {
+    inline void run(const std::string &command, const std::vector<std::string> args,
+                    std::string &output) {
         Poco::Pipe outPipe;
         Poco::ProcessHandle ph = Poco::Process::launch(command, args, 0, &outPipe, 0);
         Poco::PipeInputStream istr(outPipe);
         Poco::StreamCopier::copyToString(istr, output);
     }
 
-    std::string run(const std::string &command, const std::vector<std::string> args) {
+    inline std::string run(const std::string &command, const std::vector<std::string> args) {
         std::string output;
         run(command, args, output);
         return output;
@@ -26,7 +27,7 @@ namespace sbutils {
 
     using CommandOutput = std::tuple<std::string, std::string, int>;
 
-    CommandOutput run(CommandInfo &info, const std::string &initialDirectory) {
+    inline CommandOutput run(CommandInfo &info, const std::string &initialDirectory) {
         Poco::Pipe outPipe, errPipe;
         Poco::ProcessHandle ph = Poco::Process::launch(std::get<0>(info), std::get<1>(info),
                                                        initialDirectory, 0, &outPipe, &errPipe);
@@ -39,4 +40,18 @@ namespace sbutils {
         Poco::StreamCopier::copyToString(estr, errStr);
         return std::make_tuple(outStr, errStr, errCode);
     }
+
+    /**
+     * Run a command and collect both its standard output and standard error.
+     * The output is read before waiting for the command so a command that
+     * writes more than the pipe capacity cannot block. Return the exit code.
+     */
+    inline int execute(const CommandInfo &info, std::string &output) {
+        Poco::Pipe outPipe;
+        Poco::ProcessHandle ph = Poco::Process::launch(std::get<0>(info), std::get<1>(info),
+                                                       ".", 0, &outPipe, &outPipe);
+        Poco::PipeInputStream istr(outPipe);
+        Poco::StreamCopier::copyToString(istr, output);
+        return Poco::Process::wait(ph);
+    }
 }
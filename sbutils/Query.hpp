@@ -0,0 +1,758 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/utility/string_ref.hpp"
+
+#include "AsciiUtils.hpp"
+#include "DataStructures.hpp"
+#include "Utils.hpp"
+
+namespace sbutils {
+    // Parse a size such as 512, 10K, 4M, or 2G.
+    inline uintmax_t parse_size(const std::string &value) {
+        size_t pos = 0;
+        uintmax_t number = 0;
+        try {
+            if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) {
+                throw std::invalid_argument(value);
+            }
+            number = std::stoull(value, &pos);
+        } catch (std::logic_error &) {
+            throw std::runtime_error("Invalid size \"" + value + "\"");
+        }
+        const std::string unit = value.substr(pos);
+        if (unit.empty() || (unit == "B") || (unit == "b")) {
+            return number;
+        } else if ((unit == "K") || (unit == "k")) {
+            return number << 10;
+        } else if ((unit == "M") || (unit == "m")) {
+            return number << 20;
+        } else if ((unit == "G") || (unit == "g")) {
+            return number << 30;
+        }
+        throw std::runtime_error("Invalid size \"" + value + "\"");
+    }
+
+    // Parse a duration such as 30s, 15m, 1h, 2d, or 1w. Plain numbers are
+    // seconds.
+    inline std::time_t parse_duration(const std::string &value) {
+        size_t pos = 0;
+        std::time_t number = 0;
+        try {
+            if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) {
+                throw std::invalid_argument(value);
+            }
+            number = std::stoll(value, &pos);
+        } catch (std::logic_error &) {
+            throw std::runtime_error("Invalid duration \"" + value + "\"");
+        }
+        const std::string unit = value.substr(pos);
+        if (unit.empty() || (unit == "s")) {
+            return number;
+        } else if (unit == "m") {
+            return number * 60;
+        } else if (unit == "h") {
+            return number * 3600;
+        } else if (unit == "d") {
+            return number * 86400;
+        } else if (unit == "w") {
+            return number * 604800;
+        }
+        throw std::runtime_error("Invalid duration \"" + value + "\"");
+    }
+
+    namespace query {
+        enum class PredicateType : std::uint8_t {
+            Extension,  // The extension is one of Values.
+            Stem,       // The stem is one of Values.
+            Path,       // The path contains Values[0].
+            MinSize,    // size >= Number
+            MaxSize,    // size <= Number
+            NewerThan,  // time stamp >= Number
+            OlderThan,  // time stamp < Number
+            Permissions // All bits of Number are set.
+        };
+
+        struct Predicate {
+            PredicateType Type;
+            std::vector<std::string> Values;
+            std::intmax_t Number;
+        };
+
+        enum class ExprType : std::uint8_t { All, Any, Leaf };
+
+        // A parsed query. All and Any nodes are the AND and OR of their children.
+        struct Expr {
+            ExprType Type;
+            bool Negated;
+            Predicate Pred;
+            std::vector<Expr> Children;
+        };
+
+        inline Expr leaf(Predicate pred) {
+            return Expr{ExprType::Leaf, false, std::move(pred), {}};
+        }
+
+        inline Expr all_of(std::vector<Expr> children) {
+            return Expr{ExprType::All, false, Predicate(), std::move(children)};
+        }
+
+        inline Expr any_of(std::vector<Expr> children) {
+            return Expr{ExprType::Any, false, Predicate(), std::move(children)};
+        }
+
+        inline Expr negate(Expr expr) {
+            expr.Negated = !expr.Negated;
+            return expr;
+        }
+
+        /**
+         * Access file attributes that are used by predicates. Specialize this
+         * class to evaluate queries on other row types.
+         */
+        template <typename T> struct FileAttributes;
+
+        template <> struct FileAttributes<FileInfo> {
+            static StringTable::id_type extId(const FileInfo &info) { return info.ExtId; }
+            static boost::string_ref extension(const FileInfo &info) { return info.Extension; }
+            static boost::string_ref stem(const FileInfo &info) { return info.Stem; }
+            static boost::string_ref path(const FileInfo &info) { return info.Path; }
+            static uintmax_t size(const FileInfo &info) { return info.Size; }
+            static std::time_t timeStamp(const FileInfo &info) { return info.TimeStamp; }
+            static int permissions(const FileInfo &info) { return info.Permissions; }
+        };
+
+        namespace detail {
+            inline std::vector<std::string> split(const std::string &value) {
+                std::vector<std::string> results;
+                size_t begin = 0;
+                while (true) {
+                    const size_t pos = value.find(',', begin);
+                    results.emplace_back(value.substr(begin, pos - begin));
+                    if (pos == std::string::npos) {
+                        break;
+                    }
+                    begin = pos + 1;
+                }
+                return results;
+            }
+
+            // Words end at spaces or parentheses. Double quotes can be used
+            // to include those characters in a word.
+            inline std::vector<std::string> tokenize(const std::string &text) {
+                std::vector<std::string> tokens;
+                size_t pos = 0;
+                const size_t len = text.size();
+                while (pos < len) {
+                    const char c = text[pos];
+                    if (std::isspace(static_cast<unsigned char>(c))) {
+                        ++pos;
+                    } else if ((c == '(') || (c == ')') || (c == '!')) {
+                        tokens.emplace_back(1, c);
+                        ++pos;
+                    } else if (((c == '&') || (c == '|')) && (pos + 1 < len) &&
+                               (text[pos + 1] == c)) {
+                        tokens.emplace_back(2, c);
+                        pos += 2;
+                    } else {
+                        std::string word;
+                        auto isWordChar = [](const char x) {
+                            return !std::isspace(static_cast<unsigned char>(x)) &&
+                                   (x != '(') && (x != ')');
+                        };
+                        while ((pos < len) && isWordChar(text[pos])) {
+                            if (text[pos] == '"') {
+                                const size_t last = text.find('"', pos + 1);
+                                if (last == std::string::npos) {
+                                    throw std::runtime_error("Unterminated quote in \"" + text +
+                                                             "\"");
+                                }
+                                word.append(text, pos + 1, last - pos - 1);
+                                pos = last + 1;
+                            } else {
+                                word.push_back(text[pos++]);
+                            }
+                        }
+                        tokens.emplace_back(std::move(word));
+                    }
+                }
+                return tokens;
+            }
+
+            inline bool starts_with(const std::string &word, const char *prefix) {
+                return word.compare(0, std::strlen(prefix), prefix) == 0;
+            }
+
+            /**
+             * A recursive descent parser for
+             *     expr := term (('or' | '||') term)*
+             *     term := factor (('and' | '&&')? factor)*
+             *     factor := ('not' | '!') factor | '(' expr ')' | predicate
+             */
+            class Parser {
+              public:
+                explicit Parser(const std::string &text)
+                    : Text(text), Tokens(tokenize(text)), Pos(0), Now(std::time(nullptr)) {}
+
+                Expr parse() {
+                    if (Tokens.empty()) {
+                        return all_of({});
+                    }
+                    Expr results = parseOr();
+                    if (Pos != Tokens.size()) {
+                        error("unexpected \"" + Tokens[Pos] + "\"");
+                    }
+                    return results;
+                }
+
+              private:
+                std::string Text;
+                std::vector<std::string> Tokens;
+                size_t Pos;
+                std::time_t Now;
+
+                [[noreturn]] void error(const std::string &msg) const {
+                    throw std::runtime_error("Invalid query \"" + Text + "\": " + msg);
+                }
+
+                bool accept(const char *a, const char *b) {
+                    if ((Pos < Tokens.size()) && ((Tokens[Pos] == a) || (Tokens[Pos] == b))) {
+                        ++Pos;
+                        return true;
+                    }
+                    return false;
+                }
+
+                Expr parseOr() {
+                    std::vector<Expr> children{parseAnd()};
+                    while (accept("or", "||")) {
+                        children.emplace_back(parseAnd());
+                    }
+                    return (children.size() == 1) ? std::move(children[0])
+                                                  : any_of(std::move(children));
+                }
+
+                Expr parseAnd() {
+                    std::vector<Expr> children{parseUnary()};
+                    while (Pos < Tokens.size()) {
+                        const std::string &next = Tokens[Pos];
+                        if ((next == ")") || (next == "or") || (next == "||")) {
+                            break;
+                        }
+                        accept("and", "&&");
+                        children.emplace_back(parseUnary());
+                    }
+                    return (children.size() == 1) ? std::move(children[0])
+                                                  : all_of(std::move(children));
+                }
+
+                Expr parseUnary() {
+                    if (Pos == Tokens.size()) {
+                        error("unexpected end of the query");
+                    }
+                    if (accept("not", "!")) {
+                        return negate(parseUnary());
+                    }
+                    if (accept("(", "(")) {
+                        Expr results = parseOr();
+                        if (!accept(")", ")")) {
+                            error("missing \")\"");
+                        }
+                        return results;
+                    }
+                    return leaf(parsePredicate(Tokens[Pos++]));
+                }
+
+                Predicate parsePredicate(const std::string &word) {
+                    if (starts_with(word, "ext:")) {
+                        auto exts = split(word.substr(4));
+                        for (auto &anExt : exts) {
+                            if (!anExt.empty() && (anExt[0] != '.')) {
+                                anExt.insert(anExt.begin(), '.');
+                            }
+                        }
+                        return Predicate{PredicateType::Extension, std::move(exts), 0};
+                    }
+                    if (starts_with(word, "stem:")) {
+                        return Predicate{PredicateType::Stem, split(word.substr(5)), 0};
+                    }
+                    if (starts_with(word, "path:")) {
+                        return Predicate{PredicateType::Path, {word.substr(5)}, 0};
+                    }
+                    if (starts_with(word, "perm:")) {
+                        return parsePermissions(word);
+                    }
+
+                    // Words such as sizeof or mtimes.log are path predicates.
+                    if (isComparison(word, "size") || isComparison(word, "mtime")) {
+                        return parseComparison(word);
+                    }
+                    if (word.empty() || (word == ")") || (word == "and") || (word == "&&") ||
+                        (word == "or") || (word == "||")) {
+                        error("expected a predicate instead of \"" + word + "\"");
+                    }
+                    return Predicate{PredicateType::Path, {word}, 0};
+                }
+
+                static bool isComparison(const std::string &word, const char *field) {
+                    const size_t len = std::strlen(field);
+                    return starts_with(word, field) && (word.size() > len) &&
+                           ((word[len] == '<') || (word[len] == '>'));
+                }
+
+                // Parse perm:755 which has at most four octal digits.
+                Predicate parsePermissions(const std::string &word) {
+                    const std::string value = word.substr(5);
+                    if (value.empty() || (value.size() > 4) ||
+                        (value.find_first_not_of("01234567") != std::string::npos)) {
+                        error("invalid permissions \"" + value + "\"");
+                    }
+                    return Predicate{PredicateType::Permissions, {},
+                                     std::stoi(value, nullptr, 8)};
+                }
+
+                // Parse size>1M, size<=10K, mtime<1h (modified in the last
+                // hour), or mtime>2d (not modified in the last two days).
+                Predicate parseComparison(const std::string &word) {
+                    const size_t pos = word.find_first_of("<>");
+                    if (pos == std::string::npos) {
+                        error("expected a comparison in \"" + word + "\"");
+                    }
+                    const std::string field = word.substr(0, pos);
+                    const bool isLess = word[pos] == '<';
+                    const bool isInclusive = (pos + 1 < word.size()) && (word[pos + 1] == '=');
+                    const std::string value = word.substr(pos + 1 + isInclusive);
+                    if (field == "size") {
+                        const auto number = static_cast<std::intmax_t>(parse_size(value));
+                        if (isLess) {
+                            return Predicate{PredicateType::MaxSize, {},
+                                             isInclusive ? number : number - 1};
+                        }
+                        return Predicate{PredicateType::MinSize, {},
+                                         isInclusive ? number : number + 1};
+                    }
+                    if (field == "mtime") {
+                        const std::intmax_t timeStamp = Now - parse_duration(value);
+                        return Predicate{isLess ? PredicateType::NewerThan
+                                                : PredicateType::OlderThan,
+                                         {},
+                                         timeStamp};
+                    }
+                    error("unknown field \"" + field + "\"");
+                }
+            };
+        } // namespace detail
+
+        inline Expr parse(const std::string &text) { return detail::Parser(text).parse(); }
+    } // namespace query
+
+    /**
+     * A compiled query. Negations are pushed down to predicates, nested AND
+     * and OR nodes are merged, and the children of each node are ordered so
+     * that cheap and selective predicates are evaluated first. The result is
+     * stored in a flat array in pre-order so evaluation short-circuits by
+     * jumping over subtrees.
+     */
+    class Query {
+      public:
+        using Expr = query::Expr;
+        using ExprType = query::ExprType;
+        using Predicate = query::Predicate;
+        using PredicateType = query::PredicateType;
+
+        Query() : Nodes(), Predicates(), IgnoreCase(false) {}
+
+        // Compile a query. Extension predicates use integer ids if the
+        // extension table of the database is given. Extension, stem, and path
+        // predicates ignore case if ignoreCase is true.
+        explicit Query(const Expr &expr, const StringTable &extensions = StringTable(),
+                       bool ignoreCase = false)
+            : Nodes(), Predicates(), IgnoreCase(ignoreCase) {
+            Expr root = normalize(expr, false);
+            if ((root.Type == ExprType::All) && root.Children.empty()) {
+                return; // Match everything.
+            }
+            plan(root, extensions.size() > 0);
+            emit(root, extensions);
+        }
+
+        bool empty() const { return Nodes.empty(); }
+
+        template <typename T> bool isValid(const T &item) const {
+            return Nodes.empty() || evaluate(item, 0);
+        }
+
+        // Return false if none of the files of a vertex can satisfy the query.
+        bool isValid(const VertexSummary &summary) const {
+            return Nodes.empty() || ((summary.NumberOfFiles > 0) && evaluate(summary, 0));
+        }
+
+        // Return the evaluation order in prefix form.
+        std::string str() const { return Nodes.empty() ? "all" : str(0); }
+
+      private:
+        struct Node {
+            ExprType Type;
+            bool Negated;
+            std::uint32_t Index; // The predicate of a leaf.
+            std::uint32_t End;   // The position right after the subtree.
+        };
+
+        struct CompiledPredicate {
+            Predicate Pred; // Values are in lower case if IgnoreCase is true.
+            ExtIdFilter Ids;
+            bool UseIds;
+            bool IgnoreCase;
+        };
+
+        struct Estimate {
+            double Cost;
+            double Selectivity; // The fraction of files that pass.
+        };
+
+        std::vector<Node> Nodes;
+        std::vector<CompiledPredicate> Predicates;
+        bool IgnoreCase;
+
+        static Expr normalize(const Expr &expr, bool negated) {
+            negated = (negated != expr.Negated);
+            if (expr.Type == ExprType::Leaf) {
+                Expr results = expr;
+                results.Negated = false;
+                if (negated) {
+                    negateLeaf(results);
+                }
+                return results;
+            }
+
+            // De Morgan: NOT (a AND b) = NOT a OR NOT b.
+            Expr results;
+            results.Negated = false;
+            results.Type = !negated ? expr.Type
+                                    : ((expr.Type == ExprType::All) ? ExprType::Any
+                                                                    : ExprType::All);
+            for (auto const &child : expr.Children) {
+                Expr aChild = normalize(child, negated);
+                if (aChild.Type == results.Type) {
+                    std::move(aChild.Children.begin(), aChild.Children.end(),
+                              std::back_inserter(results.Children));
+                } else {
+                    results.Children.emplace_back(std::move(aChild));
+                }
+            }
+            if (results.Children.size() == 1) {
+                return std::move(results.Children[0]);
+            }
+            return results;
+        }
+
+        // Range predicates are negated by flipping them.
+        static void negateLeaf(Expr &expr) {
+            auto &pred = expr.Pred;
+            switch (pred.Type) {
+            case PredicateType::MinSize:
+                pred.Type = PredicateType::MaxSize;
+                pred.Number -= 1;
+                break;
+            case PredicateType::MaxSize:
+                pred.Type = PredicateType::MinSize;
+                pred.Number += 1;
+                break;
+            case PredicateType::NewerThan:
+                pred.Type = PredicateType::OlderThan;
+                break;
+            case PredicateType::OlderThan:
+                pred.Type = PredicateType::NewerThan;
+                break;
+            default:
+                expr.Negated = true;
+            }
+        }
+
+        // Rough per-file costs and pass rates of predicates.
+        static Estimate estimate(const Predicate &pred, bool useIds) {
+            const double nvalues = static_cast<double>(pred.Values.size());
+            switch (pred.Type) {
+            case PredicateType::Extension:
+                return {useIds ? 1.0 : 2.0 * nvalues, std::min(0.1 * nvalues, 0.9)};
+            case PredicateType::Stem:
+                return {2.0 * nvalues, std::min(0.01 * nvalues, 0.9)};
+            case PredicateType::Path:
+                return {8.0, 0.1};
+            case PredicateType::NewerThan:
+            case PredicateType::OlderThan:
+                return {1.0, 0.3};
+            default:
+                return {1.0, 0.5};
+            }
+        }
+
+        // Sort children so the expected cost of evaluating a node is
+        // minimized and return the estimate of the node.
+        static Estimate plan(Expr &expr, bool useIds) {
+            if (expr.Type == ExprType::Leaf) {
+                Estimate results = estimate(expr.Pred, useIds);
+                if (expr.Negated) {
+                    results.Selectivity = 1.0 - results.Selectivity;
+                }
+                return results;
+            }
+
+            const bool isAll = expr.Type == ExprType::All;
+            struct Item {
+                double Rank;
+                Estimate Est;
+                Expr Child;
+            };
+            std::vector<Item> children;
+            for (auto &child : expr.Children) {
+                const Estimate est = plan(child, useIds);
+                // AND nodes stop at the first failure and OR nodes stop at the
+                // first success.
+                const double stopRate =
+                    std::max(isAll ? (1.0 - est.Selectivity) : est.Selectivity, 1e-6);
+                children.push_back(Item{est.Cost / stopRate, est, std::move(child)});
+            }
+            std::stable_sort(children.begin(), children.end(),
+                             [](auto const &x, auto const &y) { return x.Rank < y.Rank; });
+
+            expr.Children.clear();
+            Estimate results{0.0, isAll ? 1.0 : 0.0};
+            double reachRate = 1.0;
+            for (auto &item : children) {
+                results.Cost += reachRate * item.Est.Cost;
+                if (isAll) {
+                    results.Selectivity *= item.Est.Selectivity;
+                    reachRate *= item.Est.Selectivity;
+                } else {
+                    results.Selectivity = 1.0 - (1.0 - results.Selectivity) *
+                                                    (1.0 - item.Est.Selectivity);
+                    reachRate *= (1.0 - item.Est.Selectivity);
+                }
+                expr.Children.emplace_back(std::move(item.Child));
+            }
+            return results;
+        }
+
+        void emit(const Expr &expr, const StringTable &extensions) {
+            const size_t pos = Nodes.size();
+            Nodes.push_back(Node{expr.Type, expr.Negated, 0, 0});
+            if (expr.Type == ExprType::Leaf) {
+                const bool useIds =
+                    (expr.Pred.Type == PredicateType::Extension) && (extensions.size() > 0);
+                Predicate pred = expr.Pred;
+                if (IgnoreCase) {
+                    for (auto &val : pred.Values) {
+                        val = ascii::to_lower(val);
+                    }
+                }
+                std::vector<std::string> exts;
+                if (useIds) {
+                    exts = pred.Values;
+                }
+                if (IgnoreCase) {
+                    // Use ids of all extensions that are equal ignoring case.
+                    for (size_t id = 0; useIds && (id < extensions.size()); ++id) {
+                        const std::string &anExt = extensions[id];
+                        if (std::find(pred.Values.begin(), pred.Values.end(),
+                                      ascii::to_lower(anExt)) != pred.Values.end()) {
+                            exts.push_back(anExt);
+                        }
+                    }
+                }
+                Nodes[pos].Index = static_cast<std::uint32_t>(Predicates.size());
+                Predicates.push_back(CompiledPredicate{
+                    std::move(pred), ExtIdFilter(exts, extensions), useIds, IgnoreCase});
+            }
+            for (auto const &child : expr.Children) {
+                emit(child, extensions);
+            }
+            Nodes[pos].End = static_cast<std::uint32_t>(Nodes.size());
+        }
+
+        template <typename T> bool evaluate(const T &item, const size_t pos) const {
+            const Node &aNode = Nodes[pos];
+            switch (aNode.Type) {
+            case ExprType::Leaf:
+                return test(Predicates[aNode.Index], item, aNode.Negated);
+            case ExprType::All:
+                for (size_t child = pos + 1; child < aNode.End; child = Nodes[child].End) {
+                    if (!evaluate(item, child)) {
+                        return false;
+                    }
+                }
+                return true;
+            default:
+                for (size_t child = pos + 1; child < aNode.End; child = Nodes[child].End) {
+                    if (evaluate(item, child)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+        }
+
+        template <typename T>
+        static bool test(const CompiledPredicate &aPredicate, const T &item, bool negated) {
+            using Attributes = query::FileAttributes<T>;
+            const Predicate &pred = aPredicate.Pred;
+            const bool ignoreCase = aPredicate.IgnoreCase;
+            auto isOneOf = [&pred, ignoreCase](const boost::string_ref &value) {
+                if (ignoreCase) {
+                    auto isEqual = [&value](const std::string &val) {
+                        return ascii::iequals(value.data(), value.size(), val);
+                    };
+                    return std::any_of(pred.Values.begin(), pred.Values.end(), isEqual);
+                }
+                return std::any_of(pred.Values.begin(), pred.Values.end(),
+                                   [&value](const std::string &val) { return value == val; });
+            };
+
+            bool results = false;
+            switch (pred.Type) {
+            case PredicateType::Extension:
+                results = aPredicate.UseIds ? aPredicate.Ids.isValidId(Attributes::extId(item))
+                                            : isOneOf(Attributes::extension(item));
+                break;
+            case PredicateType::Stem:
+                results = isOneOf(Attributes::stem(item));
+                break;
+            case PredicateType::Path: {
+                const boost::string_ref aPath = Attributes::path(item);
+                if (ignoreCase) {
+                    const char *end = aPath.data() + aPath.size();
+                    results = ascii::ifind(aPath.data(), end, pred.Values[0]) != end;
+                } else {
+                    results = aPath.find(boost::string_ref(pred.Values[0])) !=
+                              boost::string_ref::npos;
+                }
+                break;
+            }
+            case PredicateType::MinSize:
+                results = static_cast<std::intmax_t>(Attributes::size(item)) >= pred.Number;
+                break;
+            case PredicateType::MaxSize:
+                results = static_cast<std::intmax_t>(Attributes::size(item)) <= pred.Number;
+                break;
+            case PredicateType::NewerThan:
+                results = Attributes::timeStamp(item) >= pred.Number;
+                break;
+            case PredicateType::OlderThan:
+                results = Attributes::timeStamp(item) < pred.Number;
+                break;
+            case PredicateType::Permissions:
+                results = (Attributes::permissions(item) & pred.Number) == pred.Number;
+                break;
+            }
+            return results != negated;
+        }
+
+        // A vertex may contain a match unless its summary rules the
+        // predicate out. Negated predicates cannot be checked using summaries.
+        static bool test(const CompiledPredicate &aPredicate, const VertexSummary &summary,
+                         bool negated) {
+            if (negated) {
+                return true;
+            }
+            const Predicate &pred = aPredicate.Pred;
+            switch (pred.Type) {
+            case PredicateType::Extension:
+                return !aPredicate.UseIds || aPredicate.Ids.isValid(summary);
+            case PredicateType::MinSize:
+                return static_cast<std::intmax_t>(summary.MaxSize) >= pred.Number;
+            case PredicateType::MaxSize:
+                return static_cast<std::intmax_t>(summary.MinSize) <= pred.Number;
+            case PredicateType::NewerThan:
+                return summary.MaxTime >= pred.Number;
+            case PredicateType::OlderThan:
+                return summary.MinTime < pred.Number;
+            case PredicateType::Permissions:
+                return (summary.Permissions & pred.Number) == pred.Number;
+            default:
+                return true;
+            }
+        }
+
+        std::string str(const size_t pos) const {
+            const Node &aNode = Nodes[pos];
+            std::string results = aNode.Negated ? "!" : "";
+            if (aNode.Type == ExprType::Leaf) {
+                const Predicate &pred = Predicates[aNode.Index].Pred;
+                static const char *names[] = {"ext",    "stem",  "path",  "size>=",
+                                              "size<=", "time>=", "time<", "perm"};
+                results += names[static_cast<int>(pred.Type)];
+                if (pred.Values.empty()) {
+                    results += std::to_string(pred.Number);
+                } else {
+                    results += ":" + pred.Values[0];
+                    for (size_t idx = 1; idx < pred.Values.size(); ++idx) {
+                        results += "," + pred.Values[idx];
+                    }
+                }
+                return results;
+            }
+            results += (aNode.Type == ExprType::All) ? "(and" : "(or";
+            for (size_t child = pos + 1; child < aNode.End; child = Nodes[child].End) {
+                results += " " + str(child);
+            }
+            return results + ")";
+        }
+    };
+
+    struct BatchQuery {
+        std::string Id;
+        std::string Expression;
+    };
+
+    /**
+     * Read batch queries, one per line. A line is either a query expression
+     * or an id and an expression separated by a tab. Queries without ids are
+     * named after their line numbers. Empty lines and lines that start with
+     * '#' are skipped.
+     */
+    inline std::vector<BatchQuery> read_batch_queries(std::istream &input) {
+        std::vector<BatchQuery> queries;
+        std::string line;
+        size_t lineNumber = 0;
+        while (std::getline(input, line)) {
+            ++lineNumber;
+            const size_t pos = line.find_first_not_of(" \t");
+            if ((pos == std::string::npos) || (line[pos] == '#')) {
+                continue;
+            }
+            const size_t sep = line.find('\t', pos);
+            if (sep == std::string::npos) {
+                queries.push_back(BatchQuery{std::to_string(lineNumber), line.substr(pos)});
+            } else {
+                queries.push_back(
+                    BatchQuery{line.substr(pos, sep - pos), line.substr(sep + 1)});
+            }
+        }
+        return queries;
+    }
+
+    // Read batch queries from a file or from stdin if the file name is "-".
+    inline std::vector<BatchQuery> read_batch_queries(const std::string &fileName) {
+        if (fileName == "-") {
+            return read_batch_queries(std::cin);
+        }
+        std::ifstream input(fileName);
+        if (!input) {
+            throw std::runtime_error("Cannot open the batch file \"" + fileName + "\"");
+        }
+        return read_batch_queries(input);
+    }
+} // namespace sbutils
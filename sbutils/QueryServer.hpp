@@ -0,0 +1,408 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/asio.hpp"
+#include "boost/filesystem.hpp"
+
+#include "CommandUtils.hpp"
+#include "FileTable.hpp"
+#include "Resources.hpp"
+#include "RocksDB.hpp"
+
+#include "tbb/task_arena.h"
+
+namespace sbutils {
+    namespace protocol {
+        using socket_type = boost::asio::local::stream_protocol::socket;
+        using endpoint_type = boost::asio::local::stream_protocol::endpoint;
+
+        /**
+         * Every message has a one byte type, a four byte payload size, and a
+         * payload. A query is answered by Data messages followed by an End or
+         * an Error message.
+         */
+        enum class MessageType : std::uint8_t {
+            Query = 1,   // The payload is a serialized MLocateArgs object.
+            Count = 2,   // Same as Query but only the number of matched files is returned.
+            Reload = 3,  // Reload the file information database.
+            Data = 4,    // Matched paths separated by new lines.
+            End = 5,     // The last message of a reply.
+            Error = 6    // The payload is an error message.
+        };
+
+        // The largest request that a server accepts.
+        enum : std::uint32_t { MaxRequestSize = 1 << 20 };
+
+        // The largest number of reply bytes that are queued for a client. A query waits
+        // until the client has read enough of its reply.
+        enum : std::size_t { MaxQueuedSize = 16 << 20 };
+
+        // Return a message that is ready to be sent.
+        inline std::string encode_message(const MessageType type, const std::string &payload) {
+            const std::uint32_t size = static_cast<std::uint32_t>(payload.size());
+            std::string message(5 + payload.size(), 0);
+            message[0] = static_cast<char>(type);
+            std::memcpy(&message[1], &size, sizeof(size));
+            std::memcpy(&message[5], payload.data(), payload.size());
+            return message;
+        }
+
+        inline void write_message(socket_type &socket, const MessageType type,
+                                  const char *data, const std::uint32_t size) {
+            char header[5];
+            header[0] = static_cast<char>(type);
+            std::memcpy(header + 1, &size, sizeof(size));
+            std::array<boost::asio::const_buffer, 2> buffers = {
+                {boost::asio::buffer(header), boost::asio::buffer(data, size)}};
+            boost::asio::write(socket, buffers);
+        }
+
+        inline void write_message(socket_type &socket, const MessageType type,
+                                  const std::string &payload = std::string()) {
+            write_message(socket, type, payload.data(),
+                          static_cast<std::uint32_t>(payload.size()));
+        }
+
+        inline MessageType read_message(socket_type &socket, std::string &payload) {
+            char header[5];
+            boost::asio::read(socket, boost::asio::buffer(header));
+            std::uint32_t size;
+            std::memcpy(&size, header + 1, sizeof(size));
+            payload.resize(size);
+            if (size > 0) {
+                boost::asio::read(socket, boost::asio::buffer(&payload[0], size));
+            }
+            return static_cast<MessageType>(header[0]);
+        }
+
+        template <typename T> std::string encode(const T &data) {
+            std::ostringstream os;
+            {
+                DefaultOArchive oar(os);
+                oar(data);
+            }
+            return os.str();
+        }
+
+        template <typename T> T decode(const std::string &payload) {
+            T data = T();
+            std::istringstream is(payload);
+            DefaultIArchive iar(is);
+            iar(data);
+            return data;
+        }
+    } // namespace protocol
+
+    // The query server of a database listens on a socket next to it.
+    inline std::string socket_path(const std::string &database) {
+        return normalize_path(database) + ".sock";
+    }
+
+    /**
+     * A resident query server that keeps a FileTable in memory and answers
+     * mlocate queries over a Unix domain socket. All socket operations are
+     * asynchronous and run on the thread that calls run(), so slow or idle
+     * clients never hold a worker thread. Decoded requests are executed in a
+     * TBB task arena and their replies are queued and written by the I/O
+     * thread. The table is swapped atomically when the database is reloaded.
+     */
+    class QueryServer {
+      public:
+        QueryServer(const std::string &database, const std::string &socketPath, bool verbose)
+            : Database(database), SocketPath(socketPath), Verbose(verbose), Table(), Arena(),
+              IOService(), Acceptor() {
+            reload();
+        }
+
+        // Reload the database. Concurrent reloads are serialized because a RocksDB
+        // database cannot be opened twice at the same time.
+        void reload() {
+            std::lock_guard<std::mutex> lock(ReloadMutex);
+            auto aTable = std::make_shared<FileTable>();
+            {
+                std::unique_ptr<rocksdb::DB> db(sbutils::open(Database));
+                aTable->load(*db, Verbose);
+            }
+            std::atomic_store(&Table, std::shared_ptr<const FileTable>(std::move(aTable)));
+        }
+
+        void run() {
+            // Remove a stale socket file if there is not any server listening on it.
+            if (boost::filesystem::exists(SocketPath)) {
+                protocol::socket_type aSocket(IOService);
+                boost::system::error_code errcode;
+                aSocket.connect(protocol::endpoint_type(SocketPath), errcode);
+                if (!errcode) {
+                    throw std::runtime_error("A query server is already listening on \"" +
+                                             SocketPath + "\"");
+                }
+                boost::filesystem::remove(SocketPath);
+            }
+
+            Acceptor.reset(new boost::asio::local::stream_protocol::acceptor(
+                IOService, protocol::endpoint_type(SocketPath)));
+            if (Verbose) {
+                fmt::print("Listening on {}\n", SocketPath);
+            }
+            accept();
+            IOService.run();
+        }
+
+      private:
+        // A client connection. Its handlers are serialized using its strand.
+        struct Connection {
+            explicit Connection(boost::asio::io_service &ioService)
+                : Socket(ioService), Strand(ioService), Header(), Payload(), Outbox(),
+                  IsWriting(false), IsDone(false), IsBroken(false), Mutex(), Drained(),
+                  QueuedSize(0) {}
+            protocol::socket_type Socket;
+            boost::asio::io_service::strand Strand;
+            std::array<char, 5> Header;
+            std::string Payload;
+            std::deque<std::string> Outbox;
+            bool IsWriting;
+            bool IsDone;
+            std::atomic<bool> IsBroken; // The client has gone away.
+            std::mutex Mutex;           // Protects QueuedSize.
+            std::condition_variable Drained;
+            size_t QueuedSize; // The size of messages that are not written yet.
+        };
+        using ConnectionPtr = std::shared_ptr<Connection>;
+
+        std::string Database;
+        std::string SocketPath;
+        bool Verbose;
+        std::shared_ptr<const FileTable> Table;
+        std::mutex ReloadMutex;
+        tbb::task_arena Arena;
+        boost::asio::io_service IOService;
+        std::unique_ptr<boost::asio::local::stream_protocol::acceptor> Acceptor;
+
+        void accept() {
+            auto conn = std::make_shared<Connection>(IOService);
+            Acceptor->async_accept(conn->Socket,
+                                   [this, conn](const boost::system::error_code &errcode) {
+                                       if (!errcode) {
+                                           readRequest(conn);
+                                       }
+                                       accept();
+                                   });
+        }
+
+        void readRequest(const ConnectionPtr &conn) {
+            auto readPayload = [this, conn](const boost::system::error_code &errcode, size_t) {
+                if (errcode) {
+                    return;
+                }
+                std::uint32_t size;
+                std::memcpy(&size, conn->Header.data() + 1, sizeof(size));
+                if (size > protocol::MaxRequestSize) {
+                    send(conn, protocol::MessageType::Error, "The request is too large");
+                    finish(conn);
+                    return;
+                }
+                conn->Payload.resize(size);
+                boost::asio::async_read(
+                    conn->Socket, boost::asio::buffer(&conn->Payload[0], size),
+                    [this, conn](const boost::system::error_code &errcode, size_t) {
+                        if (!errcode) {
+                            Arena.enqueue([this, conn]() { serve(conn); });
+                        }
+                    });
+            };
+            boost::asio::async_read(conn->Socket, boost::asio::buffer(conn->Header),
+                                    readPayload);
+        }
+
+        // Queue a message of a connection. This function is thread-safe.
+        void send(const ConnectionPtr &conn, const protocol::MessageType type,
+                  const std::string &payload = std::string()) {
+            auto message =
+                std::make_shared<std::string>(protocol::encode_message(type, payload));
+            {
+                std::lock_guard<std::mutex> lock(conn->Mutex);
+                conn->QueuedSize += message->size();
+            }
+            conn->Strand.post([this, conn, message]() {
+                conn->Outbox.push_back(std::move(*message));
+                if (!conn->IsWriting) {
+                    write(conn);
+                }
+            });
+        }
+
+        // Close a connection after its queued messages are written.
+        void finish(const ConnectionPtr &conn) {
+            conn->Strand.post([this, conn]() {
+                conn->IsDone = true;
+                if (!conn->IsWriting) {
+                    write(conn);
+                }
+            });
+        }
+
+        void write(const ConnectionPtr &conn) {
+            if (conn->Outbox.empty()) {
+                conn->IsWriting = false;
+                if (conn->IsDone) {
+                    boost::system::error_code errcode;
+                    conn->Socket.close(errcode);
+                }
+                return;
+            }
+            conn->IsWriting = true;
+            boost::asio::async_write(
+                conn->Socket, boost::asio::buffer(conn->Outbox.front()),
+                conn->Strand.wrap([this, conn](const boost::system::error_code &errcode,
+                                               size_t) {
+                    {
+                        std::lock_guard<std::mutex> lock(conn->Mutex);
+                        if (errcode) {
+                            conn->IsBroken = true;
+                            conn->QueuedSize = 0;
+                            conn->Outbox.clear();
+                            conn->IsDone = true;
+                        } else {
+                            conn->QueuedSize -= conn->Outbox.front().size();
+                            conn->Outbox.pop_front();
+                        }
+                    }
+                    conn->Drained.notify_all();
+                    write(conn);
+                }));
+        }
+
+        // Block until the queued replies of a connection are small enough or the client
+        // has gone away. This function must not be called from the I/O thread.
+        void waitForOutbox(const ConnectionPtr &conn) {
+            std::unique_lock<std::mutex> lock(conn->Mutex);
+            conn->Drained.wait(lock, [&conn]() {
+                return conn->IsBroken || conn->QueuedSize < protocol::MaxQueuedSize;
+            });
+        }
+
+        // Execute a request in the task arena.
+        void serve(const ConnectionPtr &conn) {
+            using protocol::MessageType;
+            try {
+                const MessageType type = static_cast<MessageType>(conn->Header[0]);
+                switch (type) {
+                case MessageType::Query:
+                case MessageType::Count:
+                    query(conn, protocol::decode<MLocateArgs>(conn->Payload),
+                          type == MessageType::Count);
+                    break;
+                case MessageType::Reload:
+                    reload();
+                    break;
+                default:
+                    throw std::runtime_error("Unknown request");
+                }
+                send(conn, MessageType::End);
+            } catch (std::exception &e) {
+                if (Verbose) {
+                    fmt::print("Error: {}\n", e.what());
+                }
+                send(conn, MessageType::Error, e.what());
+            }
+            finish(conn);
+        }
+
+        void query(const ConnectionPtr &conn, MLocateArgs args, bool countOnly) {
+            // Keep a reference to the current table so a reload cannot release it.
+            const std::shared_ptr<const FileTable> aTable = std::atomic_load(&Table);
+            const FileTableQuery aQuery(*aTable, args);
+
+            if (countOnly) {
+                send(conn, protocol::MessageType::Data,
+                     std::to_string(aQuery.count(args.Folders)) + "\n");
+                return;
+            }
+
+            const size_t limit =
+                (args.Limit == 0) ? std::numeric_limits<size_t>::max() : args.Limit;
+            std::atomic<size_t> counter(0);
+            auto sendObj = [&](const std::vector<size_t> &rows) {
+                if (conn->IsBroken) {
+                    return false;
+                }
+                const size_t begin = counter.fetch_add(rows.size());
+                if (begin >= limit) {
+                    return false;
+                }
+                const size_t nrows = std::min(rows.size(), limit - begin);
+                std::string buffer;
+                for (size_t idx = 0; idx < nrows; ++idx) {
+                    buffer.append(aTable->path(rows[idx]), aTable->pathSize(rows[idx]));
+                    buffer.push_back('\n');
+                }
+                waitForOutbox(conn);
+                send(conn, protocol::MessageType::Data, buffer);
+                return (begin + nrows) < limit;
+            };
+            aQuery.run(args.Folders, sendObj);
+        }
+    };
+
+    /**
+     * Send a request to the query server of a given socket. Payloads of Data
+     * messages are passed to a consumer. Return false if there is not any
+     * server listening on the socket.
+     */
+    template <typename Consumer>
+    bool request_server(const std::string &socketPath, const protocol::MessageType type,
+                        const std::string &payload, Consumer &&consumer) {
+        using protocol::MessageType;
+        if (!boost::filesystem::exists(socketPath)) {
+            return false;
+        }
+
+        boost::asio::io_service ioService;
+        protocol::socket_type aSocket(ioService);
+        boost::system::error_code errcode;
+        aSocket.connect(protocol::endpoint_type(socketPath), errcode);
+        if (errcode) {
+            return false;
+        }
+
+        protocol::write_message(aSocket, type, payload);
+        std::string data;
+        while (true) {
+            switch (protocol::read_message(aSocket, data)) {
+            case MessageType::Data:
+                consumer(data);
+                break;
+            case MessageType::End:
+                return true;
+            case MessageType::Error:
+                throw std::runtime_error(data);
+            default:
+                throw std::runtime_error("Unexpected reply from " + socketPath);
+            }
+        }
+    }
+
+    // Ask the query server of a given database to reload its data.
+    inline bool notify_server(const std::string &database) {
+        try {
+            return request_server(socket_path(database), protocol::MessageType::Reload,
+                                  std::string(), [](const std::string &) {});
+        } catch (std::exception &) {
+            return false;
+        }
+    }
+} // namespace sbutils
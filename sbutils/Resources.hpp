@@ -11,6 +11,17 @@ namespace sbutils {
         static const std::string VIDKey;
         static const std::string EdgeKey;
         static const std::string AllFileKey;
+        static const std::string ExtensionKey;
+        static const std::string SummaryKey;
+        static const std::string ContentFileKey;
+        static const std::string ContentExtensionKey;
+        static const std::string ContentDocumentKey;
+        static const std::string TrigramKey;
+        static const std::string HashKey;
+        static const std::string GenerationKey;
+        static const std::string ManifestKey;
+        static const std::string BlobKey;
+        static const std::string FormatKey;
     };
     const std::string Resources::Database = ".database";
     const std::string Resources::Info = "_info_";
@@ -19,4 +30,15 @@ namespace sbutils {
     const std::string Resources::VIDKey = "_vids_";
     const std::string Resources::EdgeKey = "_edges_";
     const std::string Resources::AllFileKey = "_files_";
+    const std::string Resources::ExtensionKey = "_extensions_";
+    const std::string Resources::SummaryKey = "_summaries_";
+    const std::string Resources::ContentFileKey = "_content_files_";
+    const std::string Resources::ContentExtensionKey = "_content_extensions_";
+    const std::string Resources::ContentDocumentKey = "_content_doc_"; // Followed by a document id.
+    const std::string Resources::TrigramKey = "_content_trigram_"; // Followed by a trigram.
+    const std::string Resources::HashKey = "_hash_"; // Followed by inode, size, mtime, ctime.
+    const std::string Resources::GenerationKey = "_generations_";
+    const std::string Resources::ManifestKey = "_manifest_"; // Followed by a generation id.
+    const std::string Resources::BlobKey = "_blob_"; // Followed by a record hash.
+    const std::string Resources::FormatKey = "_format_";
 }
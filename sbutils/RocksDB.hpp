@@ -12,6 +12,21 @@
 #include "rocksdb/db.h"
 
 namespace sbutils {
+    // The version of the record format of a database. Increase it whenever the
+    // serialization of stored records such as FileInfo changes.
+    constexpr int DatabaseFormat = 2;
+
+    namespace detail {
+        // Return true if a database is empty or uses the current record format.
+        inline bool is_current_format(rocksdb::DB &db) {
+            std::string value;
+            if (db.Get(rocksdb::ReadOptions(), Resources::FormatKey, &value).ok()) {
+                return value == std::to_string(DatabaseFormat);
+            }
+            return !db.Get(rocksdb::ReadOptions(), Resources::VIDKey, &value).ok();
+        }
+    } // namespace detail
+
     template <typename T> rocksdb::DB *open(const std::string &database, T &&options) {
         rocksdb::DB *db = nullptr;
         rocksdb::Status status = rocksdb::DB::Open(std::forward<T>(options), database, &db);
@@ -21,19 +36,39 @@ namespace sbutils {
         return db;
     }
 
+    // Open a database and throw if its records cannot be read by this version.
     rocksdb::DB *open(const std::string &database) {
         rocksdb::Options options;
         options.create_if_missing = true;
-        return open(database, options);
+        std::unique_ptr<rocksdb::DB> db(open(database, options));
+        if (!detail::is_current_format(*db)) {
+            throw std::runtime_error("The database " + database +
+                                     " uses an old format. Please rebuild it with mupdatedb.");
+        }
+        return db.release();
     }
 
     template <typename T> void writeToRocksDB(const std::string &database, const T &results) {
-        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database, options));
         rocksdb::Status s;
 
         // Write all data using batch mode.
         rocksdb::WriteBatch batch;
 
+        // Records of an old format cannot be read so all of them are removed.
+        // Only the settings of the content index are kept.
+        if (!detail::is_current_format(*db)) {
+            std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(rocksdb::ReadOptions()));
+            for (it->SeekToFirst(); it->Valid(); it->Next()) {
+                if (it->key().ToString() != Resources::ContentExtensionKey) {
+                    batch.Delete(it->key());
+                }
+            }
+        }
+        batch.Put(Resources::FormatKey, std::to_string(DatabaseFormat));
+
         std::ostringstream os;
 
         // Write out all file information
@@ -46,6 +81,16 @@ namespace sbutils {
         serialize<sbutils::DefaultOArchive>(results.Graph, os);
         batch.Put(sbutils::Resources::GraphKey, os.str());
 
+        // Write out interned file extensions
+        os.str(std::string());
+        serialize<sbutils::DefaultOArchive>(results.Extensions, os);
+        batch.Put(sbutils::Resources::ExtensionKey, os.str());
+
+        // Write out vertex summaries
+        os.str(std::string());
+        serialize<sbutils::DefaultOArchive>(results.Summaries, os);
+        batch.Put(sbutils::Resources::SummaryKey, os.str());
+
         // Write out vertex information
         auto const &vertexes = results.Vertexes;
         os.str(std::string());
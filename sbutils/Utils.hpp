@@ -1,13 +1,17 @@
 #pragma once
 
+#include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <tuple>
 #include <type_traits>
+#include <unordered_set>
 #include <utility>
 
 #include "DataStructures.hpp"
+#include "FileCopy.hpp"
 #include "Timer.hpp"
 #include "boost/algorithm/searching/knuth_morris_pratt.hpp"
 
@@ -46,34 +50,105 @@ namespace sbutils {
 
     template <typename Container> class ExtFilter {
       public:
-		ExtFilter(const Container &exts) : Extensions(exts) {};
-		
+        ExtFilter(const Container &exts) : Extensions(exts.begin(), exts.end()) {}
+
         bool isValid(const FileInfo &info) const {
             if (Extensions.empty()) {
                 return true;
             }
-            return (std::find(Extensions.begin(), Extensions.end(),
-                              info.Extension) != Extensions.end());
+            return Extensions.find(info.Extension) != Extensions.end();
         }
 
       private:
-        Container Extensions;
+        std::unordered_set<std::string> Extensions;
+    };
+
+    // Filter files using their interned extension ids. Each check is a
+    // single bit test instead of string comparisons.
+    class ExtIdFilter {
+      public:
+        template <typename Container>
+        ExtIdFilter(const Container &exts, const StringTable &table)
+            : Bits((table.size() + 63) / 64, 0), IsEmpty(exts.empty()) {
+            for (auto const &anExt : exts) {
+                const auto id = table.find(anExt);
+                if (id != StringTable::NotFound) {
+                    Bits[id >> 6] |= (std::uint64_t(1) << (id & 63));
+                    SummaryBits |= VertexSummary::extBit(id);
+                }
+            }
+        }
+
+        bool isValid(const FileInfo &info) const { return isValidId(info.ExtId); }
+
+        bool isValidId(const StringTable::id_type id) const {
+            if (IsEmpty) {
+                return true;
+            }
+            return ((id >> 6) < Bits.size()) && ((Bits[id >> 6] >> (id & 63)) & 1);
+        }
+
+        // Return false if a vertex cannot have any file with given extensions.
+        bool isValid(const VertexSummary &summary) const {
+            return IsEmpty || ((summary.ExtBits & SummaryBits) != 0);
+        }
+
+        bool empty() const { return IsEmpty; }
+
+      private:
+        std::vector<std::uint64_t> Bits;
+        std::uint64_t SummaryBits = 0;
+        bool IsEmpty;
+    };
+
+    // Range constraints for file sizes, modification times, and permissions.
+    class AttributeFilter {
+      public:
+        AttributeFilter()
+            : MinSize(0), MaxSize(std::numeric_limits<uintmax_t>::max()),
+              NewerThan(std::numeric_limits<std::time_t>::min()), Permissions(0) {}
+
+        bool isValid(const FileInfo &info) const {
+            return isValid(info.Size, info.TimeStamp, info.Permissions);
+        }
+
+        bool isValid(const uintmax_t size, const std::time_t timeStamp, const int perms) const {
+            return (size >= MinSize) && (size <= MaxSize) && (timeStamp >= NewerThan) &&
+                   ((perms & Permissions) == Permissions);
+        }
+
+        // Return false if none of the files of a vertex can satisfy given
+        // constraints.
+        bool isValid(const VertexSummary &summary) const {
+            return (summary.NumberOfFiles > 0) && (summary.MaxSize >= MinSize) &&
+                   (summary.MinSize <= MaxSize) && (summary.MaxTime >= NewerThan) &&
+                   ((summary.Permissions & Permissions) == Permissions);
+        }
+
+        bool empty() const {
+            return (MinSize == 0) && (MaxSize == std::numeric_limits<uintmax_t>::max()) &&
+                   (NewerThan == std::numeric_limits<std::time_t>::min()) && (Permissions == 0);
+        }
+
+        uintmax_t MinSize;
+        uintmax_t MaxSize;
+        std::time_t NewerThan;
+        int Permissions; // All of these permission bits must be set.
     };
 
     template <typename Container> class StemFilter {
       public:
-        explicit StemFilter(Container &stems) : Stems(stems) {}
+        explicit StemFilter(const Container &stems) : Stems(stems.begin(), stems.end()) {}
 
         bool isValid(const FileInfo &info) const {
             if (Stems.empty()) {
                 return true;
             }
-            return (std::find(Stems.begin(), Stems.end(), info.Stem) !=
-                    Stems.end());
+            return Stems.find(info.Stem) != Stems.end();
         }
 
       private:
-        std::vector<std::string> Stems;
+        std::unordered_set<std::string> Stems;
     };
 
     class SimpleFilter {
@@ -130,30 +205,16 @@ namespace sbutils {
         std::for_each(files.begin(), files.end(), createParentObj);
     }
 
-    bool copyAFile(const boost::filesystem::path dstDir,
-                   const sbutils::FileInfo &info, const bool verbose) {
-        using namespace boost::filesystem;
-        const auto options = copy_option::overwrite_if_exists;
-        auto srcFile = path(info.Path);
-        auto dstFile = dstDir / srcFile;
-        bool needCopy = true;
-        if (exists(dstFile)) {
-            // TODO: We do not copy a given file if the source and destination
-            // have the same sizes. How can we make this algorithm better?
-            needCopy &= (file_size(srcFile) != file_size(dstFile));
-            if (needCopy) {
-                permissions(dstFile, add_perms | owner_write);
-            }
-        }
-
-        if (needCopy) {
-            copy_file(srcFile, dstFile, options);
-            if (verbose) {
-                fmt::print("Copy {0} to {1}\n", srcFile.string(),
-                           dstFile.string());
-            }
+    // Copy a file to dstDir unless the copy is up to date. See copy_file.
+    bool copyAFile(const boost::filesystem::path &dstDir, const sbutils::FileInfo &info,
+                   const bool verbose) {
+        thread_local std::string buffer;
+        const std::string dstFile = (dstDir / boost::filesystem::path(info.Path)).string();
+        const CopyMethod method = copy_file(info.Path, dstFile, buffer);
+        if (verbose && (method != CopyMethod::None)) {
+            fmt::print("Copy {0} to {1} using {2}\n", info.Path, dstFile, to_string(method));
         }
-        return needCopy;
+        return method != CopyMethod::None;
     }
 
     bool deleteAFile(const boost::filesystem::path &parent,
@@ -1,18 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <type_traits>
 
 #include "DataStructures.hpp"
+#include "DeltaCopy.hpp"
 #include "Timer.hpp"
 #include "Utils.hpp"
 #include "boost/algorithm/searching/knuth_morris_pratt.hpp"
 
 #include "tbb/parallel_invoke.h"
+#include "tbb/task_scheduler_init.h"
 #include "tbb/tbb.h"
 
 namespace sbutils {
@@ -37,45 +46,399 @@ namespace sbutils {
         return results;
     }
 
-    class CopyFiles {
+    /**
+     * Filter data in parallel and pass the matched items of each chunk to a
+     * consumer as soon as the chunk has been filtered. The consumer gets a
+     * vector of pointers to matched items and returns false to stop the scan.
+     * Chunks are processed concurrently so the consumer must be thread-safe.
+     */
+    template <typename Container, typename Consumer, typename FirstConstraint,
+              typename... Constraints>
+    void filter_stream_tbb(const Container &data, Consumer &&consumer, FirstConstraint &&f1,
+                           Constraints &&... fs) {
+        using value_type = typename std::decay<Container>::type::value_type;
+        tbb::task_group_context context;
+        auto filterObj = [&](const tbb::blocked_range<size_t> &r) {
+            std::vector<const value_type *> matches;
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                auto const &item = data[idx];
+                if (isValid(item, f1, fs...)) {
+                    matches.push_back(&item);
+                }
+            }
+            if (!matches.empty() && !consumer(matches)) {
+                context.cancel_group_execution();
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, data.size(), 1024), filterObj,
+                          tbb::auto_partitioner(), context);
+    }
+
+    // Count items that satisfy given constraints without copying them.
+    template <typename Container, typename FirstConstraint, typename... Constraints>
+    size_t count_tbb(const Container &data, FirstConstraint &&f1, Constraints &&... fs) {
+        auto countObj = [&](const tbb::blocked_range<size_t> &r, size_t counter) {
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                counter += isValid(data[idx], f1, fs...);
+            }
+            return counter;
+        };
+        return tbb::parallel_reduce(tbb::blocked_range<size_t>(0, data.size(), 4096),
+                                    size_t(0), countObj, std::plus<size_t>());
+    }
+
+    /**
+     * Copy files in parallel using a size-aware schedule. A file that is
+     * larger than largeFileSize is split into chunks of chunkSize bytes
+     * which are copied concurrently at their offsets, unless it can be
+     * cloned, and small files are batched so each task has enough work to
+     * amortize its overhead. Tasks are run largest first so a huge file
+     * never starts last and bounds the total copy time. Chunks of a large
+     * file are run one after another, and the file is opened when its first
+     * chunk starts and closed when its last chunk completes, so only the
+     * files that are being copied hold descriptors and an aborted copy
+     * leaves other destinations untouched. See FileCopy for the files that
+     * are skipped.
+     */
+    class CopyScheduler {
       public:
         using path = boost::filesystem::path;
+        enum : uintmax_t {
+            LargeFileSize = 64 << 20,
+            ChunkSize = 16 << 20,
+            BatchSize = 4 << 20,
+            MaxFilesPerBatch = 64
+        };
+
+        CopyScheduler(const path &dstDir, const std::vector<FileInfo> &files, bool verbose,
+                      const uintmax_t largeFileSize = LargeFileSize,
+                      const uintmax_t chunkSize = ChunkSize)
+            : DstDir(dstDir), Files(files), Verbose(verbose),
+              LargeThreshold(largeFileSize), ChunkBytes(std::max<uintmax_t>(chunkSize, 1)),
+              LargeFiles(), Tasks(), NumberOfCopiedFiles(0), NumberOfCopiedBytes(0) {}
+
+        // Copy all files and return the number of copied files and bytes.
+        std::tuple<size_t, size_t> run() {
+            plan();
+            std::atomic<size_t> next(0);
+            auto workerObj = [this, &next](const size_t) {
+                std::string buffer;
+                for (size_t idx = next++; idx < Tasks.size(); idx = next++) {
+                    execute(Tasks[idx], buffer);
+                }
+            };
+            const size_t numberOfWorkers = std::min<size_t>(
+                Tasks.size(), tbb::task_scheduler_init::default_num_threads());
+            tbb::parallel_for(size_t(0), numberOfWorkers, size_t(1), workerObj);
+            return std::make_tuple(NumberOfCopiedFiles.load(), NumberOfCopiedBytes.load());
+        }
+
+      private:
+        // A large file that is copied in chunks. The first chunk that
+        // starts opens the file and the last chunk that completes finishes it.
+        struct LargeFile {
+            LargeFile(const FileInfo &info, const size_t chunks)
+                : Info(info), NumberOfChunks(chunks), Mutex(), IsOpened(false), Copy(),
+                  RemainingChunks(chunks) {}
+            const FileInfo &Info;
+            size_t NumberOfChunks;
+            std::mutex Mutex;
+            bool IsOpened;
+            std::unique_ptr<FileCopy> Copy; // Null if the file is up to date or cloned.
+            std::atomic<size_t> RemainingChunks;
+        };
+
+        // A range of sorted files, or a chunk of a large file.
+        struct Task {
+            uintmax_t Bytes;
+            size_t Begin;
+            size_t End;
+            LargeFile *Large;
+            off_t Offset;
+        };
+
         const path DstDir;
-        const std::vector<FileInfo> *Files;
+        const std::vector<FileInfo> &Files;
         bool Verbose;
-        size_t NumberOfCopiedFiles = 0;
-        size_t NumberOfCopiedBytes = 0;
-
-        CopyFiles(const path &dstDir, const std::vector<FileInfo> *files, bool verbose)
-            : DstDir(dstDir), Files(files), Verbose(verbose), NumberOfCopiedFiles(0),
-              NumberOfCopiedBytes(0) {}
-
-        void operator()(const tbb::blocked_range<size_t> &r) {
-            const size_t begin = r.begin();
-            const size_t end = r.end();
-            for (size_t idx = begin; idx != end; ++idx) {
-                const FileInfo info = (*Files)[idx];
-                if (copyAFile(DstDir, info, Verbose)) {
-                    NumberOfCopiedFiles++;
-                    NumberOfCopiedBytes += info.Size;
+        uintmax_t LargeThreshold;
+        uintmax_t ChunkBytes;
+        std::vector<size_t> Order; // Indexes of files from the largest to the smallest.
+        std::deque<LargeFile> LargeFiles;
+        std::vector<Task> Tasks;
+        std::atomic<size_t> NumberOfCopiedFiles;
+        std::atomic<size_t> NumberOfCopiedBytes;
+
+        std::string destination(const FileInfo &info) const {
+            return (DstDir / path(info.Path)).string();
+        }
+
+        void plan() {
+            Order.resize(Files.size());
+            std::iota(Order.begin(), Order.end(), 0);
+            std::sort(Order.begin(), Order.end(), [this](const size_t lhs, const size_t rhs) {
+                return Files[lhs].Size > Files[rhs].Size;
+            });
+
+            // All chunks of a large file have the same weight so they stay
+            // together when tasks are sorted.
+            size_t idx = 0;
+            for (; (idx < Order.size()) && (Files[Order[idx]].Size > LargeThreshold); ++idx) {
+                const FileInfo &info = Files[Order[idx]];
+                const size_t chunks = (info.Size + ChunkBytes - 1) / ChunkBytes;
+                LargeFiles.emplace_back(info, chunks);
+                const uintmax_t bytes = std::min<uintmax_t>(ChunkBytes, info.Size);
+                for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                    Tasks.push_back({bytes, 0, 0, &LargeFiles.back(),
+                                     static_cast<off_t>(chunk * ChunkBytes)});
                 }
             }
+
+            // Files are sorted so each batch has files of similar sizes.
+            while (idx < Order.size()) {
+                const size_t begin = idx;
+                uintmax_t bytes = 0;
+                do {
+                    bytes += Files[Order[idx]].Size;
+                    ++idx;
+                } while ((idx < Order.size()) && (bytes < BatchSize) &&
+                         (idx - begin < MaxFilesPerBatch));
+                Tasks.push_back({bytes, begin, idx, nullptr, 0});
+            }
+
+            std::stable_sort(Tasks.begin(), Tasks.end(), [](const Task &lhs, const Task &rhs) {
+                return lhs.Bytes > rhs.Bytes;
+            });
+        }
+
+        // Open a large file unless it is up to date, or clone it. Return
+        // null if there is nothing left to copy.
+        FileCopy *open(LargeFile &aFile) {
+            std::lock_guard<std::mutex> lock(aFile.Mutex);
+            if (aFile.IsOpened) {
+                return aFile.Copy.get();
+            }
+            aFile.IsOpened = true;
+            auto aCopy = std::make_unique<FileCopy>(aFile.Info.Path, destination(aFile.Info));
+            if (aCopy->empty()) {
+                return nullptr;
+            }
+            if (clone_content(aCopy->source(), aCopy->destination())) {
+                aCopy->finish();
+                ++NumberOfCopiedFiles;
+                NumberOfCopiedBytes += aCopy->size();
+                print(aFile.Info, CopyMethod::Clone);
+                return nullptr;
+            }
+            aFile.Copy = std::move(aCopy);
+            return aFile.Copy.get();
         }
 
-        CopyFiles(const CopyFiles &rhs, tbb::split)
-            : DstDir(rhs.DstDir), Files(rhs.Files), Verbose(rhs.Verbose) {}
+        void execute(const Task &aTask, std::string &buffer) {
+            if (aTask.Large != nullptr) {
+                LargeFile &aFile = *aTask.Large;
+                FileCopy *aCopy = open(aFile);
+                CopyMethod method = CopyMethod::None;
+                if (aCopy != nullptr) {
+                    const off_t end =
+                        std::min<off_t>(aTask.Offset + ChunkBytes, aCopy->size());
+                    method = copy_range(aCopy->source(), aCopy->destination(), aTask.Offset,
+                                        end, buffer);
+                }
+                if ((--aFile.RemainingChunks > 0) || (aCopy == nullptr)) {
+                    return;
+                }
 
-        void join(const CopyFiles &rhs) {
-            NumberOfCopiedFiles += rhs.NumberOfCopiedFiles;
-            NumberOfCopiedBytes += rhs.NumberOfCopiedBytes;
+                // A source that has grown since it was found is copied to its end.
+                const off_t planned = static_cast<off_t>(aFile.NumberOfChunks * ChunkBytes);
+                if (aCopy->size() > planned) {
+                    method = copy_range(aCopy->source(), aCopy->destination(), planned,
+                                        aCopy->size(), buffer);
+                }
+                aCopy->finish();
+                ++NumberOfCopiedFiles;
+                NumberOfCopiedBytes += aCopy->size();
+                if (Verbose) {
+                    fmt::print("Copy {0} using chunks and {1}\n", aCopy->path(),
+                               to_string(method));
+                }
+                aFile.Copy.reset();
+                return;
+            }
+            for (size_t idx = aTask.Begin; idx != aTask.End; ++idx) {
+                const FileInfo &info = Files[Order[idx]];
+                const CopyMethod method = copy_file(info.Path, destination(info), buffer);
+                if (method != CopyMethod::None) {
+                    ++NumberOfCopiedFiles;
+                    NumberOfCopiedBytes += info.Size;
+                    print(info, method);
+                }
+            }
+        }
+
+        void print(const FileInfo &info, const CopyMethod method) const {
+            if (Verbose) {
+                fmt::print("Copy {0} to {1} using {2}\n", info.Path, destination(info),
+                           to_string(method));
+            }
         }
     };
 
+    // Copy files to dstDir in parallel and return the number of copied files and bytes.
     auto copyFiles_tbb(const std::vector<FileInfo> &files,
                        const boost::filesystem::path &dstDir, bool verbose = false) {
+        CopyScheduler scheduler(dstDir, files, verbose);
+        return scheduler.run();
+    }
+
+    /**
+     * Update modified files in dstDir by writing only their changed ranges,
+     * see delta_copy, and return the number of updated files and the number
+     * of bytes that are written from the sources. Files are updated in
+     * parallel and the signatures of each file are computed in parallel.
+     */
+    auto copyFiles_delta(const std::vector<FileInfo> &files,
+                         const boost::filesystem::path &dstDir, bool verbose = false) {
+        std::atomic<size_t> nfiles(0), nbytes(0);
+        auto updateObj = [&](const tbb::blocked_range<size_t> &r) {
+            std::string buffer;
+            for (size_t idx = r.begin(); idx != r.end(); ++idx) {
+                auto const &info = files[idx];
+                const std::string dstFile =
+                    (dstDir / boost::filesystem::path(info.Path)).string();
+                const DeltaCopyResult result = delta_copy(info.Path, dstFile, buffer);
+                if (!result.IsDelta && (result.Method == CopyMethod::None)) {
+                    continue;
+                }
+                ++nfiles;
+                nbytes += result.WrittenBytes;
+                if (verbose && result.IsDelta) {
+                    fmt::print("Update {0} to {1} using {2} delta: wrote {3} of {4} bytes\n",
+                               info.Path, dstFile, result.IsInPlace ? "in-place" : "renamed",
+                               result.WrittenBytes, info.Size);
+                } else if (verbose) {
+                    fmt::print("Copy {0} to {1} using {2}\n", info.Path, dstFile,
+                               to_string(result.Method));
+                }
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, files.size(), 1), updateObj);
+        return std::make_tuple(nfiles.load(), nbytes.load());
+    }
+
+    namespace detail {
+        /**
+         * Copy the content of a source to several open destinations and read
+         * it once. Each chunk is written to all destinations concurrently
+         * before the next chunk is read. Throw std::runtime_error if a file
+         * cannot be read or written.
+         */
+        inline void fanout_content(const int in, const std::vector<FileCopy *> &copies,
+                                   const off_t size, std::string &buffer) {
+            if (buffer.size() < (4 << 20)) {
+                buffer.resize(4 << 20);
+            }
+#ifdef POSIX_FADV_SEQUENTIAL
+            ::posix_fadvise(in, 0, size, POSIX_FADV_SEQUENTIAL);
+#endif
+            off_t offset = 0;
+            while (offset < size) {
+                const size_t len = std::min<size_t>(buffer.size(), size - offset);
+                const ssize_t count = ::pread(in, &buffer[0], len, offset);
+                if ((count < 0) && (errno == EINTR)) {
+                    continue;
+                }
+                if (count < 0) {
+                    throw std::runtime_error(std::string("read: ") + std::strerror(errno));
+                }
+                if (count == 0) {
+                    return;
+                }
+                auto writeObj = [&](const size_t idx) {
+                    if (!write_fully(copies[idx]->destination(), buffer.data(), count,
+                                     offset)) {
+                        throw_copy_error("Cannot write", copies[idx]->path());
+                    }
+                };
+                tbb::parallel_for(size_t(0), copies.size(), writeObj);
+                offset += count;
+            }
+        }
+    } // namespace detail
+
+    /**
+     * Copy files to several destination folders and read each source file
+     * once, so syncing a folder to N sandboxes costs one read pass instead
+     * of N. Destinations that are up to date are skipped and a destination
+     * that can clone the source does so. A file that only has one stale
+     * destination is copied using copy_content. Files are copied in
+     * parallel from the largest to the smallest. Return the number of
+     * copied files and bytes for each destination folder.
+     */
+    inline std::vector<std::tuple<size_t, size_t>>
+    copyFiles_fanout(const std::vector<FileInfo> &files,
+                     const std::vector<std::string> &dstDirs, bool verbose = false) {
+        const size_t numberOfDestinations = dstDirs.size();
+        std::unique_ptr<std::atomic<size_t>[]> nfiles(
+            new std::atomic<size_t>[numberOfDestinations]()),
+            nbytes(new std::atomic<size_t>[numberOfDestinations]());
+        std::vector<size_t> order(files.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&files](size_t lhs, size_t rhs) {
+            return files[lhs].Size > files[rhs].Size;
+        });
 
-        CopyFiles copyObj(dstDir, &files, verbose);
-        tbb::parallel_reduce(tbb::blocked_range<size_t>(0, files.size()), copyObj);
-        return std::make_tuple(copyObj.NumberOfCopiedFiles, copyObj.NumberOfCopiedBytes);
+        auto copyObj = [&](const tbb::blocked_range<size_t> &r) {
+            std::string buffer;
+            for (size_t pos = r.begin(); pos != r.end(); ++pos) {
+                auto const &info = files[order[pos]];
+                std::vector<std::unique_ptr<FileCopy>> copies(numberOfDestinations);
+                std::vector<const char *> methods(numberOfDestinations, "clone");
+                std::vector<size_t> staleIds;
+                std::vector<FileCopy *> stale;
+                for (size_t idx = 0; idx < numberOfDestinations; ++idx) {
+                    const boost::filesystem::path dstFile =
+                        boost::filesystem::path(dstDirs[idx]) / info.Path;
+                    copies[idx].reset(new FileCopy(info.Path, dstFile.string()));
+                    if (copies[idx]->empty()) {
+                        copies[idx].reset();
+                    } else if (!clone_content(copies[idx]->source(),
+                                              copies[idx]->destination())) {
+                        staleIds.push_back(idx);
+                        stale.push_back(copies[idx].get());
+                    }
+                }
+                if (stale.size() == 1) {
+                    methods[staleIds.front()] =
+                        to_string(copy_content(stale.front()->source(),
+                                               stale.front()->destination(),
+                                               stale.front()->size(), buffer));
+                } else if (stale.size() > 1) {
+                    detail::fanout_content(stale.front()->source(), stale,
+                                           stale.front()->size(), buffer);
+                    for (auto const idx : staleIds) {
+                        methods[idx] = "fan-out";
+                    }
+                }
+                for (size_t idx = 0; idx < numberOfDestinations; ++idx) {
+                    if (!copies[idx]) {
+                        continue;
+                    }
+                    copies[idx]->finish();
+                    ++nfiles[idx];
+                    nbytes[idx] += info.Size;
+                    if (verbose) {
+                        fmt::print("Copy {0} to {1} using {2}\n", info.Path,
+                                   copies[idx]->path(), methods[idx]);
+                    }
+                }
+            }
+        };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, files.size(), 1), copyObj);
+
+        std::vector<std::tuple<size_t, size_t>> results;
+        for (size_t idx = 0; idx < numberOfDestinations; ++idx) {
+            results.emplace_back(nfiles[idx].load(), nbytes[idx].load());
+        }
+        return results;
     }
 }
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <istream>
+#include <stdexcept>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "DataStructures.hpp"
+
+namespace sbutils {
+    /**
+     * Write data to a file through a large user space buffer. Formatters
+     * append records to the buffer directly and the buffer is written using
+     * a single fwrite call whenever it is full so the memory usage does not
+     * depend on the number of records.
+     */
+    class BufferedWriter {
+      public:
+        explicit BufferedWriter(const std::string &fileName, size_t capacity = 1 << 20)
+            : Output(std::fopen(fileName.c_str(), "wb")), Owned(true), Capacity(capacity),
+              Buffer() {
+            if (Output == nullptr) {
+                throw std::runtime_error("Cannot open \"" + fileName + "\" for writing");
+            }
+            init();
+        }
+
+        explicit BufferedWriter(std::FILE *output, size_t capacity = 1 << 20)
+            : Output(output), Owned(false), Capacity(capacity), Buffer() {
+            init();
+        }
+
+        BufferedWriter(const BufferedWriter &) = delete;
+        BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+        ~BufferedWriter() {
+            try {
+                flush();
+            } catch (std::exception &) {
+                // Destructors cannot report errors.
+            }
+            if (Owned) {
+                std::fclose(Output);
+            }
+        }
+
+        // The buffer that formatters append to. Call commit after appending.
+        std::string &buffer() { return Buffer; }
+
+        void commit() {
+            if (Buffer.size() >= Capacity) {
+                flush();
+            }
+        }
+
+        void write(const char *data, const size_t len) {
+            Buffer.append(data, len);
+            commit();
+        }
+
+        void write(const std::string &data) { write(data.data(), data.size()); }
+
+        void flush() {
+            if (!Buffer.empty() &&
+                (std::fwrite(Buffer.data(), 1, Buffer.size(), Output) != Buffer.size())) {
+                throw std::runtime_error("Cannot write data to the output file");
+            }
+            Buffer.clear();
+            std::fflush(Output);
+        }
+
+      private:
+        std::FILE *Output;
+        bool Owned;
+        size_t Capacity;
+        std::string Buffer;
+
+        void init() {
+            // Records are appended one at a time so keep some headroom.
+            Buffer.reserve(Capacity + 4096);
+            if (Owned) {
+                std::setvbuf(Output, nullptr, _IONBF, 0);
+            }
+        }
+    };
+
+    namespace detail {
+        // Return the position of the first character that must be escaped in
+        // a JSON string or end if there is not any.
+        inline const char *find_json_special(const char *begin, const char *end) {
+            const char *ptr = begin;
+#ifdef __SSE2__
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control = _mm_set1_epi8(0x1F);
+            for (; ptr + 16 <= end; ptr += 16) {
+                const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+                // Unsigned data <= 0x1F iff max(data, 0x1F) == 0x1F.
+                const __m128i isControl = _mm_cmpeq_epi8(_mm_max_epu8(data, control), control);
+                const __m128i isSpecial =
+                    _mm_or_si128(isControl, _mm_or_si128(_mm_cmpeq_epi8(data, quote),
+                                                         _mm_cmpeq_epi8(data, backslash)));
+                const int mask = _mm_movemask_epi8(isSpecial);
+                if (mask != 0) {
+                    return ptr + __builtin_ctz(static_cast<unsigned int>(mask));
+                }
+            }
+#endif
+            for (; ptr != end; ++ptr) {
+                const unsigned char c = static_cast<unsigned char>(*ptr);
+                if ((c < 0x20) || (c == '"') || (c == '\\')) {
+                    return ptr;
+                }
+            }
+            return end;
+        }
+
+        /**
+         * Append a quoted JSON string. Runs of characters that do not need
+         * escaping are copied at once. Bytes are copied as they are so paths
+         * are expected to be UTF-8.
+         */
+        inline void append_json_string(std::string &buffer, const std::string &value) {
+            static const char *Hex = "0123456789abcdef";
+            buffer.push_back('"');
+            const char *ptr = value.data();
+            const char *end = ptr + value.size();
+            while (true) {
+                const char *pos = find_json_special(ptr, end);
+                buffer.append(ptr, pos);
+                if (pos == end) {
+                    break;
+                }
+                const unsigned char c = static_cast<unsigned char>(*pos);
+                switch (c) {
+                case '"':
+                    buffer.append("\\\"");
+                    break;
+                case '\\':
+                    buffer.append("\\\\");
+                    break;
+                case '\n':
+                    buffer.append("\\n");
+                    break;
+                case '\r':
+                    buffer.append("\\r");
+                    break;
+                case '\t':
+                    buffer.append("\\t");
+                    break;
+                default:
+                    buffer.append("\\u00");
+                    buffer.push_back(Hex[c >> 4]);
+                    buffer.push_back(Hex[c & 0xF]);
+                }
+                ptr = pos + 1;
+            }
+            buffer.push_back('"');
+        }
+
+        inline void append_varint(std::string &buffer, std::uint64_t value) {
+            while (value >= 0x80) {
+                buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            buffer.push_back(static_cast<char>(value));
+        }
+
+        inline bool read_varint(std::istream &input, std::uint64_t &value) {
+            value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                const int c = input.get();
+                if (c == std::char_traits<char>::eof()) {
+                    return false;
+                }
+                value |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+                if ((c & 0x80) == 0) {
+                    return true;
+                }
+            }
+            throw std::runtime_error("Invalid variable length integer");
+        }
+
+        inline std::uint64_t zigzag_encode(const std::int64_t value) {
+            return (static_cast<std::uint64_t>(value) << 1) ^
+                   static_cast<std::uint64_t>(value >> 63);
+        }
+
+        inline std::int64_t zigzag_decode(const std::uint64_t value) {
+            return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+        }
+    } // namespace detail
+
+    /**
+     * Format each file as a JSON object on its own line i.e JSON Lines.
+     */
+    struct JSONLinesFormat {
+        static void header(std::string &) {}
+
+        static void append(std::string &buffer, const FileInfo &info) {
+            buffer.append("{\"path\":");
+            detail::append_json_string(buffer, info.Path);
+            buffer.append(",\"stem\":");
+            detail::append_json_string(buffer, info.Stem);
+            buffer.append(",\"extension\":");
+            detail::append_json_string(buffer, info.Extension);
+            buffer.append(",\"size\":");
+            buffer.append(std::to_string(info.Size));
+            buffer.append(",\"permissions\":");
+            buffer.append(std::to_string(info.Permissions));
+            buffer.append(",\"timestamp\":");
+            buffer.append(std::to_string(info.TimeStamp));
+            buffer.append("}\n");
+        }
+    };
+
+    /**
+     * A compact binary format. The file starts with a magic string and each
+     * record has the path, stem and extension sizes, permissions, file size,
+     * and time stamp as variable length integers followed by the path. The
+     * stem and the extension are the tail of the path so they are not
+     * stored.
+     */
+    struct BinaryFormat {
+        static const char *magic() { return "SBFI\x01"; }
+
+        static void header(std::string &buffer) { buffer.append(magic(), 5); }
+
+        static void append(std::string &buffer, const FileInfo &info) {
+            detail::append_varint(buffer, info.Path.size());
+            detail::append_varint(buffer, info.Stem.size());
+            detail::append_varint(buffer, info.Extension.size());
+            detail::append_varint(buffer, static_cast<std::uint64_t>(info.Permissions));
+            detail::append_varint(buffer, info.Size);
+            detail::append_varint(buffer, detail::zigzag_encode(info.TimeStamp));
+            buffer.append(info.Path);
+        }
+
+        static void check_header(std::istream &input) {
+            char header[5];
+            if (!input.read(header, 5) || (std::memcmp(header, magic(), 5) != 0)) {
+                throw std::runtime_error("Invalid binary file information header");
+            }
+        }
+
+        // Read the next record. Return false at the end of the input.
+        static bool read(std::istream &input, FileInfo &info) {
+            std::uint64_t pathSize, stemSize, extSize, perms, size, timeStamp;
+            if (!detail::read_varint(input, pathSize)) {
+                return false;
+            }
+            if (!detail::read_varint(input, stemSize) || !detail::read_varint(input, extSize) ||
+                !detail::read_varint(input, perms) || !detail::read_varint(input, size) ||
+                !detail::read_varint(input, timeStamp) || (stemSize + extSize > pathSize)) {
+                throw std::runtime_error("Truncated binary file information record");
+            }
+            info.Path.resize(pathSize);
+            if ((pathSize > 0) && !input.read(&info.Path[0], pathSize)) {
+                throw std::runtime_error("Truncated binary file information record");
+            }
+            info.Stem = info.Path.substr(pathSize - stemSize - extSize, stemSize);
+            info.Extension = info.Path.substr(pathSize - extSize);
+            info.Permissions = static_cast<int>(perms);
+            info.Size = size;
+            info.TimeStamp = static_cast<std::time_t>(detail::zigzag_decode(timeStamp));
+            return true;
+        }
+    };
+} // namespace sbutils
@@ -1,8 +1,22 @@
 #pragma once
 
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "sbutils/DataStructures.hpp"
 #include "sbutils/TemporaryDirectory.hpp"
 
 namespace {
+    // Create the information of a file that does not have to exist.
+    inline sbutils::FileInfo createFileInfo(const std::string &aPath, uintmax_t size = 0,
+                                            std::time_t timeStamp = 0, int perms = 0644) {
+        const boost::filesystem::path p(aPath);
+        return sbutils::FileInfo(perms, size, aPath, p.stem().string(), p.extension().string(),
+                                 timeStamp);
+    }
+
     class TestData {
       public:
         using path = boost::filesystem::path;
@@ -0,0 +1,61 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "gtest/gtest.h"
+#include <fstream>
+#include <string>
+
+#include "boost/filesystem.hpp"
+
+#include "sbutils/AsciiUtils.hpp"
+#include "sbutils/ContentSearch.hpp"
+
+TEST(AsciiFind, Positive) {
+    const std::string data = std::string(100, 'a') + "needle" + std::string(10, 'b');
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    EXPECT_EQ(sbutils::ascii::find(begin, end, "needle") - begin, 100);
+    EXPECT_EQ(sbutils::ascii::find(begin, end, "a") - begin, 0);
+    EXPECT_EQ(sbutils::ascii::find(begin, end, "bbb") - begin, 106);
+    EXPECT_EQ(sbutils::ascii::find(begin, end, "Needle"), end);
+    EXPECT_EQ(sbutils::ascii::find(begin, end, "needlex"), end);
+}
+
+TEST(ContentSearcher, Positive) {
+    const std::string data = "int main() {\n    return Foo();\n}\n// foo bar foo\n";
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+
+    std::string output;
+    EXPECT_EQ(sbutils::ContentSearcher("foo", false).search("a.cpp", begin, end, output), 1u);
+    EXPECT_EQ(output, "a.cpp:4:// foo bar foo\n");
+
+    output.clear();
+    EXPECT_EQ(sbutils::ContentSearcher("FOO", true).search("a.cpp", begin, end, output), 2u);
+    EXPECT_EQ(output, "a.cpp:2:    return Foo();\na.cpp:4:// foo bar foo\n");
+
+    output.clear();
+    EXPECT_EQ(sbutils::ContentSearcher("foo", true, true).search("a.cpp", begin, end, output),
+              1u);
+    EXPECT_EQ(output, "a.cpp\n");
+}
+
+TEST(FileContent, Positive) {
+    const auto aFile = boost::filesystem::temp_directory_path() /
+                       boost::filesystem::unique_path("%%%%-%%%%-%%%%.txt");
+    const std::string data(3 * sbutils::FileContent::MinMappedSize, 'x');
+    std::ofstream(aFile.string()) << data << '\0';
+
+    std::string buffer;
+    {
+        const sbutils::FileContent content(aFile.string(), buffer);
+        ASSERT_TRUE(content.isValid());
+        EXPECT_EQ(content.size(), data.size() + 1);
+        EXPECT_TRUE(buffer.empty()); // Large files are memory mapped.
+        EXPECT_FALSE(sbutils::is_binary(content.begin(), content.end()));
+    }
+    boost::filesystem::remove(aFile);
+
+    const std::string binary("abc\0def", 7);
+    EXPECT_TRUE(sbutils::is_binary(binary.data(), binary.data() + binary.size()));
+    EXPECT_FALSE(sbutils::FileContent("/this/file/does/not/exist", buffer).isValid());
+}
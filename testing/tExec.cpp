@@ -0,0 +1,100 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sbutils/Exec.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+    std::vector<std::string> split_lines(const std::string &text) {
+        std::vector<std::string> results;
+        std::istringstream is(text);
+        std::string line;
+        while (std::getline(is, line)) {
+            results.emplace_back(line);
+        }
+        return results;
+    }
+} // namespace
+
+TEST(CommandExecutor, Placeholder) {
+    testing::internal::CaptureStdout();
+    {
+        sbutils::CommandExecutor executor("echo begin {} end", false, 1);
+        executor.push("/a");
+        executor.push("/b");
+        EXPECT_EQ(0u, executor.finish());
+    }
+    const std::vector<std::string> expected = {"begin /a end", "begin /b end"};
+    EXPECT_EQ(expected, split_lines(testing::internal::GetCapturedStdout()));
+
+    // Paths are appended if the command does not have any placeholder.
+    testing::internal::CaptureStdout();
+    {
+        sbutils::CommandExecutor executor("echo -n", true, 1);
+        executor.push("/a");
+        executor.push("/b");
+        EXPECT_EQ(0u, executor.finish());
+    }
+    EXPECT_EQ("/a /b", testing::internal::GetCapturedStdout());
+
+    EXPECT_THROW(sbutils::CommandExecutor(" ", false, 1), std::runtime_error);
+}
+
+TEST(CommandExecutor, Batch) {
+    const size_t budget = sbutils::detail::argument_budget();
+    const size_t numberOfPaths = 2000;
+    std::vector<std::string> paths;
+    for (size_t idx = 0; idx < numberOfPaths; ++idx) {
+        paths.emplace_back("/" + std::string(200, 'a') + std::to_string(idx));
+    }
+
+    testing::internal::CaptureStdout();
+    {
+        sbutils::CommandExecutor executor("echo", true, 2);
+        for (auto const &aPath : paths) {
+            executor.push(aPath);
+        }
+        EXPECT_EQ(0u, executor.finish());
+    }
+    const auto lines = split_lines(testing::internal::GetCapturedStdout());
+
+    // The paths do not fit in a single command so they are split into
+    // several commands and every command fits in the argument budget.
+    EXPECT_GT(lines.size(), 1u);
+    std::vector<std::string> results;
+    for (auto const &aLine : lines) {
+        size_t size = sbutils::detail::argument_size("echo");
+        std::istringstream is(aLine);
+        std::string arg;
+        while (is >> arg) {
+            size += sbutils::detail::argument_size(arg);
+            results.emplace_back(arg);
+        }
+        EXPECT_LE(size, budget);
+    }
+    std::sort(results.begin(), results.end());
+    std::sort(paths.begin(), paths.end());
+    EXPECT_EQ(paths, results);
+}
+
+TEST(CommandExecutor, Failures) {
+    testing::internal::CaptureStdout();
+    sbutils::CommandExecutor executor("false {}", false, 2);
+    executor.push("/a");
+    executor.push("/b");
+    executor.push("/c");
+    EXPECT_EQ(3u, executor.finish());
+    EXPECT_EQ(3u, executor.finish());
+    testing::internal::GetCapturedStdout();
+
+    testing::internal::CaptureStdout();
+    sbutils::CommandExecutor batchExecutor("false", true, 2);
+    batchExecutor.push("/a");
+    batchExecutor.push("/b");
+    EXPECT_EQ(1u, batchExecutor.finish());
+    testing::internal::GetCapturedStdout();
+}
@@ -2,9 +2,11 @@
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 #include "boost/filesystem.hpp"
 #include "gtest/gtest.h"
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -56,3 +58,67 @@ TEST(FileSearch, Positive) {
     test_file_search<sbutils::filesystem::DoNothingPolicy, 13>(tmpPath);
     test_file_search<sbutils::filesystem::NormalPolicy, 12>(tmpPath);
 }
+
+namespace {
+    // Return the sorted paths of the files that dfs_file_search finds.
+    template <typename FileFilter>
+    std::vector<std::string> dfs_file_paths(const boost::filesystem::path &aFolder,
+                                            const FileFilter &fileFilter) {
+        using Container = std::vector<boost::filesystem::path>;
+        sbutils::filesystem::Visitor<Container, sbutils::filesystem::NormalPolicy> visitor;
+        sbutils::filesystem::dfs_file_search(Container{aFolder}, visitor);
+        std::vector<std::string> results;
+        for (auto const &info : visitor.getFolderHierarchy<unsigned int>().AllFiles) {
+            if (fileFilter.isValid(info)) {
+                results.push_back(info.Path);
+            }
+        }
+        std::sort(results.begin(), results.end());
+        return results;
+    }
+
+    // Return the sorted paths of the files that parallel_file_search streams.
+    template <typename FileFilter>
+    std::vector<std::string> streamed_file_paths(const boost::filesystem::path &aFolder,
+                                                 const FileFilter &fileFilter) {
+        std::vector<std::string> results;
+        std::mutex aMutex;
+        auto consumer = [&](const std::vector<sbutils::FileInfo> &files) {
+            std::lock_guard<std::mutex> lock(aMutex);
+            for (auto const &info : files) {
+                results.push_back(info.Path);
+            }
+        };
+        using Visitor = sbutils::filesystem::StreamVisitor<sbutils::filesystem::NormalPolicy,
+                                                           FileFilter, decltype(consumer)>;
+        const Visitor visitor(fileFilter, consumer);
+        sbutils::filesystem::parallel_file_search(std::vector<std::string>{aFolder.string()},
+                                                  visitor);
+        std::sort(results.begin(), results.end());
+        return results;
+    }
+
+    struct AllFiles {
+        bool isValid(const sbutils::FileInfo &) const { return true; }
+    };
+
+    struct CppFiles {
+        bool isValid(const sbutils::FileInfo &info) const { return info.Extension == ".cpp"; }
+    };
+} // namespace
+
+TEST(ParallelFileSearch, Positive) {
+    sbutils::TemporaryDirectory tmpDir;
+    TestData testData(tmpDir.getPath());
+    auto const &tmpPath = tmpDir.getPath();
+
+    // Folders are filtered like dfs_file_search does and files are filtered while
+    // folders are visited.
+    auto const allFiles = dfs_file_paths(tmpPath, AllFiles());
+    EXPECT_EQ(allFiles.size(), 12u);
+    EXPECT_EQ(streamed_file_paths(tmpPath, AllFiles()), allFiles);
+
+    auto const cppFiles = dfs_file_paths(tmpPath, CppFiles());
+    EXPECT_EQ(cppFiles.size(), 3u);
+    EXPECT_EQ(streamed_file_paths(tmpPath, CppFiles()), cppFiles);
+}
@@ -0,0 +1,573 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "sbutils/CommandUtils.hpp"
+#include "sbutils/ContentIndex.hpp"
+#include "sbutils/FileSearch.hpp"
+#include "sbutils/FileTable.hpp"
+#include "sbutils/FolderDiff.hpp"
+#include "sbutils/Generations.hpp"
+#include "sbutils/RocksDB.hpp"
+#include "sbutils/TemporaryDirectory.hpp"
+
+namespace {
+    // Sorted vertex paths that have siblings whose names extend "/a/b".
+    const std::vector<std::string> VertexPaths = {"/a",     "/a/b",   "/a/b-c",   "/a/b-c/d",
+                                                  "/a/b.d", "/a/b/e", "/a/b/e/f", "/a/b0",
+                                                  "/a/c"};
+
+    using path = boost::filesystem::path;
+
+    // Write a file and set its modification time if a time stamp is given.
+    void write_text(const path &aFile, const std::string &content,
+                    const std::time_t timeStamp = 0) {
+        {
+            std::ofstream os(aFile.string());
+            os << content;
+        }
+        if (timeStamp != 0) {
+            boost::filesystem::last_write_time(aFile, timeStamp);
+        }
+    }
+
+    // Search a folder and write the result to a database like mupdatedb does.
+    auto update_database(const std::string &database, const path &aFolder) {
+        using Container = std::vector<path>;
+        sbutils::filesystem::Visitor<Container, sbutils::filesystem::NormalPolicy> visitor;
+        sbutils::filesystem::dfs_file_search(Container{aFolder}, visitor);
+        auto results = visitor.getFolderHierarchy<unsigned int>();
+        sbutils::writeToRocksDB(database, results);
+        return results;
+    }
+
+    // Return the sorted names of the files of selected vertexes of a table.
+    std::vector<std::string> file_names(const sbutils::VertexTable &table) {
+        std::vector<std::string> results;
+        std::mutex aMutex;
+        sbutils::read_vertexes_tbb(table, table.Selected,
+                                   [&](const std::vector<sbutils::FileInfo> &files) {
+                                       std::lock_guard<std::mutex> lock(aMutex);
+                                       for (auto const &info : files) {
+                                           results.push_back(info.Stem + info.Extension);
+                                       }
+                                       return true;
+                                   });
+        std::sort(results.begin(), results.end());
+        return results;
+    }
+
+    // Return the information of a file in the result of update_database.
+    template <typename Hierarchy>
+    sbutils::FileInfo find_file(const Hierarchy &results, const path &aFile) {
+        auto const &allFiles = results.AllFiles;
+        auto isMatched = [&aFile](auto const &info) { return info.Path == aFile.string(); };
+        auto const pos = std::find_if(allFiles.begin(), allFiles.end(), isMatched);
+        if (pos == allFiles.end()) {
+            throw std::runtime_error("Cannot find " + aFile.string());
+        }
+        return *pos;
+    }
+
+    // Collect the sorted paths of the differences that a diff reports.
+    struct DiffCollector {
+        void operator()(const std::vector<sbutils::FileInfo> &modifiedFiles,
+                        const std::vector<sbutils::FileInfo> &deletedFiles,
+                        const std::vector<sbutils::FileInfo> &newFiles) {
+            std::lock_guard<std::mutex> lock(Mutex);
+            append(modifiedFiles, Modified);
+            append(deletedFiles, Deleted);
+            append(newFiles, New);
+        }
+
+        static void append(const std::vector<sbutils::FileInfo> &files,
+                           std::vector<std::string> &paths) {
+            for (auto const &info : files) {
+                paths.insert(std::upper_bound(paths.begin(), paths.end(), info.Path),
+                             info.Path);
+            }
+        }
+
+        std::mutex Mutex;
+        std::vector<std::string> Modified;
+        std::vector<std::string> Deleted;
+        std::vector<std::string> New;
+    };
+
+    // Return the keys of a database that start with a given prefix.
+    std::set<std::string> find_keys(rocksdb::DB &db, const std::string &prefix) {
+        std::set<std::string> results;
+        std::unique_ptr<rocksdb::Iterator> it(db.NewIterator(rocksdb::ReadOptions()));
+        for (it->Seek(prefix); it->Valid(); it->Next()) {
+            const std::string aKey = it->key().ToString();
+            if (aKey.compare(0, prefix.size(), prefix) != 0) {
+                break;
+            }
+            results.insert(aKey);
+        }
+        return results;
+    }
+} // namespace
+
+TEST(DescendantRange, Positive) {
+    auto range = sbutils::descendant_range(VertexPaths.begin(), VertexPaths.end(), "/a/b");
+    EXPECT_EQ(std::distance(VertexPaths.begin(), range.first), 5);
+    EXPECT_EQ(std::distance(VertexPaths.begin(), range.second), 7);
+
+    range = sbutils::descendant_range(VertexPaths.begin(), VertexPaths.end(), "/a/c");
+    EXPECT_EQ(range.first, range.second);
+}
+
+TEST(SelectVertexes, Positive) {
+    const std::vector<sbutils::vertex_index_type> expected = {1, 5, 6};
+    EXPECT_EQ(sbutils::select_vertexes(VertexPaths, {"/a/b"}), expected);
+    EXPECT_EQ(sbutils::select_vertexes(VertexPaths, {"/a/b/"}), expected);
+    EXPECT_EQ(sbutils::select_vertexes(VertexPaths, {}).size(), VertexPaths.size());
+}
+
+TEST(FileTable, VertexRanges) {
+    sbutils::FileTable table;
+    table.VertexPaths = VertexPaths;
+    using Ranges = std::vector<std::pair<size_t, size_t>>;
+    EXPECT_EQ(table.vertexRanges({"/a/b"}), (Ranges{{1, 2}, {5, 7}}));
+    EXPECT_EQ(table.vertexRanges({"/a/b-c"}), (Ranges{{2, 4}}));
+
+    // Nested folders are merged and missing folders are ignored.
+    EXPECT_EQ(table.vertexRanges({"/a", "/a/b", "/x"}), (Ranges{{0, 9}}));
+    EXPECT_EQ(table.vertexRanges({}), (Ranges{{0, 9}}));
+}
+
+TEST(CompileBatch, Positive) {
+    sbutils::MLocateArgs args;
+    args.Expression = "ext:.cpp";
+    sbutils::StringTable extensions;
+    sbutils::FileInfo info;
+    info.Path = "/a/b/foo.cpp";
+    info.Stem = "foo";
+    info.Extension = ".cpp";
+    info.ExtId = extensions.intern(".cpp");
+    extensions.intern(".h");
+
+    auto queries =
+        sbutils::compile_batch(args, {{"1", "stem:foo"}, {"2", "ext:.h"}}, extensions);
+    ASSERT_EQ(queries.size(), 2u);
+    EXPECT_TRUE(queries[0].isValid(info));
+    EXPECT_FALSE(queries[1].isValid(info));
+
+    // A batch query with unbalanced parentheses cannot escape its group.
+    EXPECT_THROW(sbutils::compile_batch(args, {{"1", "ext:.h) or (ext:.cpp"}}, extensions),
+                 std::runtime_error);
+    EXPECT_THROW(sbutils::compile_batch(args, {{"1", "(ext:.h"}}, extensions),
+                 std::runtime_error);
+}
+
+TEST(HashKey, Positive) {
+    sbutils::FileInfo info;
+    info.Inode = 7;
+    info.Size = 100;
+    info.ModifiedTime = 1000;
+    info.ChangedTime = 2000;
+    const std::string aKey = sbutils::detail::hash_key(info);
+
+    // A file whose modification time was restored after an edit is a new version.
+    info.ChangedTime = 3000;
+    EXPECT_NE(aKey, sbutils::detail::hash_key(info));
+    info.ChangedTime = 2000;
+    EXPECT_EQ(aKey, sbutils::detail::hash_key(info));
+}
+
+TEST(Generations, ParseTime) {
+    using sbutils::generations::parse_time;
+    std::time_t day, minute, second;
+    ASSERT_TRUE(parse_time("2024-05-01", day));
+    ASSERT_TRUE(parse_time("2024-05-01 13:30", minute));
+    ASSERT_TRUE(parse_time("2024-05-01 13:30:15", second));
+    EXPECT_EQ(minute - day, 13 * 3600 + 30 * 60);
+    EXPECT_EQ(second - minute, 15);
+
+    std::time_t timeStamp;
+    EXPECT_FALSE(parse_time("", timeStamp));
+    EXPECT_FALSE(parse_time("13:30", timeStamp));
+    EXPECT_FALSE(parse_time("2024-05-01x", timeStamp));
+    EXPECT_FALSE(parse_time("yesterday", timeStamp));
+}
+
+TEST(Generations, FindGeneration) {
+    using sbutils::find_generation;
+    std::time_t timeStamp;
+    ASSERT_TRUE(sbutils::generations::parse_time("2024-05-01 13:30", timeStamp));
+    const std::vector<sbutils::Generation> generations = {
+        {3, timeStamp - 60, 1, 1}, {4, timeStamp, 1, 1}, {5, timeStamp + 60, 1, 1}};
+
+    // Generations are found using their ids.
+    EXPECT_EQ(find_generation(generations, "4").Id, 4u);
+    EXPECT_THROW(find_generation(generations, "2"), std::runtime_error);
+
+    // Or their positions relative to the latest generation.
+    EXPECT_EQ(find_generation(generations, "-0").Id, 5u);
+    EXPECT_EQ(find_generation(generations, "-2").Id, 3u);
+    EXPECT_THROW(find_generation(generations, "-3"), std::runtime_error);
+
+    // Or the latest generation that was saved at or before a given time.
+    EXPECT_EQ(find_generation(generations, "2024-05-01 13:30").Id, 4u);
+    EXPECT_EQ(find_generation(generations, "2024-05-01 13:29:59").Id, 3u);
+    EXPECT_EQ(find_generation(generations, "2024-05-02").Id, 5u);
+    EXPECT_THROW(find_generation(generations, "2024-05-01"), std::runtime_error);
+    EXPECT_THROW(find_generation(generations, "yesterday"), std::runtime_error);
+}
+
+TEST(Generations, SaveGeneration) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path dataFolder = tmpDir.getPath() / path("data");
+    const std::string database = (tmpDir.getPath() / path(".database")).string();
+    const std::string aFolder = (dataFolder / path("a")).string();
+    const std::string bFolder = (dataFolder / path("b")).string();
+    boost::filesystem::create_directories(aFolder);
+    boost::filesystem::create_directories(bFolder);
+    write_text(path(aFolder) / path("foo.cpp"), "foo");
+    write_text(path(bFolder) / path("bar.cpp"), "bar");
+
+    const size_t maxGenerations = 2;
+    auto save = [&]() {
+        auto const results = update_database(database, dataFolder);
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        return sbutils::save_generation(*db, results, maxGenerations);
+    };
+    auto read_manifest = [&](const std::uint64_t id) {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        sbutils::Manifest aManifest;
+        const std::string aKey = sbutils::generations::manifest_key(id);
+        EXPECT_TRUE(sbutils::read_value(*db, aKey, aManifest));
+        return aManifest;
+    };
+
+    // Each generation only changes one folder.
+    EXPECT_EQ(save(), 1u);
+    const auto first = read_manifest(1);
+    write_text(path(aFolder) / path("baz.cpp"), "baz");
+    EXPECT_EQ(save(), 2u);
+    const auto second = read_manifest(2);
+    write_text(path(bFolder) / path("qux.cpp"), "qux");
+    EXPECT_EQ(save(), 3u);
+    const auto third = read_manifest(3);
+
+    std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+    const auto generations = sbutils::read_generations(*db);
+    ASSERT_EQ(generations.size(), maxGenerations);
+    EXPECT_EQ(generations[0].Id, 2u);
+    EXPECT_EQ(generations[1].Id, 3u);
+    EXPECT_TRUE(find_keys(*db, sbutils::generations::manifest_key(1)).empty());
+
+    // Only blobs that are used by the kept generations are stored.
+    std::set<std::string> expected;
+    for (auto const hash : second.RecordHashes) {
+        expected.insert(sbutils::blob_key(hash));
+    }
+    for (auto const hash : third.RecordHashes) {
+        expected.insert(sbutils::blob_key(hash));
+    }
+    EXPECT_EQ(find_keys(*db, sbutils::Resources::BlobKey), expected);
+
+    // The record of folder b is shared by the first two generations so it is kept, but
+    // the record of folder a in the first generation is deleted.
+    auto const aVid = std::distance(
+        first.Vids.begin(), std::find(first.Vids.begin(), first.Vids.end(), aFolder));
+    auto const bVid = std::distance(
+        first.Vids.begin(), std::find(first.Vids.begin(), first.Vids.end(), bFolder));
+    EXPECT_EQ(first.RecordHashes[bVid], second.RecordHashes[bVid]);
+    EXPECT_EQ(expected.count(sbutils::blob_key(first.RecordHashes[aVid])), 0u);
+
+    // Removed generations cannot be opened and kept ones return their own files.
+    EXPECT_THROW(sbutils::open_vertex_table(*db, "1", {}), std::runtime_error);
+    auto const bTable = sbutils::open_vertex_table(*db, "-1", {bFolder});
+    EXPECT_TRUE(bTable.isGeneration());
+    EXPECT_EQ(file_names(bTable), (std::vector<std::string>{"bar.cpp"}));
+    EXPECT_EQ(file_names(sbutils::open_vertex_table(*db, "2", {})),
+              (std::vector<std::string>{"bar.cpp", "baz.cpp", "foo.cpp"}));
+    EXPECT_EQ(file_names(sbutils::open_vertex_table(*db, "", {bFolder})),
+              (std::vector<std::string>{"bar.cpp", "qux.cpp"}));
+}
+
+TEST(DiffDatabases, SkipIdenticalVertexes) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path dataFolder = tmpDir.getPath() / path("data");
+    const std::string firstDatabase = (tmpDir.getPath() / path(".first")).string();
+    const std::string secondDatabase = (tmpDir.getPath() / path(".second")).string();
+    const std::string xFolder = (dataFolder / path("x")).string();
+    const std::string yFolder = (dataFolder / path("y")).string();
+    boost::filesystem::create_directories(xFolder);
+    boost::filesystem::create_directories(yFolder);
+    write_text(path(xFolder) / path("changed.txt"), "aaa");
+    write_text(path(yFolder) / path("keep.txt"), "keep");
+    update_database(firstDatabase, dataFolder);
+    write_text(path(xFolder) / path("changed.txt"), "bbbb");
+    update_database(secondDatabase, dataFolder);
+
+    std::unique_ptr<rocksdb::DB> first(sbutils::open(firstDatabase));
+    std::unique_ptr<rocksdb::DB> second(sbutils::open(secondDatabase));
+
+    // Folder y is the same in both databases so its record is never read.
+    std::vector<std::string> vids;
+    ASSERT_TRUE(sbutils::read_value(*second, sbutils::Resources::VIDKey, vids));
+    auto const yVid = std::distance(vids.begin(), std::find(vids.begin(), vids.end(), yFolder));
+    ASSERT_LT(static_cast<size_t>(yVid), vids.size());
+    second->Delete(rocksdb::WriteOptions(), sbutils::to_fixed_string(9, yVid));
+
+    DiffCollector collector;
+    sbutils::diff_databases(*first, *second, {dataFolder.string()}, collector);
+    EXPECT_EQ(collector.Modified, (std::vector<std::string>{xFolder + "/changed.txt"}));
+    EXPECT_TRUE(collector.Deleted.empty());
+    EXPECT_TRUE(collector.New.empty());
+}
+
+TEST(DiffDatabases, OtherFolder) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path firstFolder = tmpDir.getPath() / path("first");
+    const path secondFolder = tmpDir.getPath() / path("second");
+    const std::string firstDatabase = (tmpDir.getPath() / path(".first")).string();
+    const std::string secondDatabase = (tmpDir.getPath() / path(".second")).string();
+
+    // Files that have the same sizes and modification times are the same.
+    const std::time_t timeStamp = 1500000000;
+    for (auto const &aFolder : {firstFolder, secondFolder}) {
+        boost::filesystem::create_directories(aFolder / path("x"));
+        boost::filesystem::create_directories(aFolder / path("y"));
+        write_text(aFolder / path("x") / path("same.txt"), "same", timeStamp);
+        write_text(aFolder / path("y") / path("keep.txt"), "keep", timeStamp);
+    }
+    write_text(firstFolder / path("x") / path("changed.txt"), "aaa", timeStamp);
+    write_text(secondFolder / path("x") / path("changed.txt"), "bbbb", timeStamp);
+    boost::filesystem::create_directories(firstFolder / path("z"));
+    write_text(firstFolder / path("z") / path("old.txt"), "old", timeStamp);
+    boost::filesystem::create_directories(secondFolder / path("w"));
+    write_text(secondFolder / path("w") / path("added.txt"), "added", timeStamp);
+    write_text(secondFolder / path("x") / path("new.txt"), "new", timeStamp);
+    update_database(firstDatabase, firstFolder);
+    update_database(secondDatabase, secondFolder);
+
+    // Paths of the second database are reported as paths of the first folder.
+    std::unique_ptr<rocksdb::DB> first(sbutils::open(firstDatabase));
+    std::unique_ptr<rocksdb::DB> second(sbutils::open(secondDatabase));
+    DiffCollector collector;
+    sbutils::diff_databases(*first, *second, {firstFolder.string()}, collector, false,
+                            secondFolder.string());
+    const std::string root = firstFolder.string();
+    EXPECT_EQ(collector.Modified, (std::vector<std::string>{root + "/x/changed.txt"}));
+    EXPECT_EQ(collector.Deleted, (std::vector<std::string>{root + "/z/old.txt"}));
+    EXPECT_EQ(collector.New,
+              (std::vector<std::string>{root + "/w/added.txt", root + "/x/new.txt"}));
+
+    // The other folder must be paired with exactly one folder.
+    EXPECT_THROW(sbutils::diff_databases(*first, *second, {root, root + "/x"}, collector,
+                                         false, secondFolder.string()),
+                 std::runtime_error);
+}
+
+TEST(ContentIndex, Trigrams) {
+    using sbutils::content::trigram_type;
+    auto pack = [](const char *value) {
+        return static_cast<trigram_type>((value[0] << 16) | (value[1] << 8) | value[2]);
+    };
+    const std::vector<trigram_type> expected = {pack("abc"), pack("bca"), pack("cab")};
+
+    // Trigrams are case folded, sorted, and distinct.
+    sbutils::content::TrigramExtractor extractor;
+    const std::string data = "abcABCab";
+    EXPECT_EQ(extractor(data.data(), data.data() + data.size()), expected);
+
+    // The extractor can be reused.
+    EXPECT_EQ(extractor(data.data(), data.data() + data.size()), expected);
+    EXPECT_TRUE(extractor(data.data(), data.data() + 2).empty());
+
+    EXPECT_EQ(sbutils::content::trigrams("ABCabca"), expected);
+    EXPECT_TRUE(sbutils::content::trigrams("ab").empty());
+}
+
+TEST(ContentIndex, UpdateContentIndex) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path dataFolder = tmpDir.getPath() / path("data");
+    const std::string database = (tmpDir.getPath() / path(".database")).string();
+    boost::filesystem::create_directories(dataFolder);
+    const path fooFile = dataFolder / path("foo.cpp");
+    const path barFile = dataFolder / path("bar.cpp");
+    const path textFile = dataFolder / path("notes.txt");
+    const path largeFile = dataFolder / path("large.cpp");
+    write_text(fooFile, "hello world");
+    write_text(barFile, "goodbye");
+    write_text(textFile, "hello");
+    write_text(largeFile, "hello " + std::string(100, 'x'));
+
+    // Only small files with given extensions are indexed.
+    const std::vector<std::string> extensions = {".cpp"};
+    const uintmax_t maxFileSize = 100;
+    auto update = [&]() {
+        auto const results = update_database(database, dataFolder);
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        return std::make_pair(
+            sbutils::update_content_index(*db, results.AllFiles, extensions, maxFileSize),
+            results);
+    };
+    auto result = update();
+    EXPECT_EQ(result.first, 2u);
+
+    // Unchanged files are not read again and a modified file is read again.
+    EXPECT_EQ(update().first, 0u);
+    write_text(barFile, "hello there");
+    result = update();
+    EXPECT_EQ(result.first, 1u);
+    auto const &results = result.second;
+
+    std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+    {
+        const sbutils::ContentCandidates candidates(*db, "Hello");
+        ASSERT_TRUE(candidates.enabled());
+        EXPECT_EQ(candidates.size(), 2u);
+        EXPECT_TRUE(candidates.isCandidate(find_file(results, fooFile)));
+        EXPECT_TRUE(candidates.isCandidate(find_file(results, barFile)));
+        EXPECT_TRUE(candidates.isCandidate(find_file(results, textFile)));
+        EXPECT_TRUE(candidates.isCandidate(find_file(results, largeFile)));
+    }
+    {
+        const sbutils::ContentCandidates candidates(*db, "world");
+        EXPECT_EQ(candidates.size(), 1u);
+        EXPECT_TRUE(candidates.isCandidate(find_file(results, fooFile)));
+        EXPECT_FALSE(candidates.isCandidate(find_file(results, barFile)));
+    }
+
+    // Short queries cannot use the index.
+    EXPECT_FALSE(sbutils::ContentCandidates(*db, "he").enabled());
+
+    // A file that has changed since it was indexed is always searched.
+    write_text(fooFile, "goodbye world");
+    const sbutils::ContentCandidates candidates(*db, "goodbye");
+    EXPECT_EQ(candidates.size(), 0u);
+    EXPECT_TRUE(candidates.isCandidate(find_file(results, fooFile)));
+    EXPECT_FALSE(candidates.isCandidate(find_file(results, barFile)));
+}
+
+TEST(DiffFolders, Pipeline) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path dataFolder = tmpDir.getPath() / path("data");
+    const std::string database = (tmpDir.getPath() / path(".database")).string();
+    const path aFolder = dataFolder / path("a");
+    const path bFolder = aFolder / path("b");
+    const path cFolder = dataFolder / path("c");
+    boost::filesystem::create_directories(bFolder);
+    boost::filesystem::create_directories(cFolder);
+    write_text(aFolder / path("modified.txt"), "old");
+    write_text(aFolder / path("same.txt"), "same");
+    write_text(bFolder / path("removed.txt"), "removed");
+    write_text(cFolder / path("deleted.txt"), "deleted");
+    write_text(cFolder / path("same.txt"), "same");
+    update_database(database, dataFolder);
+
+    // Modify files, remove a folder, and add files and folders.
+    write_text(aFolder / path("modified.txt"), "modified");
+    write_text(aFolder / path("new.txt"), "new");
+    boost::filesystem::remove_all(bFolder);
+    boost::filesystem::remove(cFolder / path("deleted.txt"));
+    boost::filesystem::create_directories(dataFolder / path("d"));
+    write_text(dataFolder / path("d") / path("added.txt"), "added");
+
+    // Diffing folders as they are listed gives the same result as the old
+    // path that collects all files before diffing them.
+    const std::vector<std::string> folders = {dataFolder.string()};
+    auto const expected = sbutils::diffFolders(database, folders, false);
+    auto const results = sbutils::diffFolders_tbb(database, folders, false);
+    auto paths = [](const std::vector<sbutils::FileInfo> &files) {
+        std::vector<std::string> results;
+        for (auto const &info : files) {
+            results.push_back(info.Path);
+        }
+        return results;
+    };
+    EXPECT_EQ(paths(std::get<0>(results)), paths(std::get<0>(expected)));
+    EXPECT_EQ(paths(std::get<1>(results)), paths(std::get<1>(expected)));
+    EXPECT_EQ(paths(std::get<2>(results)), paths(std::get<2>(expected)));
+
+    const std::string root = dataFolder.string();
+    EXPECT_EQ(paths(std::get<0>(results)),
+              (std::vector<std::string>{root + "/a/modified.txt"}));
+    EXPECT_EQ(paths(std::get<1>(results)),
+              (std::vector<std::string>{root + "/a/b/removed.txt", root + "/c/deleted.txt"}));
+    EXPECT_EQ(paths(std::get<2>(results)),
+              (std::vector<std::string>{root + "/a/new.txt", root + "/d/added.txt"}));
+}
+
+TEST(ContentHashes, PruneHashes) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path dataFolder = tmpDir.getPath() / path("data");
+    const std::string database = (tmpDir.getPath() / path(".database")).string();
+    boost::filesystem::create_directories(dataFolder);
+    const path fooFile = dataFolder / path("foo.txt");
+    const path barFile = dataFolder / path("bar.txt");
+    write_text(fooFile, "foo");
+    write_text(barFile, "bar");
+    auto results = update_database(database, dataFolder);
+    {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        EXPECT_EQ(sbutils::update_hashes(*db, results.AllFiles), 2u);
+        EXPECT_EQ(sbutils::prune_hashes(*db, results.AllFiles), 0u);
+    }
+    const auto oldFoo = find_file(results, fooFile);
+    const auto oldBar = find_file(results, barFile);
+
+    // Only hashes of the current versions of files are kept.
+    write_text(fooFile, "modified");
+    boost::filesystem::remove(barFile);
+    results = update_database(database, dataFolder);
+    std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+    EXPECT_EQ(sbutils::update_hashes(*db, results.AllFiles), 1u);
+    EXPECT_EQ(sbutils::prune_hashes(*db, results.AllFiles), 2u);
+    std::uint64_t value;
+    EXPECT_FALSE(sbutils::read_hash(*db, oldFoo, value));
+    EXPECT_FALSE(sbutils::read_hash(*db, oldBar, value));
+    EXPECT_TRUE(sbutils::read_hash(*db, find_file(results, fooFile), value));
+    EXPECT_EQ(find_keys(*db, sbutils::Resources::HashKey).size(), 1u);
+}
+
+TEST(DatabaseFormat, Positive) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path dataFolder = tmpDir.getPath() / path("data");
+    const std::string database = (tmpDir.getPath() / path(".database")).string();
+    boost::filesystem::create_directories(dataFolder);
+    write_text(dataFolder / path("foo.txt"), "foo");
+    update_database(database, dataFolder);
+    EXPECT_NO_THROW(std::unique_ptr<rocksdb::DB>(sbutils::open(database)));
+
+    // Databases of an old format cannot be read.
+    {
+        rocksdb::Options options;
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database, options));
+        db->Delete(rocksdb::WriteOptions(), sbutils::Resources::FormatKey);
+        db->Put(rocksdb::WriteOptions(), sbutils::Resources::ContentFileKey, "stale");
+        db->Put(rocksdb::WriteOptions(), sbutils::Resources::ContentExtensionKey, "settings");
+    }
+    try {
+        std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+        ADD_FAILURE() << "An old database is opened";
+    } catch (std::runtime_error &e) {
+        EXPECT_NE(std::string(e.what()).find("mupdatedb"), std::string::npos);
+    }
+
+    // Rebuilding a database removes its old records but keeps its settings.
+    update_database(database, dataFolder);
+    std::unique_ptr<rocksdb::DB> db(sbutils::open(database));
+    std::string value;
+    const rocksdb::ReadOptions readOpts;
+    EXPECT_FALSE(db->Get(readOpts, sbutils::Resources::ContentFileKey, &value).ok());
+    EXPECT_TRUE(db->Get(readOpts, sbutils::Resources::ContentExtensionKey, &value).ok());
+    EXPECT_EQ(value, "settings");
+}
@@ -0,0 +1,43 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+#include "sbutils/DataStructures.hpp"
+#include "sbutils/FuzzySearch.hpp"
+
+#include "TestData.hpp"
+
+TEST(FuzzyScorer, Positive) {
+    sbutils::FuzzyScorer scorer("fsh");
+    EXPECT_NE(scorer.score("/src/FileSearch.hpp"), sbutils::FuzzyScorer::NoMatch);
+    EXPECT_EQ(scorer.score("/src/Timer.hpp"), sbutils::FuzzyScorer::NoMatch);
+
+    // Matches in file names and at word boundaries are preferred.
+    EXPECT_GT(scorer.score("/src/file_search.hpp"), scorer.score("/fsh/test/data.cpp"));
+    EXPECT_GT(scorer.score("/src/fsh.cpp"), scorer.score("/src/fxsxh.cpp"));
+
+    // Smart case: an upper case character makes the pattern case sensitive.
+    sbutils::FuzzyScorer caseScorer("FS");
+    EXPECT_NE(caseScorer.score("/src/FileSearch.hpp"), sbutils::FuzzyScorer::NoMatch);
+    EXPECT_EQ(caseScorer.score("/src/filesearch.hpp"), sbutils::FuzzyScorer::NoMatch);
+}
+
+TEST(FuzzyFilter, Positive) {
+    std::vector<sbutils::FileInfo> data;
+    for (int idx = 0; idx < 10000; ++idx) {
+        data.emplace_back(createFileInfo("/src/module" + std::to_string(idx) + "/data.txt"));
+    }
+    data.emplace_back(createFileInfo("/src/utils/FileSearch.hpp"));
+    data.emplace_back(createFileInfo("/src/utils/FolderDiff.hpp"));
+
+    auto results = sbutils::fuzzy_filter_tbb(data, sbutils::FuzzyScorer("filesearch"), 5);
+    ASSERT_EQ(results.size(), static_cast<size_t>(1));
+    EXPECT_EQ(results[0].Item.Path, "/src/utils/FileSearch.hpp");
+
+    results = sbutils::fuzzy_filter_tbb(data, sbutils::FuzzyScorer("data"), 3);
+    ASSERT_EQ(results.size(), static_cast<size_t>(3));
+    EXPECT_GE(results[0].Score, results[1].Score);
+    EXPECT_GE(results[1].Score, results[2].Score);
+}
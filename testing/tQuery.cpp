@@ -0,0 +1,135 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "gtest/gtest.h"
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "sbutils/DataStructures.hpp"
+#include "sbutils/Query.hpp"
+
+#include "TestData.hpp"
+
+namespace {
+    bool match(const std::string &expr, const sbutils::FileInfo &info) {
+        return sbutils::Query(sbutils::query::parse(expr)).isValid(info);
+    }
+} // namespace
+
+TEST(Query, Predicates) {
+    const std::time_t now = std::time(nullptr);
+    const auto info = createFileInfo("/src/utils/FileSearch.hpp", 4096, now - 60, 0755);
+
+    EXPECT_TRUE(match("", info));
+    EXPECT_TRUE(match("ext:.hpp", info));
+    EXPECT_TRUE(match("ext:cpp,hpp", info));
+    EXPECT_FALSE(match("ext:.cpp", info));
+    EXPECT_TRUE(match("stem:FileSearch", info));
+    EXPECT_TRUE(match("path:utils/", info));
+    EXPECT_TRUE(match("Search", info));
+    EXPECT_FALSE(match("size>4K", info));
+    EXPECT_TRUE(match("size>=4K", info));
+    EXPECT_TRUE(match("size<1M", info));
+    EXPECT_TRUE(match("mtime<1h", info));
+    EXPECT_FALSE(match("mtime>1h", info));
+    EXPECT_TRUE(match("perm:111", info));
+    EXPECT_FALSE(match("perm:002", info));
+}
+
+TEST(Query, Operators) {
+    const std::time_t now = std::time(nullptr);
+    const auto info = createFileInfo("/src/test/data.cpp", 100, now - 86400 * 3);
+
+    EXPECT_TRUE(match("ext:.cpp path:test", info));
+    EXPECT_TRUE(match("ext:.cpp and path:test", info));
+    EXPECT_FALSE(match("ext:.cpp && not path:test", info));
+    EXPECT_TRUE(match("ext:.hpp or stem:data", info));
+    EXPECT_TRUE(match("!(ext:.hpp || size>1K)", info));
+    EXPECT_FALSE(match("not (ext:.cpp and mtime>2d)", info));
+    EXPECT_TRUE(match("(ext:.hpp or ext:.cpp) and not (size<10 or mtime<1d)", info));
+    EXPECT_TRUE(match("path:\"src/test\"", info));
+
+    EXPECT_THROW(sbutils::query::parse("(ext:.cpp"), std::runtime_error);
+    EXPECT_THROW(sbutils::query::parse("ext:.cpp or"), std::runtime_error);
+    EXPECT_THROW(sbutils::query::parse("size>"), std::runtime_error);
+    EXPECT_THROW(sbutils::query::parse("size<=abc"), std::runtime_error);
+    EXPECT_THROW(sbutils::query::parse("mtime>-1d"), std::runtime_error);
+    EXPECT_THROW(sbutils::query::parse("perm:"), std::runtime_error);
+    EXPECT_THROW(sbutils::query::parse("perm:rwx"), std::runtime_error);
+    EXPECT_THROW(sbutils::query::parse("perm:0800"), std::runtime_error);
+}
+
+TEST(Query, FieldPrefixes) {
+    // Words that only start with a field name are path predicates.
+    const auto info = createFileInfo("/usr/include/sizeof/size_t.h", 100, 0);
+    EXPECT_TRUE(match("sizeof", info));
+    EXPECT_TRUE(match("size_t.h", info));
+    EXPECT_TRUE(match("size", info));
+    EXPECT_FALSE(match("mtimes.log", info));
+    EXPECT_TRUE(match("sizeof and size<1K", info));
+}
+
+TEST(Query, Plan) {
+    // Negations are pushed down and cheap predicates are evaluated first.
+    const sbutils::Query q1(sbutils::query::parse("path:test and size>1K and ext:.cpp"));
+    EXPECT_EQ(q1.str(), "(and size>=1025 ext:.cpp path:test)");
+
+    const sbutils::Query q2(sbutils::query::parse("not (size>1K or path:test)"));
+    EXPECT_EQ(q2.str(), "(and size<=1024 !path:test)");
+
+    // Summaries are used to skip vertexes.
+    sbutils::VertexSummary summary;
+    summary.update(createFileInfo("/src/a.cpp", 100, 0));
+    summary.update(createFileInfo("/src/b.cpp", 200, 0));
+    EXPECT_TRUE(q2.isValid(summary));
+    EXPECT_FALSE(q1.isValid(summary));
+    const sbutils::Query q3(sbutils::query::parse("size>300 or mtime<1h"));
+    EXPECT_FALSE(q3.isValid(summary));
+}
+
+TEST(Query, IgnoreCase) {
+    const std::string aPath("/Src/Utils/FileSearch_With_A_Long_Name.HPP");
+    for (size_t pos = 0; pos < aPath.size(); ++pos) {
+        for (size_t len = 1; pos + len <= aPath.size(); ++len) {
+            const std::string needle = sbutils::ascii::to_lower(aPath.substr(pos, len));
+            const std::string lowered = sbutils::ascii::to_lower(aPath);
+            const char *begin = aPath.data();
+            const char *end = begin + aPath.size();
+            EXPECT_EQ(sbutils::ascii::ifind(begin, end, needle) - begin,
+                      static_cast<std::ptrdiff_t>(lowered.find(needle)));
+        }
+    }
+    const char *end = aPath.data() + aPath.size();
+    EXPECT_EQ(sbutils::ascii::ifind(aPath.data(), end, "filesearch_without"), end);
+
+    const auto info = createFileInfo(aPath, 0, 0);
+    sbutils::StringTable exts;
+    exts.intern(".cpp");
+    exts.intern(".HPP");
+    auto match = [&info, &exts](const std::string &expr) {
+        return sbutils::Query(sbutils::query::parse(expr), exts, true).isValid(info);
+    };
+    EXPECT_FALSE(sbutils::Query(sbutils::query::parse("path:filesearch")).isValid(info));
+    EXPECT_TRUE(match("path:filesearch"));
+    EXPECT_TRUE(match("stem:filesearch_with_a_long_name"));
+    EXPECT_FALSE(match("stem:filesearch"));
+    EXPECT_FALSE(match("ext:.hpp"));
+    EXPECT_FALSE(match("ext:.txt"));
+
+    auto indexed = info;
+    indexed.ExtId = exts.find(".HPP");
+    EXPECT_TRUE(sbutils::Query(sbutils::query::parse("ext:.hpp"), exts, true).isValid(indexed));
+    EXPECT_FALSE(sbutils::Query(sbutils::query::parse("ext:.hpp"), exts).isValid(indexed));
+}
+
+TEST(Query, Batch) {
+    std::istringstream input("ext:.cpp\n\n# A comment\nheaders\text:.hpp or ext:.h\n");
+    const auto queries = sbutils::read_batch_queries(input);
+    ASSERT_EQ(queries.size(), 2u);
+    EXPECT_EQ(queries[0].Id, "1");
+    EXPECT_EQ(queries[0].Expression, "ext:.cpp");
+    EXPECT_EQ(queries[1].Id, "headers");
+    EXPECT_EQ(queries[1].Expression, "ext:.hpp or ext:.h");
+}
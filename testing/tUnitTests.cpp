@@ -2,6 +2,7 @@
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 #include "gtest/gtest.h"
 #include <array>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <string>
@@ -9,11 +10,16 @@
 #include <vector>
 
 #include "sbutils/DataStructures.hpp"
+#include "sbutils/DeltaCopy.hpp"
 #include "sbutils/FileSearch.hpp"
 #include "sbutils/FileUtils.hpp"
+#include "sbutils/Hash.hpp"
+#include "sbutils/IoUring.hpp"
+#include "sbutils/MergeDiff.hpp"
 #include "sbutils/Print.hpp"
 #include "sbutils/TemporaryDirectory.hpp"
 #include "sbutils/Timer.hpp"
+#include "sbutils/UtilsTBB.hpp"
 
 #include "TestData.hpp"
 
@@ -211,3 +217,553 @@ TEST(DFS, Positive) {
     EXPECT_EQ(results.Graph.numberOfVertexes(), static_cast<size_t>(6));
     EXPECT_TRUE(results.Graph.isDirected());
 }
+
+TEST(StringTable, Positive) {
+    sbutils::StringTable table;
+    EXPECT_EQ(table.intern(".cpp"), 0u);
+    EXPECT_EQ(table.intern(".hpp"), 1u);
+    EXPECT_EQ(table.intern(".cpp"), 0u);
+    EXPECT_EQ(table.size(), static_cast<size_t>(2));
+    EXPECT_EQ(table[1], ".hpp");
+    EXPECT_TRUE(table.find(".txt") == sbutils::StringTable::NotFound);
+
+    // Filter files using interned extension ids.
+    std::vector<sbutils::FileInfo> files;
+    files.emplace_back(sbutils::FileInfo(0, 0, "/a/foo.cpp", "foo", ".cpp", 0, 0));
+    files.emplace_back(sbutils::FileInfo(0, 0, "/a/foo.hpp", "foo", ".hpp", 0, 1));
+    files.emplace_back(sbutils::FileInfo(0, 0, "/a/boo.txt", "boo", ".txt", 0));
+    const std::vector<std::string> exts{".hpp", ".txt"};
+    const sbutils::ExtIdFilter f1(exts, table);
+    EXPECT_FALSE(f1.isValid(files[0]));
+    EXPECT_TRUE(f1.isValid(files[1]));
+    EXPECT_FALSE(f1.isValid(files[2]));
+
+    const sbutils::ExtIdFilter f2(std::vector<std::string>(), table);
+    EXPECT_TRUE(f2.isValid(files[2]));
+
+    const std::vector<std::string> stems{"boo"};
+    const sbutils::StemFilter<std::vector<std::string>> f3(stems);
+    EXPECT_FALSE(f3.isValid(files[0]));
+    EXPECT_TRUE(f3.isValid(files[2]));
+}
+
+TEST(VertexSummary, Positive) {
+    std::vector<sbutils::FileInfo> files;
+    files.emplace_back(sbutils::FileInfo(0644, 100, "/a/foo.cpp", "foo", ".cpp", 1000, 0));
+    files.emplace_back(sbutils::FileInfo(0755, 5000, "/a/run.sh", "run", ".sh", 2000, 3));
+    const sbutils::VertexSummary summary(files);
+    EXPECT_EQ(summary.NumberOfFiles, static_cast<size_t>(2));
+    EXPECT_EQ(summary.MinSize, 100u);
+    EXPECT_EQ(summary.MaxSize, 5000u);
+    EXPECT_EQ(summary.MaxTime, 2000);
+
+    sbutils::AttributeFilter f;
+    EXPECT_TRUE(f.empty());
+    f.MinSize = 1000;
+    EXPECT_TRUE(f.isValid(summary));
+    EXPECT_FALSE(f.isValid(files[0]));
+    EXPECT_TRUE(f.isValid(files[1]));
+
+    f.NewerThan = 3000;
+    EXPECT_FALSE(f.isValid(summary));
+
+    sbutils::AttributeFilter g;
+    g.Permissions = 0111;
+    EXPECT_TRUE(g.isValid(summary));
+    EXPECT_FALSE(g.isValid(files[0]));
+    EXPECT_TRUE(g.isValid(files[1]));
+}
+
+TEST(MerkleSignature, Positive) {
+    const std::vector<std::string> paths = {"/a", "/a/b", "/a/c", "/d"};
+    EXPECT_EQ(sbutils::parent_indexes(paths), (std::vector<std::int64_t>{-1, 0, 0, -1}));
+
+    // Build a hierarchy in which only the file of a given vertex has a different size.
+    using Hierarchy = sbutils::FolderHierarchy<unsigned int>;
+    auto build = [&paths](const size_t changed) {
+        std::vector<Hierarchy::vertex_type> vertexes;
+        for (size_t idx = 0; idx < paths.size(); ++idx) {
+            std::vector<sbutils::FileInfo> files;
+            const uintmax_t size = (idx == changed) ? 11 : 10;
+            files.emplace_back(
+                sbutils::FileInfo(0644, size, paths[idx] + "/foo.cpp", "foo", ".cpp", 0));
+            vertexes.emplace_back(Hierarchy::vertex_type(paths[idx], files, 100));
+        }
+        return Hierarchy(std::move(vertexes), Hierarchy::edge_container());
+    };
+
+    const auto first = build(paths.size()), second = build(paths.size()), third = build(1);
+    for (size_t idx = 0; idx < paths.size(); ++idx) {
+        EXPECT_EQ(first.Summaries[idx].Signature, second.Summaries[idx].Signature);
+    }
+    EXPECT_EQ(first.Summaries[0].DirTime, 100);
+
+    // A change of /a/b changes the signatures of /a/b and its ancestor /a only.
+    EXPECT_NE(first.Summaries[1].FileSignature, third.Summaries[1].FileSignature);
+    EXPECT_NE(first.Summaries[1].Signature, third.Summaries[1].Signature);
+    EXPECT_EQ(first.Summaries[0].FileSignature, third.Summaries[0].FileSignature);
+    EXPECT_NE(first.Summaries[0].Signature, third.Summaries[0].Signature);
+    EXPECT_EQ(first.Summaries[2].Signature, third.Summaries[2].Signature);
+    EXPECT_EQ(first.Summaries[3].Signature, third.Summaries[3].Signature);
+}
+
+TEST(FilterStream, Positive) {
+    std::vector<sbutils::FileInfo> files;
+    for (int idx = 0; idx < 100000; ++idx) {
+        const std::string ext = (idx % 10 == 0) ? ".cpp" : ".txt";
+        files.emplace_back(
+            sbutils::FileInfo(0, idx, "/a/" + std::to_string(idx) + ext, "", ext, 0));
+    }
+    const std::vector<std::string> exts{".cpp"};
+    const sbutils::ExtFilter<std::vector<std::string>> f(exts);
+    EXPECT_EQ(sbutils::count_tbb(files, f), static_cast<size_t>(10000));
+
+    std::atomic<size_t> counter(0);
+    auto allObj = [&counter](auto const &matches) {
+        counter += matches.size();
+        return true;
+    };
+    sbutils::filter_stream_tbb(files, allObj, f);
+    EXPECT_EQ(counter.load(), static_cast<size_t>(10000));
+
+    // The scan stops early if the consumer returns false.
+    std::atomic<size_t> chunks(0);
+    auto firstObj = [&chunks](auto const &) {
+        ++chunks;
+        return false;
+    };
+    sbutils::filter_stream_tbb(files, firstObj, f);
+    EXPECT_LT(chunks.load(), static_cast<size_t>(100));
+}
+
+TEST(SortedDiff, Positive) {
+    // Use enough files to get several partitions.
+    std::vector<sbutils::FileInfo> first, second;
+    for (int idx = 0; idx < 200000; ++idx) {
+        const std::string aPath = "/a/" + sbutils::to_fixed_string(6, idx) + ".cpp";
+        if (idx % 1000 != 1) {
+            first.emplace_back(sbutils::FileInfo(0, idx, aPath, "", ".cpp", 0));
+        }
+        if (idx % 1000 != 2) {
+            second.emplace_back(
+                sbutils::FileInfo(0, (idx % 1000 == 3) ? idx + 1 : idx, aPath, "", ".cpp", 0));
+        }
+    }
+    std::reverse(second.begin(), second.end()); // Unsorted inputs are sorted first.
+
+    auto results = sbutils::sorted_diff(first, second);
+    const auto &modifiedFiles = std::get<0>(results);
+    const auto &firstOnly = std::get<1>(results);
+    const auto &secondOnly = std::get<2>(results);
+    ASSERT_EQ(modifiedFiles.size(), 200u);
+    ASSERT_EQ(firstOnly.size(), 200u);
+    ASSERT_EQ(secondOnly.size(), 200u);
+    EXPECT_EQ(modifiedFiles.front().Path, "/a/000003.cpp");
+    EXPECT_EQ(modifiedFiles.front().Size, 3u); // Modified files are taken from first.
+    EXPECT_EQ(firstOnly.back().Path, "/a/199002.cpp");
+    EXPECT_EQ(secondOnly.back().Path, "/a/199001.cpp");
+    EXPECT_TRUE(std::is_sorted(secondOnly.begin(), secondOnly.end()));
+}
+
+TEST(StatComparator, Positive) {
+    std::vector<sbutils::FileInfo> first, second;
+    for (int idx = 0; idx < 4; ++idx) {
+        sbutils::FileInfo info(0, 10, "/a/" + std::to_string(idx) + ".cpp", "", ".cpp", 0);
+        info.Inode = 1;
+        info.ModifiedTime = 100;
+        info.ChangedTime = 100;
+        first.push_back(info);
+        second.push_back(info);
+    }
+    second[1].Size = 11;          // Modified
+    second[2].ModifiedTime = 200; // Has to be hashed
+    second[3].Inode = 2;          // Has to be hashed
+
+    std::vector<std::pair<sbutils::FileInfo, sbutils::FileInfo>> ambiguous;
+    auto results = sbutils::sorted_diff(first, second, sbutils::StatComparator(), ambiguous);
+    ASSERT_EQ(std::get<0>(results).size(), 1u);
+    EXPECT_EQ(std::get<0>(results).front().Path, "/a/1.cpp");
+    ASSERT_EQ(ambiguous.size(), 2u);
+    EXPECT_EQ(ambiguous[0].first.Path, "/a/2.cpp");
+    EXPECT_EQ(ambiguous[0].second.ModifiedTime, 200);
+    EXPECT_EQ(ambiguous[1].second.Inode, 2u);
+}
+
+TEST(XXHash64, Positive) {
+    EXPECT_EQ(sbutils::xxhash64("", 0), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(sbutils::xxhash64("a", 1), 0xD24EC4F1A98C6E5BULL);
+    EXPECT_EQ(sbutils::xxhash64("abc", 3), 0x44BC2CF5AD770999ULL);
+    const std::string data = "Nobody inspects the spammish repetition";
+    EXPECT_EQ(sbutils::xxhash64(data.data(), data.size()), 0xFBCEA83C8A378BF1ULL);
+
+    // Streaming gives the same result as a single buffer.
+    std::string longData;
+    for (int idx = 0; idx < 1000; ++idx) {
+        longData += std::to_string(idx);
+    }
+    sbutils::XXHash64 h;
+    for (size_t pos = 0; pos < longData.size(); pos += 7) {
+        h.update(longData.data() + pos, std::min<size_t>(7, longData.size() - pos));
+    }
+    EXPECT_EQ(h.digest(), sbutils::xxhash64(longData.data(), longData.size()));
+}
+
+TEST(DeltaCopy, Positive) {
+    // The rolling checksum of a window equals the checksum of its content.
+    std::string data;
+    std::uint32_t seed = 12345;
+    for (int idx = 0; idx < 20000; ++idx) {
+        seed = seed * 1103515245 + 12345;
+        data += static_cast<char>(seed >> 24);
+    }
+    const size_t blockSize = 4096;
+    sbutils::delta::RollingChecksum checksum(data.data(), blockSize);
+    for (size_t pos = 0; pos < 100; ++pos) {
+        checksum.roll(data[pos], data[pos + blockSize]);
+    }
+    EXPECT_EQ(checksum.value(),
+              sbutils::delta::RollingChecksum(data.data() + 100, blockSize).value());
+
+    // Blocks of the old version are found after an insertion.
+    sbutils::TemporaryDirectory tmpDir;
+    const std::string oldFile = (tmpDir.getPath() / "old").string();
+    const std::string newFile = (tmpDir.getPath() / "new").string();
+    std::ofstream(oldFile) << data;
+    const std::string inserted = data.substr(0, 5000) + "abc" + data.substr(5000);
+    std::ofstream(newFile) << inserted;
+    sbutils::FileDescriptor fd(::open(oldFile.c_str(), O_RDONLY));
+    const auto blocks = sbutils::delta::signatures(fd.get(), data.size(), blockSize);
+    ASSERT_EQ(blocks.size(), 4u);
+    const auto matches = sbutils::delta::find_matches(inserted.data(), inserted.size(),
+                                                      blocks, blockSize);
+    ASSERT_EQ(matches.size(), 2u);
+    EXPECT_EQ(matches[0].SrcOffset, 0u);
+    EXPECT_EQ(matches[0].DstOffset, 0u);
+    EXPECT_EQ(matches[0].Length, blockSize);
+    EXPECT_EQ(matches[1].SrcOffset, 2 * blockSize + 3);
+    EXPECT_EQ(matches[1].DstOffset, 2 * blockSize);
+    EXPECT_EQ(matches[1].Length, 2 * blockSize);
+
+    // Only the changed ranges are written and the result equals the source.
+    std::string buffer;
+    auto result = sbutils::delta_copy(newFile, oldFile, buffer, 0);
+    EXPECT_TRUE(result.IsDelta);
+    EXPECT_FALSE(result.IsInPlace);
+    EXPECT_EQ(result.WrittenBytes, inserted.size() - 3 * blockSize);
+    std::ifstream is(oldFile);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(is), {}), inserted);
+
+    // The destination is up to date.
+    result = sbutils::delta_copy(newFile, oldFile, buffer, 0);
+    EXPECT_FALSE(result.IsDelta);
+    EXPECT_EQ(result.Method, sbutils::CopyMethod::None);
+}
+
+namespace {
+    std::string read_file(const std::string &aPath) {
+        std::ifstream is(aPath, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(is), {});
+    }
+
+    // Write a file with pseudo random content, a given mode, and a
+    // modification time that has a fraction of a second.
+    sbutils::FileInfo write_file(const path &aPath, const size_t size, const mode_t mode,
+                                 std::uint32_t seed) {
+        std::string data(size, 0);
+        for (auto &aByte : data) {
+            seed = seed * 1103515245 + 12345;
+            aByte = static_cast<char>(seed >> 24);
+        }
+        std::ofstream(aPath.string(), std::ios::binary) << data;
+        ::chmod(aPath.c_str(), mode);
+        const struct timespec times[2] = {{1500000000, 0},
+                                          {1500000000 + seed % 1000, 123456789}};
+        ::utimensat(AT_FDCWD, aPath.c_str(), times, 0);
+        return sbutils::FileInfo(mode, size, aPath.string(), aPath.stem().string(),
+                                 aPath.extension().string(), times[1].tv_sec);
+    }
+
+    // Check that a copy has the content, mode, and modification time of its source.
+    void expect_copy(const std::string &srcFile, const std::string &dstFile) {
+        struct stat srcStat, dstStat;
+        ASSERT_EQ(::stat(srcFile.c_str(), &srcStat), 0);
+        ASSERT_EQ(::stat(dstFile.c_str(), &dstStat), 0) << dstFile;
+        EXPECT_EQ(read_file(srcFile), read_file(dstFile)) << dstFile;
+        EXPECT_EQ(srcStat.st_mode & 07777, dstStat.st_mode & 07777) << dstFile;
+        const auto &srcTime = sbutils::detail::modification_timespec(srcStat);
+        const auto &dstTime = sbutils::detail::modification_timespec(dstStat);
+        EXPECT_EQ(srcTime.tv_sec, dstTime.tv_sec) << dstFile;
+        EXPECT_EQ(srcTime.tv_nsec, dstTime.tv_nsec) << dstFile;
+    }
+} // namespace
+
+TEST(IsUpToDate, Positive) {
+    const struct timespec srcTime = {10, 123456789};
+    auto isUpToDate = [&srcTime](const struct timespec &dstTime) {
+        return sbutils::detail::is_up_to_date(100, srcTime, 100, dstTime);
+    };
+    EXPECT_TRUE(isUpToDate({10, 123456789}));
+
+    // Times are compared at the precision of the destination.
+    EXPECT_TRUE(isUpToDate({10, 0}));
+    EXPECT_TRUE(isUpToDate({10, 123456000}));
+    EXPECT_TRUE(isUpToDate({10, 120000000}));
+    EXPECT_FALSE(isUpToDate({10, 123457000}));
+    EXPECT_FALSE(isUpToDate({10, 123456788}));
+    EXPECT_FALSE(isUpToDate({11, 0}));
+    EXPECT_FALSE(isUpToDate({9, 123456789}));
+    EXPECT_FALSE(sbutils::detail::is_up_to_date(100, srcTime, 101, srcTime));
+}
+
+TEST(CopyContent, Positive) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path srcFile = tmpDir.getPath() / "src";
+    const path dstFile = tmpDir.getPath() / "dst";
+    const size_t size = (3 << 20) + 12345;
+    write_file(srcFile, size, 0644, 1);
+    const std::string data = read_file(srcFile.string());
+
+    // Each method of the fallback chain continues where the previous one stopped.
+    {
+        sbutils::FileDescriptor in(::open(srcFile.c_str(), O_RDONLY));
+        sbutils::FileDescriptor out(::open(dstFile.c_str(), O_WRONLY | O_CREAT, 0644));
+        ASSERT_TRUE(in.isValid() && out.isValid());
+        std::string buffer(1 << 16, 0);
+        off_t offset = 0;
+        if (!sbutils::detail::kernel_copy(in.get(), out.get(), offset, size / 3)) {
+            sbutils::detail::buffered_copy(in.get(), out.get(), offset, size / 3, buffer);
+        }
+        EXPECT_EQ(offset, static_cast<off_t>(size / 3));
+        if (!sbutils::detail::sendfile_copy(in.get(), out.get(), offset, 2 * size / 3)) {
+            sbutils::detail::buffered_copy(in.get(), out.get(), offset, 2 * size / 3, buffer);
+        }
+        EXPECT_EQ(offset, static_cast<off_t>(2 * size / 3));
+        sbutils::detail::buffered_copy(in.get(), out.get(), offset, size, buffer);
+        EXPECT_EQ(offset, static_cast<off_t>(size));
+    }
+    EXPECT_EQ(read_file(dstFile.string()), data);
+
+    // A range is copied to the same offset of the destination.
+    {
+        sbutils::FileDescriptor in(::open(srcFile.c_str(), O_RDONLY));
+        sbutils::FileDescriptor out(::open(dstFile.c_str(), O_WRONLY | O_TRUNC));
+        std::string buffer;
+        sbutils::copy_range(in.get(), out.get(), 1 << 20, size, buffer);
+        sbutils::copy_range(in.get(), out.get(), 0, 1 << 20, buffer);
+    }
+    EXPECT_EQ(read_file(dstFile.string()), data);
+
+    // The whole chain. A clone is only possible on a copy-on-write file system.
+    {
+        sbutils::FileDescriptor in(::open(srcFile.c_str(), O_RDONLY));
+        sbutils::FileDescriptor out(::open(dstFile.c_str(), O_WRONLY | O_TRUNC));
+        std::string buffer;
+        const auto method = sbutils::copy_content(in.get(), out.get(), size, buffer);
+        EXPECT_NE(method, sbutils::CopyMethod::None);
+    }
+    EXPECT_EQ(read_file(dstFile.string()), data);
+}
+
+TEST(FileCopy, Positive) {
+    sbutils::TemporaryDirectory tmpDir;
+    std::string buffer;
+    for (const size_t size : {size_t(0), size_t(100), size_t((1 << 20) + 1)}) {
+        const path srcFile = tmpDir.getPath() / ("src" + std::to_string(size));
+        const path dstFile = tmpDir.getPath() / ("dst" + std::to_string(size));
+        write_file(srcFile, size, 0750, static_cast<std::uint32_t>(size));
+        EXPECT_NE(sbutils::copy_file(srcFile.string(), dstFile.string(), buffer),
+                  sbutils::CopyMethod::None);
+        expect_copy(srcFile.string(), dstFile.string());
+
+        // The copy is up to date.
+        EXPECT_EQ(sbutils::copy_file(srcFile.string(), dstFile.string(), buffer),
+                  sbutils::CopyMethod::None);
+    }
+
+    // A copy on a file system that keeps seconds only is up to date.
+    const path srcFile = tmpDir.getPath() / "src100";
+    const path dstFile = tmpDir.getPath() / "dst100";
+    struct stat srcStat;
+    ASSERT_EQ(::stat(srcFile.c_str(), &srcStat), 0);
+    const struct timespec times[2] = {
+        {0, UTIME_OMIT}, {sbutils::detail::modification_timespec(srcStat).tv_sec, 0}};
+    ::utimensat(AT_FDCWD, dstFile.c_str(), times, 0);
+    EXPECT_EQ(sbutils::copy_file(srcFile.string(), dstFile.string(), buffer),
+              sbutils::CopyMethod::None);
+
+    // A copy of a read-only file can be updated.
+    const path readOnlyFile = tmpDir.getPath() / "readonly";
+    const path readOnlyCopy = tmpDir.getPath() / "readonly.copy";
+    write_file(readOnlyFile, 1000, 0444, 1);
+    sbutils::copy_file(readOnlyFile.string(), readOnlyCopy.string(), buffer);
+    expect_copy(readOnlyFile.string(), readOnlyCopy.string());
+    ::chmod(readOnlyFile.c_str(), 0644);
+    write_file(readOnlyFile, 2000, 0444, 2);
+    EXPECT_NE(sbutils::copy_file(readOnlyFile.string(), readOnlyCopy.string(), buffer),
+              sbutils::CopyMethod::None);
+    expect_copy(readOnlyFile.string(), readOnlyCopy.string());
+
+    // A missing source is an error.
+    EXPECT_THROW(sbutils::copy_file((tmpDir.getPath() / "missing").string(),
+                                    readOnlyCopy.string(), buffer),
+                 std::runtime_error);
+}
+
+TEST(CopyScheduler, Positive) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path srcDir = tmpDir.getPath() / "src";
+    const path dstDir = tmpDir.getPath() / "dst";
+    boost::filesystem::create_directories(srcDir);
+
+    // Empty files, batches of small files, and large files that are split
+    // into several chunks with a partial last chunk.
+    const uintmax_t largeFileSize = 1 << 20, chunkSize = 256 << 10;
+    std::vector<sbutils::FileInfo> files;
+    uintmax_t totalSize = 0;
+    for (size_t idx = 0; idx < 150; ++idx) {
+        size_t size = idx * 37;
+        if (idx % 50 == 0) {
+            size = 0;
+        } else if (idx % 50 == 1) {
+            size = largeFileSize + idx * 4097;
+        }
+        const mode_t mode = (idx % 2 == 0) ? 0644 : 0755;
+        files.emplace_back(write_file(srcDir / ("file" + std::to_string(idx)), size, mode,
+                                      static_cast<std::uint32_t>(idx)));
+        totalSize += size;
+    }
+    for (auto const &info : files) {
+        boost::filesystem::create_directories((dstDir / path(info.Path)).parent_path());
+    }
+
+    sbutils::CopyScheduler scheduler(dstDir, files, false, largeFileSize, chunkSize);
+    EXPECT_EQ(scheduler.run(), std::make_tuple(files.size(), size_t(totalSize)));
+    for (auto const &info : files) {
+        expect_copy(info.Path, (dstDir / path(info.Path)).string());
+    }
+
+    // All copies are up to date.
+    sbutils::CopyScheduler another(dstDir, files, false, largeFileSize, chunkSize);
+    EXPECT_EQ(another.run(), std::make_tuple(size_t(0), size_t(0)));
+
+    // A large file that has grown since it was found is copied to its end
+    // and counted using its current size.
+    const path grownFile = srcDir / "grown";
+    std::vector<sbutils::FileInfo> grown(1, write_file(grownFile, largeFileSize + 1, 0600, 7));
+    write_file(grownFile, 2 * largeFileSize + 100, 0600, 8);
+    sbutils::CopyScheduler grownScheduler(dstDir, grown, false, largeFileSize, chunkSize);
+    EXPECT_EQ(grownScheduler.run(),
+              std::make_tuple(size_t(1), size_t(2 * largeFileSize + 100)));
+    expect_copy(grownFile.string(), (dstDir / path(grownFile)).string());
+}
+
+TEST(CopyFilesUring, Positive) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path srcDir = tmpDir.getPath() / "src";
+    const path dstDir = tmpDir.getPath() / "dst";
+    boost::filesystem::create_directories(srcDir);
+
+    // More files than slots, including empty files and files that need
+    // several reads.
+    std::vector<sbutils::FileInfo> files;
+    size_t totalSize = 0;
+    for (size_t idx = 0; idx < 20; ++idx) {
+        const size_t size = (idx % 7 == 0) ? 0 : ((idx % 5 == 0) ? (5 << 19) + idx : idx * 999);
+        const mode_t mode = (idx % 2 == 0) ? 0640 : 0755;
+        files.emplace_back(write_file(srcDir / ("file" + std::to_string(idx)), size, mode,
+                                      static_cast<std::uint32_t>(idx)));
+        totalSize += size;
+    }
+    for (auto const &info : files) {
+        boost::filesystem::create_directories((dstDir / path(info.Path)).parent_path());
+    }
+    auto dstFile = [&dstDir](const sbutils::FileInfo &info) {
+        return (dstDir / path(info.Path)).string();
+    };
+
+    EXPECT_EQ(sbutils::copyFiles_uring(files, dstDir, false, 4),
+              std::make_tuple(files.size(), totalSize));
+    for (auto const &info : files) {
+        expect_copy(info.Path, dstFile(info));
+    }
+
+    // Up to date destinations are skipped.
+    EXPECT_EQ(sbutils::copyFiles_uring(files, dstDir, false, 4),
+              std::make_tuple(size_t(0), size_t(0)));
+
+    // A read-only destination cannot be opened for writing by io_uring
+    // unless the user is root, and is copied by the fallback.
+    files[1] = write_file(srcDir / "file1", 4321, 0444, 100);
+    ::chmod(dstFile(files[1]).c_str(), 0444);
+    files[2] = write_file(srcDir / "file2", 1234, 0644, 101);
+    EXPECT_EQ(sbutils::copyFiles_uring(files, dstDir, false, 4),
+              std::make_tuple(size_t(2), size_t(4321 + 1234)));
+    expect_copy(files[1].Path, dstFile(files[1]));
+    expect_copy(files[2].Path, dstFile(files[2]));
+
+    // Files that cannot be copied, a missing source and a destination that
+    // is a folder, do not stop the other files and are reported at the end.
+    std::vector<sbutils::FileInfo> badFiles(files.begin(), files.begin() + 10);
+    badFiles.emplace_back(sbutils::FileInfo(0644, 10, (srcDir / "missing").string(),
+                                            "missing", "", 0));
+    badFiles.emplace_back(write_file(srcDir / "folder", 10, 0644, 102));
+    boost::filesystem::create_directories(dstFile(badFiles.back()));
+    for (size_t idx = 3; idx < 6; ++idx) {
+        badFiles[idx] = write_file(badFiles[idx].Path, 777 + idx, 0644, 200 + idx);
+    }
+    EXPECT_THROW(sbutils::copyFiles_uring(badFiles, dstDir, false, 2), std::runtime_error);
+    for (size_t idx = 0; idx < 10; ++idx) {
+        expect_copy(badFiles[idx].Path, dstFile(badFiles[idx]));
+    }
+}
+
+TEST(CopyFilesFanout, Positive) {
+    sbutils::TemporaryDirectory tmpDir;
+    const path srcDir = tmpDir.getPath() / "src";
+    boost::filesystem::create_directories(srcDir);
+    const std::vector<std::string> dstDirs = {(tmpDir.getPath() / "dst0").string(),
+                                              (tmpDir.getPath() / "dst1").string(),
+                                              (tmpDir.getPath() / "dst2").string()};
+
+    // A file that is read in several chunks, an empty file, and small files.
+    std::vector<sbutils::FileInfo> files;
+    size_t totalSize = 0;
+    for (size_t idx = 0; idx < 10; ++idx) {
+        const size_t size = (idx == 0) ? (9 << 20) + 123 : ((idx == 1) ? 0 : idx * 1000);
+        files.emplace_back(write_file(srcDir / ("file" + std::to_string(idx)), size, 0640,
+                                      static_cast<std::uint32_t>(idx)));
+        totalSize += size;
+    }
+    for (auto const &aDir : dstDirs) {
+        for (auto const &info : files) {
+            boost::filesystem::create_directories((path(aDir) / path(info.Path)).parent_path());
+        }
+    }
+    auto dstFile = [](const std::string &aDir, const sbutils::FileInfo &info) {
+        return (path(aDir) / path(info.Path)).string();
+    };
+
+    // The first destination is up to date and the second one has an up to
+    // date copy of the large file, which is then copied to the third one only.
+    std::string buffer;
+    for (auto const &info : files) {
+        sbutils::copy_file(info.Path, dstFile(dstDirs[0], info), buffer);
+    }
+    sbutils::copy_file(files[0].Path, dstFile(dstDirs[1], files[0]), buffer);
+
+    const auto results = sbutils::copyFiles_fanout(files, dstDirs);
+    ASSERT_EQ(results.size(), dstDirs.size());
+    EXPECT_EQ(results[0], std::make_tuple(size_t(0), size_t(0)));
+    EXPECT_EQ(results[1], std::make_tuple(files.size() - 1, totalSize - files[0].Size));
+    EXPECT_EQ(results[2], std::make_tuple(files.size(), totalSize));
+    for (auto const &aDir : dstDirs) {
+        for (auto const &info : files) {
+            expect_copy(info.Path, dstFile(aDir, info));
+        }
+    }
+
+    // All destinations are up to date.
+    for (auto const &item : sbutils::copyFiles_fanout(files, dstDirs)) {
+        EXPECT_EQ(item, std::make_tuple(size_t(0), size_t(0)));
+    }
+}
@@ -0,0 +1,52 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sbutils/DataStructures.hpp"
+#include "sbutils/Writers.hpp"
+
+#include "TestData.hpp"
+
+TEST(JSONLinesFormat, Positive) {
+    std::string buffer;
+    sbutils::JSONLinesFormat::append(buffer, createFileInfo("/src/a \"b\"\\c\td.cpp", 10, 3));
+    EXPECT_EQ(buffer, "{\"path\":\"/src/a \\\"b\\\"\\\\c\\td.cpp\",\"stem\":\"a "
+                      "\\\"b\\\"\\\\c\\td\",\"extension\":\".cpp\",\"size\":10,"
+                      "\"permissions\":420,\"timestamp\":3}\n");
+
+    // Long strings use the vectorized scan.
+    buffer.clear();
+    sbutils::detail::append_json_string(buffer, std::string(40, 'x') + '\x01' + "\xc3\xa9");
+    EXPECT_EQ(buffer, "\"" + std::string(40, 'x') + "\\u0001\xc3\xa9\"");
+}
+
+TEST(BinaryFormat, Positive) {
+    std::vector<sbutils::FileInfo> data = {createFileInfo("/src/FileSearch.hpp", 1234, -5),
+                                           createFileInfo("/src/Makefile", 0, 1500000000),
+                                           createFileInfo("/src/.gitignore", 1ull << 40, 0)};
+    std::string buffer;
+    sbutils::BinaryFormat::header(buffer);
+    for (auto const &item : data) {
+        sbutils::BinaryFormat::append(buffer, item);
+    }
+
+    std::istringstream is(buffer);
+    sbutils::BinaryFormat::check_header(is);
+    sbutils::FileInfo info;
+    for (auto const &item : data) {
+        ASSERT_TRUE(sbutils::BinaryFormat::read(is, info));
+        EXPECT_EQ(info.Path, item.Path);
+        EXPECT_EQ(info.Stem, item.Stem);
+        EXPECT_EQ(info.Extension, item.Extension);
+        EXPECT_EQ(info.Size, item.Size);
+        EXPECT_EQ(info.Permissions, item.Permissions);
+        EXPECT_EQ(info.TimeStamp, item.TimeStamp);
+    }
+    EXPECT_FALSE(sbutils::BinaryFormat::read(is, info));
+
+    std::istringstream invalid("JSON");
+    EXPECT_THROW(sbutils::BinaryFormat::check_header(invalid), std::runtime_error);
+}